@@ -7,7 +7,7 @@ namespace tempest::compiler {
   using tempest::error::diag;
   using tempest::parse::Parser;
 
-  CompilationUnit* CompilationUnit::theCU = nullptr;
+  thread_local CompilationUnit* CompilationUnit::theCU = nullptr;
 
   void CompilationUnit::addSourceFile(llvm::StringRef filepath, llvm::StringRef moduleName) {
     auto mod = _importMgr.getCachedModule(moduleName);
@@ -13,16 +13,38 @@
   #include "tempest/import/importmgr.hpp"
 #endif
 
+#ifndef TEMPEST_SEMA_CONVERT_CONFORMANCE_HPP
+  #include "tempest/sema/convert/conformance.hpp"
+#endif
+
+#ifndef TEMPEST_SEMA_CONVERT_RELATIONCACHE_HPP
+  #include "tempest/sema/convert/relationcache.hpp"
+#endif
+
+#ifndef TEMPEST_SEMA_INFER_OVERLOADCACHE_HPP
+  #include "tempest/sema/infer/overloadcache.hpp"
+#endif
+
+#ifndef TEMPEST_SEMA_INFER_OVERLOADINDEX_HPP
+  #include "tempest/sema/infer/overloadindex.hpp"
+#endif
+
 #ifndef TEMPEST_GEN_SYMBOLSTORE_HPP
   #include "tempest/gen/symbolstore.hpp"
 #endif
 
+#include <deque>
+#include <mutex>
 #include <vector>
 
 namespace tempest::compiler {
   using tempest::sema::graph::Module;
   using tempest::sema::graph::SpecializationStore;
   using tempest::sema::graph::TypeStore;
+  using tempest::sema::convert::ConformanceCache;
+  using tempest::sema::convert::RelationCache;
+  using tempest::sema::infer::OverloadCache;
+  using tempest::sema::infer::OverloadIndexStore;
   using tempest::import::ImportMgr;
   using tempest::gen::SymbolStore;
 
@@ -57,18 +79,44 @@ namespace tempest::compiler {
     /** Contains canonicalized instances of derived types. */
     SpecializationStore& spec() { return _spec; }
 
+    /** Memoized results of type relation predicates. */
+    RelationCache& relations() { return _relations; }
+
+    /** Memoized results of interface conformance checks. */
+    ConformanceCache& conformance() { return _conformance; }
+
+    /** Memoized results of overload resolution. */
+    OverloadCache& overloads() { return _overloads; }
+
+    /** Indices of large overload sets, used to filter out implausible candidates. */
+    OverloadIndexStore& overloadIndices() { return _overloadIndices; }
+
     /** Repository of output symbols to be emitted. */
     SymbolStore& symbols() { return _symbols; }
 
+    /** Create a new allocator which lives as long as the compilation unit. Used to give
+        each worker thread an arena of its own, since allocators are not thread-safe. */
+    tempest::support::BumpPtrAllocator& createArena() {
+      std::lock_guard<std::mutex> lock(_arenaMutex);
+      return _arenas.emplace_back();
+    }
+
     /** Manages imports of modules. */
     ImportMgr& importMgr() { return _importMgr; }
 
-    // Static instance of current compilation unit.
-    static CompilationUnit* theCU;
+    // Compilation unit being compiled on this thread. Passes that start worker threads set
+    // it on each worker, so that separate compilation units can be compiled concurrently.
+    static thread_local CompilationUnit* theCU;
 
   private:
+    std::deque<tempest::support::BumpPtrAllocator> _arenas;
+    std::mutex _arenaMutex;
     TypeStore _types;
     SpecializationStore _spec;
+    RelationCache _relations;
+    ConformanceCache _conformance;
+    OverloadCache _overloads;
+    OverloadIndexStore _overloadIndices;
     SymbolStore _symbols;
     ImportMgr _importMgr;
     std::vector<Module*> _sourceModules;
@@ -4,6 +4,8 @@
 #include "tempest/gen/cgtarget.hpp"
 #include "tempest/gen/codegen.hpp"
 #include "tempest/opt/basicopts.hpp"
+#include "tempest/opt/gcroots.hpp"
+#include "tempest/sema/infer/constraintsolver.hpp"
 #include "tempest/sema/pass/buildgraph.hpp"
 #include "tempest/sema/pass/dataflow.hpp"
 #include "tempest/sema/pass/expandspecialization.hpp"
@@ -23,6 +25,7 @@
 
 #include <vector>
 #include <cstdlib>
+#include <memory>
 
 using namespace llvm;
 using namespace llvm::sys;
@@ -35,6 +38,28 @@ cl::list<std::string> InputFilenames(
     cl::Positional, cl::desc("<Input files or dirs>"), cl::OneOrMore);
 cl::opt<string> OutputDir("d", llvm::cl::desc("Output directory"));
 cl::opt<string> OutputFile("o", llvm::cl::desc("Output file"));
+cl::opt<unsigned> Jobs(
+    "j",
+    llvm::cl::desc("Number of threads to use for type inference and specialization"),
+    llvm::cl::init(1));
+cl::opt<size_t> SolverBudget(
+    "solver-budget",
+    llvm::cl::desc("Maximum number of steps when searching for the best overloads"),
+    llvm::cl::init(100000));
+cl::opt<unsigned> SolverProfileCount(
+    "solver-profile",
+    llvm::cl::desc("Report the N slowest expressions for type inference"),
+    llvm::cl::init(0));
+cl::opt<bool> SolverTrace(
+    "solver-trace",
+    llvm::cl::desc("Show the status of every overload candidate after type inference"));
+cl::opt<bool> SpecializationStats(
+    "specialization-stats",
+    llvm::cl::desc("Report how much of the specialized function bodies was shared"));
+cl::opt<bool> GCWriteBarriers(
+    "gc-write-barriers",
+    llvm::cl::desc("Mark cards on reference stores, so that minor collections only scan the "
+                   "old objects that were modified"));
 
 namespace tempest::compiler {
   using tempest::error::diag;
@@ -44,6 +69,7 @@ namespace tempest::compiler {
   }
 
   int Compiler::run() {
+    tempest::sema::infer::ConstraintSolver::defaultSearchBudget = SolverBudget;
     addPackageSearchPaths();
     addSourceFiles();
     CompilationUnit::theCU = &_cu;
@@ -60,6 +86,7 @@ namespace tempest::compiler {
       target.select();
       gen::CodeGen gen(context, target);
       auto mod = gen.createModule(_cu.outputModName());
+      mod->setWriteBarriers(GCWriteBarriers);
       gen.genSymbols(_cu.symbols());
       if (diag.errorCount() == 0) {
         llvm::verifyModule(*mod->irModule(), &(llvm::errs()));
@@ -67,6 +94,8 @@ namespace tempest::compiler {
         for (auto& fn : mod->irModule()->functions()) {
           opts.run(&fn);
         }
+        opt::GCRoots roots(mod);
+        roots.run();
         // mod->irModule()->print(llvm::errs(), nullptr);
         outputModule(mod);
       }
@@ -90,8 +119,18 @@ namespace tempest::compiler {
       pass.run();
     }
     if (diag.errorCount() == 0) {
-      ResolveTypesPass pass(_cu);
+      std::unique_ptr<tempest::sema::infer::SolverProfile> profile;
+      if (SolverProfileCount > 0) {
+        profile = std::make_unique<tempest::sema::infer::SolverProfile>(SolverProfileCount);
+      }
+      tempest::sema::infer::ConstraintSolver::profile = profile.get();
+      tempest::sema::infer::ConstraintSolver::traceSites = SolverTrace;
+      ResolveTypesPass pass(_cu, Jobs);
       pass.run();
+      tempest::sema::infer::ConstraintSolver::profile = nullptr;
+      if (profile) {
+        profile->report();
+      }
     }
     if (diag.errorCount() == 0) {
       FindOverridesPass pass(_cu);
@@ -102,8 +141,13 @@ namespace tempest::compiler {
       pass.run();
     }
     if (diag.errorCount() == 0) {
-      ExpandSpecializationPass pass(_cu);
+      ExpandSpecializationPass pass(_cu, Jobs);
       pass.run();
+      if (SpecializationStats) {
+        diag.info() << "Specialization: " << pass.shared().expandedNodes()
+            << " expression nodes expanded, " << pass.shared().sharedNodes() << " shared, "
+            << pass.escapes().numStackAllocs() << " allocations on the stack.";
+      }
     }
   }
 
@@ -78,6 +78,7 @@ namespace tempest::error {
     assert(msg.size() > 0 && "Zero-length diagnostic message");
 
     _messageCountArray[(int)sev] += 1;
+    std::lock_guard<std::mutex> lock(_outputMutex);
 
     bool colorChanged = false;
     #if TEMPEST_HAVE_UNISTD_HPP
@@ -9,6 +9,8 @@
   #include "tempest/source/location.hpp"
 #endif
 
+#include <atomic>
+#include <mutex>
 #include <sstream>
 
 namespace tempest::error {
@@ -105,7 +107,8 @@ namespace tempest::error {
     int _indentLevel;
   };
 
-  /** Reporter that prints to stdout / stderr. */
+  /** Reporter that prints to stdout / stderr. Messages may be reported from multiple threads;
+      each message is written atomically. */
   class ConsoleReporter : public IndentingReporter {
   public:
     ConsoleReporter() {
@@ -138,7 +141,8 @@ namespace tempest::error {
     static ConsoleReporter INSTANCE;
 
   private:
-    int _messageCountArray[SEVERITY_LEVELS];
+    std::atomic<int> _messageCountArray[SEVERITY_LEVELS];
+    std::mutex _outputMutex;
   //   RecoveryState _recovery;
 
     void writeSpaces(unsigned numSpaces);
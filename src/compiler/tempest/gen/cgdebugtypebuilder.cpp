@@ -77,6 +77,14 @@ namespace tempest::gen {
         return irType;
       }
 
+      case Type::Kind::UNION:
+      case Type::Kind::INTERFACE: {
+        // Only named for now; a debugger shows the raw fields.
+        std::string name;
+        getLinkageName(name, ty, typeArgs);
+        return _builder.createUnspecifiedType(name);
+      }
+
       // // Nominal types
       // STRUCT, INTERFACE, TRAIT, EXTENSION, ENUM,  // Composites
       // ALIAS,          // An alias for another type
@@ -199,9 +207,9 @@ namespace tempest::gen {
               _dataLayout->getPrefTypeAlignment(memberType),
               structLayout->getElementOffsetInBits(memberIndex),
               DINode::DIFlags::FlagZero, getMemberType(vd->type(), typeArgs)));
+          memberIndex += 1;
         }
       }
-      memberIndex += 1;
     }
     DICompositeType* diCls = _builder.createClassType(
         diScope, td->name(), diFile, td->location().startLine,
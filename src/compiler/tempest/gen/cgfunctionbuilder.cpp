@@ -10,6 +10,7 @@
 #include "tempest/sema/graph/primitivetype.hpp"
 
 #include <llvm/IR/Constants.h>
+#include <llvm/IR/MDBuilder.h>
 #include <llvm/Support/Casting.h>
 
 namespace tempest::gen {
@@ -143,13 +144,10 @@ namespace tempest::gen {
       //   f->setLinkage(GlobalValue::LinkOnceODRLinkage);
       // }
 
-      // if (gcEnabled_) {
-      //   if (SsGC) {
-      //     f->setGC("shadow-stack");
-      //   } else {
-      //     f->setGC("tart-gc");
-      //   }
-      // }
+      // Roots are found with stack maps rather than a shadow stack: every call becomes a
+      // statepoint (see opt::GCRoots), and LLVM's statepoint strategy treats pointers in
+      // address space 1 as references to heap objects.
+      _irFunction->setGC("statepoint-example");
 
       if (_module->isDebug()) {
         std::string linkageName;
@@ -228,13 +226,10 @@ namespace tempest::gen {
       //   ++it;
       // }
 
-      // If this function needs to make allocations, cache a copy of the
-      // allocation context pointer for this thread, since it can on some
-      // platforms be expensive to look up.
-      // if (fdef->flags() & FunctionDefn::MakesAllocs) {
-      //   Function * gcGetAllocContext = genFunctionValue(gc_allocContext);
-      //   gcAllocContext_ = builder_.CreateCall(gcGetAllocContext, "allocCtx");
-      // }
+      // The allocation context is looked up by the first allocation in the function
+      // (see getAllocContext).
+      _gcAllocContext = nullptr;
+      _freshObject = nullptr;
 
   //     for (; it != f->arg_end(); ++it, ++param_index) {
 
@@ -396,7 +391,7 @@ namespace tempest::gen {
             return genStoreUnionValue(
                 lval, rval, static_cast<const UnionType*>(iop->args[0]->type));
           }
-          return _builder.CreateStore(rval, lval);
+          return genStore(rval, lval);
         }
         return nullptr;
       }
@@ -556,6 +551,11 @@ namespace tempest::gen {
         }
       }
 
+      case Expr::Kind::NOT: {
+        auto op = static_cast<const UnaryOp*>(expr);
+        return _builder.CreateNot(visitExpr(op->arg));
+      }
+
       case Expr::Kind::INTEGER_LITERAL:
         return visitIntegerLiteral(static_cast<IntegerLiteral*>(expr));
 
@@ -596,6 +596,24 @@ namespace tempest::gen {
         return visitCastCreateUnion(static_cast<UnaryOp*>(expr));
       }
 
+      case Expr::Kind::CAST_CREATE_INTERFACE: {
+        auto op = static_cast<InterfaceCastOp*>(expr);
+        return genInterfaceRef(
+            visitExpr(op->arg), cast<ClassInterfaceTranslationSym>(op->trans));
+      }
+
+      case Expr::Kind::IS_TYPE: {
+        auto op = static_cast<TypeTestOp*>(expr);
+        return genIsInstance(visitExpr(op->arg), cast<ClassDescriptorSym>(op->cls));
+      }
+
+      case Expr::Kind::AS_TYPE: {
+        // The result is a reference union of the class and void, where null is void.
+        auto op = static_cast<TypeTestOp*>(expr);
+        auto obj = genDowncast(visitExpr(op->arg), cast<ClassDescriptorSym>(op->cls));
+        return _builder.CreatePointerCast(obj, _module->types().get(op->type, _typeArgs));
+      }
+
       case Expr::Kind::ALLOC_OBJ:
         return visitAllocObj(static_cast<SymbolRefExpr*>(expr));
 
@@ -814,11 +832,14 @@ namespace tempest::gen {
   Value* CGFunctionBuilder::visitCall(ApplyFnOp* in) {
     Expr* stem = nullptr;
     Value* fnVal = nullptr;
+    FunctionDefn* callee = nullptr;
+    FunctionDefn* ifaceMethod = nullptr;
     StringRef fnName;
     if (auto sref = dyn_cast<SymbolRefExpr>(in->function)) {
       stem = sref->stem;
       if (auto fnSym = dyn_cast<FunctionSym>(sref->sym)) {
         fnVal = fnSym->fnVal;
+        callee = fnSym->function;
         fnName = fnSym->function->name();
       } else {
         assert(false && "Symbol type not callable");
@@ -838,7 +859,12 @@ namespace tempest::gen {
           return visitCallIntrinsic(in);
         }
         fnName = fndef->name();
-        assert(false && "Missing function value");
+        if (isInterfaceMethod(fndef)) {
+          // Dispatched through the itable carried by the receiver.
+          ifaceMethod = fndef;
+        } else {
+          assert(false && "Missing function value");
+        }
       }
     }
 
@@ -861,6 +887,10 @@ namespace tempest::gen {
     if (in->flavor != ApplyFnOp::FLEXNEW) {
       if (stem != nullptr) {
         selfArg = visitExpr(stem);
+        if (ifaceMethod) {
+          fnVal = genInterfaceMethodPtr(selfArg, ifaceMethod);
+          selfArg = _builder.CreateExtractValue(selfArg, INTERFACE_REF_OBJECT, "self");
+        }
         // Type::TypeClass selfTypeClass = in->selfArg()->type()->typeClass();
         // if (selfTypeClass == Type::Struct) {
         //   if (in->exprType() == Expr::CtorCall) {
@@ -875,10 +905,21 @@ namespace tempest::gen {
         // if (fn->storageClass() == Storage_Instance) {
         //   args.push_back(selfArg);
         // }
+      } else if (callee && !callee->selfType()) {
+        // Free functions take a context pointer in place of self; there's no closure yet.
+        selfArg = llvm::ConstantPointerNull::get(cast<llvm::PointerType>(
+            cast<llvm::Function>(fnVal)->getFunctionType()->getParamType(0)));
       } else {
         // Should have a null pointer.
         assert(false && "Implement");
       }
+      // Methods inherited from a base class take a pointer to the base class.
+      if (auto fn = dyn_cast_or_null<llvm::Function>(fnVal)) {
+        auto selfType = fn->getFunctionType()->getParamType(0);
+        if (selfArg->getType() != selfType) {
+          selfArg = _builder.CreatePointerCast(selfArg, selfType);
+        }
+      }
       args.push_back(selfArg);
     }
 
@@ -954,6 +995,8 @@ namespace tempest::gen {
     //   return result;
     // } else {
       Value * result = _builder.CreateCall(func, args);
+      // The callee may collect, after which a fresh object may have been promoted.
+      _freshObject = nullptr;
       if (!result->getType()->isVoidTy()) {
         result->setName(name);
       }
@@ -986,7 +1029,15 @@ namespace tempest::gen {
     auto argType = op->arg->type;
     auto ut = cast<UnionType>(op->type);
     auto cgu = _module->types().createUnion(ut);
-    if (!cgu->valueTypes.empty()) {
+    if (cgu->layout == CGUnionType::REFERENCE) {
+      if (argType->kind == Type::Kind::VOID) {
+        return llvm::ConstantPointerNull::get(cast<PointerType>(cgu->type));
+      } else if (argType->kind == Type::Kind::CLASS) {
+        return _builder.CreatePointerCast(arg, cgu->type);
+      } else {
+        assert(false && "Invalid member type for reference union");
+      }
+    } else if (!cgu->valueTypes.empty()) {
       if (argType->kind == Type::Kind::VOID) {
         assert(false && "Implement void to union");
       } else if (argType->kind == Type::Kind::CLASS) {
@@ -1002,25 +1053,30 @@ namespace tempest::gen {
           index += 1;
         }
         assert(index < cgu->valueTypes.size() + CGUnionType::VALUE_START);
-        // Allocate sufficient memory for the largest type
-        auto allocPtr = _builder.CreateAlloca(cgu->valueType);
-        // Cast it to the actual value type and store the value
-        auto argPtrTy = PointerType::get(_module->types().getMemberType(argType, {}), 0);
-        _builder.CreateStore(arg, _builder.CreatePointerCast(allocPtr, argPtrTy));
-
         auto pair = llvm::ConstantStruct::get(cast<llvm::StructType>(cgu->ssaType), {
             llvm::ConstantInt::get(cgu->tagType, index),
-            llvm::UndefValue::get(allocPtr->getType()),
+            llvm::UndefValue::get(cgu->valueType),
         });
 
-        return _builder.CreateInsertValue(pair, _builder.CreateLoad(allocPtr), { 1 });
+        if (cgu->registerPayload) {
+          // Widen the value to the payload integer in registers.
+          Value* bits = arg;
+          auto argTy = arg->getType();
+          if (argTy->isFloatingPointTy()) {
+            bits = _builder.CreateBitCast(
+                arg, llvm::IntegerType::get(_gen.context, argTy->getPrimitiveSizeInBits()));
+          }
+          return _builder.CreateInsertValue(
+              pair, _builder.CreateZExtOrBitCast(bits, cgu->valueType), { 1 });
+        }
 
-        // auto tagAddr = _builder.CreateStructGEP(cgu->type, allocPtr, 0);
-        // auto valueAddr = _builder.CreateStructGEP(cgu->type, allocPtr, 1);
-        // // Store the tag
-        // _builder.CreateStore(llvm::ConstantInt::get(cgu->tagType, index), tagAddr);
-        // // Store the value
-        // return _builder.CreateLoad(allocPtr);
+        // Allocate sufficient memory for the largest type
+        auto allocPtr = _builder.CreateAlloca(cgu->valueType);
+        // Cast it to the actual value type and store the value
+        auto argPtrTy = PointerType::get(_module->types().getMemberType(argType, {}), 0);
+        _builder.CreateStore(arg, _builder.CreatePointerCast(allocPtr, argPtrTy));
+        return _builder.CreateInsertValue(
+            pair, _builder.CreateLoad(cgu->valueType, allocPtr), { 1 });
       }
     } else {
       assert(false && "Implement");
@@ -1032,11 +1088,12 @@ namespace tempest::gen {
     auto clsSym = cast<ClassDescriptorSym>(in->sym);
     auto clsDesc = _module->genClassDescValue(clsSym);
     llvm::Type* clsType = _module->types().get(clsSym->typeDefn->type(), clsSym->typeArgs);
-    Value* args[2] = {
-      llvm::ConstantExpr::getSizeOf(clsType),
-      clsDesc,
-    };
-    auto alloc = _builder.CreateCall(_module->getGCAlloc(), args, "new");
+    auto size = _irModule->getDataLayout().getTypeAllocSize(clsType);
+    if (in->noEscape) {
+      return genStackAlloc(clsDesc, clsType, size);
+    }
+    auto alloc = genHeapAlloc(
+        llvm::ConstantInt::get(llvm::Type::getInt64Ty(_gen.context), size), clsDesc);
     return _builder.CreatePointerCast(alloc, clsType->getPointerTo(1));
 
     // Get gc_alloc function reference
@@ -1077,25 +1134,151 @@ namespace tempest::gen {
     auto clsDesc = _module->genClassDescValue(clsSym);
     auto clsType = cast<llvm::StructType>(
         _module->types().get(clsSym->typeDefn->type(), clsSym->typeArgs));
-    auto arrayOffset = llvm::ConstantExpr::getOffsetOf(
-        clsType, clsSym->typeDefn->numInstanceVars());
-    auto elementOffset = _builder.CreateMul(
-      numElements,
-      llvm::ConstantExpr::getSizeOf(clsType->getElementType(2)));
-
-    Value* args[2] = {
-      _builder.CreateAdd(arrayOffset, elementOffset),
-      clsDesc,
-    };
-    auto alloc = _builder.CreateCall(_module->getGCAlloc(), args, "new");
-    return _builder.CreatePointerCast(alloc, clsType->getPointerTo(1));
+    // The array is the last field.
+    auto& layout = _irModule->getDataLayout();
+    auto arrayIndex = clsType->getNumElements() - 1;
+    auto elementType = cast<llvm::ArrayType>(clsType->getElementType(arrayIndex))
+        ->getElementType();
+    auto arrayOffset = layout.getStructLayout(clsType)->getElementOffset(arrayIndex);
+    auto elementSize = layout.getTypeAllocSize(elementType);
+    Value* obj;
+    if (in->noEscape) {
+      obj = genStackAlloc(
+          clsDesc, clsType,
+          arrayOffset + cast<llvm::ConstantInt>(numElements)->getZExtValue() * elementSize);
+    } else {
+      auto sizeType = llvm::Type::getInt64Ty(_gen.context);
+      auto size = _builder.CreateAdd(
+          llvm::ConstantInt::get(sizeType, arrayOffset),
+          _builder.CreateMul(
+              _builder.CreateZExtOrTrunc(numElements, sizeType),
+              llvm::ConstantInt::get(sizeType, elementSize)));
+      obj = _builder.CreatePointerCast(genHeapAlloc(size, clsDesc), clsType->getPointerTo(1));
+    }
+
+    // The collector needs the number of elements to find the end of the object.
+    auto objType = _module->types().getObjectType();
+    auto gcAddr = _builder.CreateStructGEP(
+        objType, _builder.CreatePointerCast(obj, objType->getPointerTo(1)), OBJECT_GC,
+        "gc.addr");
+    _builder.CreateStore(
+        _builder.CreateIntToPtr(numElements, objType->getStructElementType(OBJECT_GC)), gcAddr);
+    return obj;
+  }
+
+  Value* CGFunctionBuilder::getAllocContext() {
+    // Looking up a thread-local can be expensive on some platforms, so it's only done once,
+    // at the start of the function.
+    if (!_gcAllocContext) {
+      auto& entry = _irFunction->getEntryBlock();
+      llvm::IRBuilder<> entryBuilder(&entry, entry.getFirstInsertionPt());
+      _gcAllocContext = entryBuilder.CreateCall(_module->getGCAllocContext(), {}, "allocCtx");
+    }
+    return _gcAllocContext;
+  }
+
+  Value* CGFunctionBuilder::genHeapAlloc(Value* size, llvm::Constant* clsDesc) {
+    auto& types = _module->types();
+    auto ctxType = types.getAllocContextType();
+    auto bytePtrType = ctxType->getElementType(ALLOC_CONTEXT_CURSOR);
+    auto i8Type = llvm::Type::getInt8Ty(_gen.context);
+    auto sizeType = llvm::Type::getInt64Ty(_gen.context);
+
+    // Keep the cursor pointer-aligned.
+    auto pointerAlign = _irModule->getDataLayout().getPointerABIAlignment(0).value();
+    size = _builder.CreateAnd(
+        _builder.CreateAdd(size, llvm::ConstantInt::get(sizeType, pointerAlign - 1)),
+        llvm::ConstantInt::get(sizeType, ~(pointerAlign - 1)),
+        "alloc.size");
+
+    // Bump the cursor if the object fits in what's left of the buffer.
+    auto ctx = getAllocContext();
+    auto cursorAddr = _builder.CreateStructGEP(ctxType, ctx, ALLOC_CONTEXT_CURSOR, "tlab.addr");
+    auto cursor = _builder.CreateLoad(bytePtrType, cursorAddr, "tlab.cursor");
+    auto limit = _builder.CreateLoad(
+        bytePtrType,
+        _builder.CreateStructGEP(ctxType, ctx, ALLOC_CONTEXT_LIMIT, "tlab.limit.addr"),
+        "tlab.limit");
+    auto next = _builder.CreateGEP(i8Type, cursor, size, "tlab.next");
+    auto fits = _builder.CreateICmpULE(next, limit, "tlab.fits");
+
+    auto blkFast = createBlock("alloc.fast");
+    auto blkSlow = createBlock("alloc.slow");
+    auto blkDone = createBlock("alloc.done");
+    _builder.CreateCondBr(
+        fits, blkFast, blkSlow, llvm::MDBuilder(_gen.context).createBranchWeights(2000, 1));
+
+    // Fast path: the buffer is already zero-filled, so only the header needs to be set.
+    _builder.SetInsertPoint(blkFast);
+    _builder.CreateStore(next, cursorAddr);
+    auto objType = types.getObjectType();
+    auto header = _builder.CreateStructGEP(
+        objType, _builder.CreatePointerCast(cursor, objType->getPointerTo(1)), OBJECT_CLASS,
+        "cls.addr");
+    _builder.CreateStore(
+        llvm::ConstantExpr::getPointerCast(
+            clsDesc, objType->getStructElementType(OBJECT_CLASS)),
+        header);
+    _builder.CreateBr(blkDone);
+
+    // Slow path: let the runtime refill the buffer, or collect.
+    _builder.SetInsertPoint(blkSlow);
+    Value* args[2] = { size, clsDesc };
+    auto slowAlloc = _builder.CreatePointerCast(
+        _builder.CreateCall(_module->getGCAlloc(), args), bytePtrType);
+    _builder.CreateBr(blkDone);
+
+    _builder.SetInsertPoint(blkDone);
+    auto result = _builder.CreatePHI(bytePtrType, 2, "new");
+    result->addIncoming(cursor, blkFast);
+    result->addIncoming(slowAlloc, blkSlow);
+    // Any collection happened before the object was allocated, so it's in the nursery (or
+    // the runtime has already marked its card).
+    _freshObject = result;
+    _freshObjectBlock = blkDone;
+    return result;
+  }
+
+  Value* CGFunctionBuilder::genStackAlloc(
+      llvm::Constant* clsDesc, llvm::Type* clsType, uint64_t size) {
+    auto i8Type = llvm::Type::getInt8Ty(_gen.context);
+    auto align = llvm::Align(16);
+
+    // Put the slot in the entry block so that it's allocated once per call, rather than once
+    // per loop iteration.
+    auto& entry = _irFunction->getEntryBlock();
+    llvm::IRBuilder<> entryBuilder(&entry, entry.getFirstInsertionPt());
+    auto slot = entryBuilder.CreateAlloca(llvm::ArrayType::get(i8Type, size), nullptr, "obj");
+    slot->setAlignment(align);
+
+    // Start out the same as an object from gc_alloc: zero-filled, with the class descriptor
+    // in the header.
+    _builder.CreateMemSet(slot, llvm::ConstantInt::get(i8Type, 0), size, align);
+    auto objType = _module->types().getObjectType();
+    auto header = _builder.CreateStructGEP(
+        objType, _builder.CreatePointerCast(slot, objType->getPointerTo()), OBJECT_CLASS,
+        "cls.addr");
+    _builder.CreateStore(
+        llvm::ConstantExpr::getPointerCast(
+            clsDesc, objType->getStructElementType(OBJECT_CLASS)),
+        header);
+    // Stack objects are reported as roots like any other reference, so that the collector
+    // can trace their fields; it won't move them, since they aren't in the heap. An
+    // addrspacecast would hide that the pointer has no heap base, which the statepoint
+    // rewriter can't handle, so go through an integer instead.
+    return _builder.CreateIntToPtr(
+        _builder.CreatePtrToInt(slot, _irModule->getDataLayout().getIntPtrType(_gen.context)),
+        clsType->getPointerTo(1),
+        "new");
   }
 
   llvm::Value* CGFunctionBuilder::visitVoidValue(Expr* e) {
     if (auto ut = dyn_cast<UnionType>(e->type)) {
       auto cgu = _module->types().createUnion(ut);
       assert(cgu->hasVoidType);
-      if (cgu->tagType) {
+      if (cgu->layout == CGUnionType::REFERENCE) {
+        return llvm::ConstantPointerNull::get(cast<PointerType>(cgu->type));
+      } else if (cgu->tagType) {
         return llvm::ConstantStruct::get(cast<llvm::StructType>(cgu->ssaType), {
             llvm::ConstantInt::get(cgu->tagType, 0),
             llvm::UndefValue::get(cgu->valueType),
@@ -1329,6 +1512,11 @@ namespace tempest::gen {
       //     diag.fatal(in) << "Invalid type shape";
       // }
 
+      // A variable holding an object reference has to be loaded first.
+      if (unqualifiedAndUnspecialized(lval->type)->kind == Type::Kind::CLASS) {
+        needsDeref = true;
+      }
+
       if (lval->stem != NULL) {
         baseHasBase = true;
       // } else {
@@ -1394,7 +1582,9 @@ namespace tempest::gen {
       llvm::Value* rval,
       const UnionType* ut) {
     auto cgu = _module->types().createUnion(ut);
-    if (!cgu->valueTypes.empty()) {
+    if (cgu->layout == CGUnionType::REFERENCE) {
+      return genStore(rval, lval);
+    } else if (!cgu->valueTypes.empty()) {
       // Extract the tag from the pair and store it.
       auto tag = _builder.CreateExtractValue(rval, 0, "tag");
       _builder.CreateStore(
@@ -1403,7 +1593,7 @@ namespace tempest::gen {
 
       // Load the value from the pair and store it in the value slot.
       auto value = _builder.CreateExtractValue(rval, 1);
-      return _builder.CreateStore(
+      return genStore(
           value,
           _builder.CreateStructGEP(
               cast<llvm::StructType>(cgu->type), lval, cgu->valueStructIndex));
@@ -1412,6 +1602,121 @@ namespace tempest::gen {
     }
   }
 
+  Value* CGFunctionBuilder::genStore(Value* value, Value* addr) {
+    auto store = _builder.CreateStore(value, addr);
+    if (!_module->writeBarriers() || addr->getType()->getPointerAddressSpace() != 1) {
+      return store;
+    }
+
+    // Nothing to record unless the value holds a reference.
+    llvm::SmallVector<uint64_t, 4> refs;
+    _module->types().addReferenceMap(value->getType(), 0, refs);
+    if (refs.empty()) {
+      return store;
+    }
+
+    // Field addresses are constant offsets from the start of the object.
+    auto obj = addr->stripInBoundsOffsets();
+    if (isa<llvm::IntToPtrInst>(obj)) {
+      // Allocated on the stack (see genStackAlloc), so never scanned through the card table.
+      return store;
+    }
+    if (obj == _freshObject && _builder.GetInsertBlock() == _freshObjectBlock) {
+      // Still in the nursery, which is scanned in full.
+      return store;
+    }
+    genWriteBarrier(obj);
+    return store;
+  }
+
+  void CGFunctionBuilder::genWriteBarrier(Value* obj) {
+    // Inlined once the safepoints are in place (see opt::GCRoots).
+    auto barrier = _module->getGCWriteBarrier();
+    _builder.CreateCall(
+        barrier,
+        { _builder.CreatePointerCast(obj, barrier->getFunctionType()->getParamType(0)) });
+  }
+
+  Value* CGFunctionBuilder::genIsInstance(Value* obj, ClassDescriptorSym* cls) {
+    // Load the class ID from the object's class descriptor.
+    auto objType = _module->types().getObjectType();
+    auto clsDescType = _module->types().getClassDescType();
+    auto objPtr = _builder.CreatePointerCast(obj, objType->getPointerTo(1));
+    auto clsDescAddr = _builder.CreateStructGEP(objType, objPtr, OBJECT_CLASS, "cls.addr");
+    auto clsDesc = _builder.CreatePointerCast(
+        _builder.CreateLoad(objType->getStructElementType(OBJECT_CLASS), clsDescAddr, "cls.raw"),
+        clsDescType->getPointerTo(),
+        "cls");
+    auto idType = llvm::Type::getInt32Ty(_irModule->getContext());
+    auto idAddr = _builder.CreateStructGEP(clsDescType, clsDesc, CLASS_DESC_ID, "cls.id.addr");
+    auto id = _builder.CreateLoad(idType, idAddr, "cls.id");
+
+    // A class with no subclasses has a single ID.
+    if (cls->classIdEnd == cls->classId + 1) {
+      return _builder.CreateICmpEQ(id, llvm::ConstantInt::get(idType, cls->classId), "isa");
+    }
+
+    // Otherwise it's a range check, which only needs one unsigned compare:
+    // (id - classId) < (classIdEnd - classId).
+    auto offset = _builder.CreateSub(id, llvm::ConstantInt::get(idType, cls->classId));
+    return _builder.CreateICmpULT(
+        offset, llvm::ConstantInt::get(idType, cls->classIdEnd - cls->classId), "isa");
+  }
+
+  Value* CGFunctionBuilder::genDowncast(Value* obj, ClassDescriptorSym* cls) {
+    auto isInstance = genIsInstance(obj, cls);
+    auto clsType = _module->types().get(cls->typeDefn->type(), cls->typeArgs)->getPointerTo(1);
+    return _builder.CreateSelect(
+        isInstance,
+        _builder.CreatePointerCast(obj, clsType),
+        llvm::ConstantPointerNull::get(clsType),
+        "as");
+  }
+
+  Value* CGFunctionBuilder::genInterfaceRef(Value* obj, ClassInterfaceTranslationSym* tsym) {
+    auto refType = _module->types().getInterfaceRefType();
+    auto itable = _module->genInterfaceMethodsValue(tsym);
+    Value* result = llvm::UndefValue::get(refType);
+    result = _builder.CreateInsertValue(
+        result,
+        _builder.CreatePointerCast(obj, refType->getElementType(INTERFACE_REF_OBJECT)),
+        INTERFACE_REF_OBJECT);
+    result = _builder.CreateInsertValue(
+        result,
+        llvm::ConstantExpr::getPointerCast(
+            itable, refType->getElementType(INTERFACE_REF_METHODS)),
+        INTERFACE_REF_METHODS,
+        "iref");
+    return result;
+  }
+
+  Value* CGFunctionBuilder::genInterfaceMethodPtr(Value* ifaceRef, FunctionDefn* method) {
+    auto& types = _module->types();
+    auto refType = types.getInterfaceRefType();
+    auto fnPtrType = llvm::Type::getVoidTy(_gen.context)->getPointerTo();
+
+    // The itable comes with the reference, so finding the method is a single load.
+    auto itable = _builder.CreateExtractValue(ifaceRef, INTERFACE_REF_METHODS, "itable");
+    auto slot = _builder.CreateConstInBoundsGEP1_32(
+        fnPtrType, itable, method->methodIndex(), "imethod.addr");
+    auto fnRaw = _builder.CreateLoad(fnPtrType, slot, "imethod.raw");
+
+    // Implementations take the object as their self argument.
+    llvm::SmallVector<llvm::Type*, 16> paramTypes;
+    paramTypes.push_back(refType->getElementType(INTERFACE_REF_OBJECT));
+    for (auto param : method->type()->paramTypes) {
+      paramTypes.push_back(types.getMemberType(param, _typeArgs));
+    }
+    auto funcType = llvm::FunctionType::get(
+        types.getMemberType(method->type()->returnType, _typeArgs), paramTypes, false);
+    return _builder.CreatePointerCast(fnRaw, funcType->getPointerTo(), "imethod");
+  }
+
+  bool CGFunctionBuilder::isInterfaceMethod(FunctionDefn* method) {
+    auto td = dyn_cast_or_null<TypeDefn>(method->definedIn());
+    return td && td->type()->kind == Type::Kind::INTERFACE && !method->isStatic();
+  }
+
   bool CGFunctionBuilder::genTestExpr(Expr* test, BasicBlock* blkTrue, BasicBlock* blkFalse) {
     switch (test->kind) {
       case Expr::Kind::LOGICAL_AND: {
@@ -38,6 +38,7 @@ namespace tempest::gen {
   class CGModule;
   class CGTypeBuilder;
   class ClassDescriptorSym;
+  class ClassInterfaceTranslationSym;
 
   /** Basic block in the code flow graph. */
   class CGFunctionBuilder {
@@ -76,6 +77,11 @@ namespace tempest::gen {
     llvm::Function* _irFunction = nullptr;
     llvm::DIScope* _lexicalScope = nullptr;
     llvm::Value* _implicitSelf = nullptr;
+    llvm::Value* _gcAllocContext = nullptr;
+    /** The most recent heap allocation, and the block it's in, for as long as nothing could
+        have collected since. */
+    llvm::Value* _freshObject = nullptr;
+    llvm::BasicBlock* _freshObjectBlock = nullptr;
     std::vector<llvm::Value*> _locals;
 
     llvm::Value* visitExpr(Expr* expr);
@@ -110,6 +116,41 @@ namespace tempest::gen {
         Expr* in, SmallVectorImpl<llvm::Value*>& indices, std::stringstream& label);
     llvm::Value* genStoreUnionValue(llvm::Value* lval, llvm::Value* rval, const UnionType* ut);
 
+    /** Store a value to memory, followed by a write barrier if the module requires one. */
+    llvm::Value* genStore(llvm::Value* value, llvm::Value* addr);
+
+    /** Mark the card of an object that a reference has been stored into. */
+    void genWriteBarrier(llvm::Value* obj);
+
+    /** Allocate an object on the garbage-collected heap. Bump-allocates inline from the
+        thread's allocation buffer, and only calls the runtime when the buffer is full. */
+    llvm::Value* genHeapAlloc(llvm::Value* size, llvm::Constant* clsDesc);
+
+    /** Return this thread's allocation context, looking it up once per function. */
+    llvm::Value* getAllocContext();
+
+    /** Allocate an object which doesn't escape the current function on the stack. */
+    llvm::Value* genStackAlloc(llvm::Constant* clsDesc, llvm::Type* clsType, uint64_t size);
+
+    /** Generate a test of whether an object is an instance of a class (or a subclass of it),
+        using the class ID ranges assigned by SymbolStore::assignClassIds. */
+    llvm::Value* genIsInstance(llvm::Value* obj, ClassDescriptorSym* cls);
+
+    /** Generate a downcast of an object to a class, producing null if the object isn't an
+        instance of that class. */
+    llvm::Value* genDowncast(llvm::Value* obj, ClassDescriptorSym* cls);
+
+    /** Generate an interface reference from an object and the translation of its class to
+        the interface. */
+    llvm::Value* genInterfaceRef(llvm::Value* obj, ClassInterfaceTranslationSym* tsym);
+
+    /** Generate the address of the implementation of an interface method, looked up in the
+        itable of an interface reference. */
+    llvm::Value* genInterfaceMethodPtr(llvm::Value* ifaceRef, FunctionDefn* method);
+
+    /** True if calls to this method have to be dispatched through an itable. */
+    static bool isInterfaceMethod(FunctionDefn* method);
+
     /** Create a new basic block and append it to the current function. */
     llvm::BasicBlock* createBlock(const llvm::Twine& blkName);
 
@@ -9,6 +9,7 @@
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/Support/Casting.h>
 #include <llvm/Support/Path.h>
+#include <algorithm>
 
 namespace tempest::gen {
   using namespace tempest::sema::graph;
@@ -76,9 +77,13 @@ namespace tempest::gen {
     // Create a temporary builder for the entry point func.
     llvm::IRBuilder<> _builder(_context);
 
-    // Call the entry point function.
+    // Set up the heap, then call the entry point function.
     BasicBlock * blkEntry = BasicBlock::Create(_context, "entry", mainFn);
     _builder.SetInsertPoint(blkEntry);
+    auto i32Type = llvm::IntegerType::get(_context, 32);
+    auto gcInit = _irModule->getOrInsertFunction(
+        "gc_init", llvm::FunctionType::get(llvm::Type::getVoidTy(_context), { i32Type }, false));
+    _builder.CreateCall(gcInit, { llvm::ConstantInt::get(i32Type, _writeBarriers ? 1 : 0) });
     auto result = _builder.CreateCall(fn, {
       llvm::Constant::getNullValue(llvm::Type::getVoidTy(_context)->getPointerTo()),
     });
@@ -195,6 +200,67 @@ namespace tempest::gen {
     return _gcAlloc;
   }
 
+  llvm::Function* CGModule::getGCAllocContext() {
+    if (!_gcAllocContext) {
+      // Signature is gc_alloc_context() -> AllocContext*.
+      llvm::Type* funcType = llvm::FunctionType::get(
+        _types.getAllocContextType()->getPointerTo(), false);
+      _gcAllocContext = llvm::Function::Create(
+          cast<llvm::FunctionType>(funcType),
+          llvm::Function::ExternalLinkage,
+          "gc_alloc_context",
+          _irModule.get());
+      _gcAllocContext->addFnAttr(llvm::Attribute::NoUnwind);
+      // Never collects, so calls to it don't need to be safepoints.
+      _gcAllocContext->addFnAttr("gc-leaf-function");
+    }
+
+    return _gcAllocContext;
+  }
+
+  llvm::Function* CGModule::getGCWriteBarrier() {
+    if (!_gcWriteBarrier) {
+      // Signature is gc_write_barrier(Object addrspace(1)*).
+      auto objPtrType = _types.getObjectType()->getPointerTo(1);
+      llvm::Type* funcType = llvm::FunctionType::get(
+          llvm::Type::getVoidTy(_context), { objPtrType }, false);
+      _gcWriteBarrier = llvm::Function::Create(
+          cast<llvm::FunctionType>(funcType),
+          llvm::Function::InternalLinkage,
+          "gc_write_barrier",
+          _irModule.get());
+      _gcWriteBarrier->addFnAttr(llvm::Attribute::NoUnwind);
+      _gcWriteBarrier->addFnAttr(llvm::Attribute::NoInline);
+      _gcWriteBarrier->addFnAttr("gc-leaf-function");
+
+      // The card table pointer is set by gc_init before any generated code runs.
+      auto i8Type = llvm::Type::getInt8Ty(_context);
+      auto cardTable = new GlobalVariable(
+          *_irModule,
+          i8Type->getPointerTo(),
+          false,
+          GlobalVariable::ExternalLinkage,
+          nullptr,
+          "gc_card_table");
+
+      llvm::IRBuilder<> builder(BasicBlock::Create(_context, "entry", _gcWriteBarrier));
+      auto intPtrType = _irModule->getDataLayout().getIntPtrType(_context);
+      auto cards = builder.CreateLoad(cardTable->getValueType(), cardTable, "cards");
+      cards->setMetadata(llvm::LLVMContext::MD_invariant_load, llvm::MDNode::get(_context, {}));
+      auto index = builder.CreateAnd(
+          builder.CreateLShr(builder.CreatePtrToInt(_gcWriteBarrier->getArg(0), intPtrType),
+              CARD_SHIFT),
+          llvm::ConstantInt::get(intPtrType, CARD_INDEX_MASK),
+          "card.index");
+      builder.CreateStore(
+          llvm::ConstantInt::get(i8Type, CARD_DIRTY),
+          builder.CreateInBoundsGEP(i8Type, cards, index, "card"));
+      builder.CreateRetVoid();
+    }
+
+    return _gcWriteBarrier;
+  }
+
   GlobalVariable* CGModule::genClassDescValue(ClassDescriptorSym* sym) {
     if (sym->desc) {
       return sym->desc;
@@ -231,15 +297,39 @@ namespace tempest::gen {
         *_irModule, methodTableData->getType(), true,
         llvm::GlobalValue::LinkageTypes::ExternalLinkage, methodTableData, linkageNameMethods);
 
+    // Instance layout
+    auto& layout = _irModule->getDataLayout();
+    auto clsType = cast<llvm::StructType>(_types.get(sym->typeDefn->type(), sym->typeArgs));
+    uint64_t instanceSize = layout.getTypeAllocSize(clsType);
+    uint64_t elementSize = 0;
+    auto lastField = clsType->getElementType(clsType->getNumElements() - 1);
+    auto flexArray = dyn_cast<llvm::ArrayType>(lastField);
+    if (flexArray && flexArray->getNumElements() == 0) {
+      instanceSize = layout.getStructLayout(clsType)->getElementOffset(
+          clsType->getNumElements() - 1);
+      elementSize = layout.getTypeAllocSize(flexArray->getElementType());
+    }
+
     // Class descriptor properties
-    llvm::Constant* clsDescProps[3] = {
+    auto idType = llvm::Type::getInt32Ty(_context);
+    llvm::Constant* clsDescProps[8] = {
       llvm::ConstantPointerNull::get(clsDescType->getPointerTo()),
-      methodTable,
+      llvm::ConstantPointerNull::get(_types.getClassInterfaceTransType()->getPointerTo()),
+      llvm::ConstantExpr::getPointerCast(
+          methodTable, clsDescType->getElementType(CLASS_DESC_METHODS)),
+      llvm::ConstantInt::get(idType, sym->classId),
+      llvm::ConstantInt::get(idType, sym->classIdEnd),
+      llvm::ConstantInt::get(idType, instanceSize),
+      llvm::ConstantInt::get(idType, elementSize),
       llvm::ConstantPointerNull::get(
-          llvm::Type::getVoidTy(_context)->getPointerTo()->getPointerTo()),
+          cast<llvm::PointerType>(clsDescType->getElementType(CLASS_DESC_TRACE))),
     };
+    if (auto traceTable = genTraceTable(sym, clsType, instanceSize, elementSize)) {
+      clsDescProps[CLASS_DESC_TRACE] = llvm::ConstantExpr::getPointerCast(
+          traceTable, clsDescType->getElementType(CLASS_DESC_TRACE));
+    }
     if (sym->baseClsSym) {
-      clsDescProps[0] = genClassDescValue(sym->baseClsSym);
+      clsDescProps[CLASS_DESC_BASE] = genClassDescValue(sym->baseClsSym);
     }
 
     // Class descriptor global var
@@ -247,6 +337,53 @@ namespace tempest::gen {
     return clsDesc;
   }
 
+  GlobalVariable* CGModule::genTraceTable(
+      ClassDescriptorSym* sym,
+      llvm::StructType* clsType,
+      uint64_t instanceSize,
+      uint64_t elementSize) {
+    // The instance bitmap is followed by the element bitmap, each padded out to whole words
+    // so that the collector can find the second from the sizes in the class descriptor.
+    auto bytesPerMapWord = _irModule->getDataLayout().getPointerSize() * 64;
+    SmallVector<uint64_t, 4> instanceMap;
+    _types.addReferenceMap(clsType, 0, instanceMap);
+    instanceMap.resize((instanceSize + bytesPerMapWord - 1) / bytesPerMapWord, 0);
+    SmallVector<uint64_t, 4> elementMap;
+    if (elementSize > 0) {
+      auto flexArray = cast<llvm::ArrayType>(
+          clsType->getElementType(clsType->getNumElements() - 1));
+      _types.addReferenceMap(flexArray->getElementType(), 0, elementMap);
+      elementMap.resize((elementSize + bytesPerMapWord - 1) / bytesPerMapWord, 0);
+    }
+
+    auto hasReferences = [](uint64_t word) { return word != 0; };
+    if (std::none_of(instanceMap.begin(), instanceMap.end(), hasReferences)
+        && std::none_of(elementMap.begin(), elementMap.end(), hasReferences)) {
+      // Nothing to trace.
+      return nullptr;
+    }
+
+    SmallVector<llvm::Constant*, 8> words;
+    auto wordType = llvm::Type::getInt64Ty(_context);
+    for (auto word : instanceMap) {
+      words.push_back(llvm::ConstantInt::get(wordType, word));
+    }
+    for (auto word : elementMap) {
+      words.push_back(llvm::ConstantInt::get(wordType, word));
+    }
+    auto traceData = llvm::ConstantArray::get(
+        llvm::ArrayType::get(wordType, words.size()), words);
+
+    std::string linkageName;
+    linkageName.reserve(64);
+    getLinkageName(linkageName, sym->typeDefn, sym->typeArgs);
+    linkageName.append("::trace");
+    sym->traceTable = new llvm::GlobalVariable(
+        *_irModule, traceData->getType(), true,
+        llvm::GlobalValue::LinkageTypes::ExternalLinkage, traceData, linkageName);
+    return sym->traceTable;
+  }
+
   GlobalVariable* CGModule::genInterfaceDescValue(InterfaceDescriptorSym* sym) {
     if (sym->desc) {
       return sym->desc;
@@ -281,20 +418,49 @@ namespace tempest::gen {
     getLinkageName(linkageName, sym->cls->typeDefn, sym->cls->typeArgs);
     linkageName.append("::");
     getLinkageName(linkageName, sym->iface->typeDefn, sym->iface->typeArgs);
-    linkageName.append("::methods");
+    linkageName.append("::iftrans");
     sym->desc = new llvm::GlobalVariable(
-        *_irModule, _types.getClassDescType(), true,
+        *_irModule, _types.getClassInterfaceTransType(), true,
         llvm::GlobalValue::LinkageTypes::ExternalLinkage, nullptr, linkageName);
     return sym->desc;
   }
 
+  GlobalVariable* CGModule::genInterfaceMethodsValue(ClassInterfaceTranslationSym* sym) {
+    if (sym->methods) {
+      return sym->methods;
+    }
+    std::string linkageName;
+    linkageName.reserve(64);
+    getLinkageName(linkageName, sym->cls->typeDefn, sym->cls->typeArgs);
+    linkageName.append("::");
+    getLinkageName(linkageName, sym->iface->typeDefn, sym->iface->typeArgs);
+    linkageName.append("::itable");
+    sym->methods = new llvm::GlobalVariable(
+        *_irModule,
+        llvm::ArrayType::get(
+            llvm::Type::getVoidTy(_context)->getPointerTo(), sym->methodTable.size()),
+        true, llvm::GlobalValue::LinkageTypes::ExternalLinkage, nullptr, linkageName);
+    return sym->methods;
+  }
+
   GlobalVariable* CGModule::genClassInterfaceTrans(ClassInterfaceTranslationSym* sym) {
     auto transDesc = genClassInterfaceTransValue(sym);
     auto transDescType = _types.getClassInterfaceTransType();
+
+    // Interface method table (itable), in interface method order.
+    auto itable = genInterfaceMethodsValue(sym);
+    auto fnPtrType = llvm::Type::getVoidTy(_context)->getPointerTo();
+    SmallVector<llvm::Constant*, 16> methodRefs;
+    for (auto m : sym->methodTable) {
+      assert(m->fnVal && "Function values must be declared before interface tables");
+      methodRefs.push_back(llvm::ConstantExpr::getPointerCast(m->fnVal, fnPtrType));
+    }
+    itable->setInitializer(llvm::ConstantArray::get(
+        cast<llvm::ArrayType>(itable->getValueType()), methodRefs));
+
     llvm::Constant* clsDescProps[2] = {
-      genInterfaceDesc(sym->iface),
-      llvm::ConstantPointerNull::get(
-          llvm::Type::getVoidTy(_context)->getPointerTo()->getPointerTo()),
+      genInterfaceDescValue(sym->iface),
+      llvm::ConstantExpr::getPointerCast(itable, transDescType->getElementType(1)),
     };
     transDesc->setInitializer(llvm::ConstantStruct::get(transDescType, clsDescProps));
     return transDesc;
@@ -90,6 +90,11 @@ namespace tempest::gen {
     /** If true, means we're generating debug info. */
     bool isDebug() const { return _debug; }
 
+    /** If true, stores of references into heap objects are followed by a write barrier
+        that marks the object's card. */
+    bool writeBarriers() const { return _writeBarriers; }
+    void setWriteBarriers(bool enable) { _writeBarriers = enable; }
+
     /** Generate code to call function fdef as the main entry point. */
     void makeEntryPoint(FunctionDefn* fdef);
 
@@ -103,6 +108,14 @@ namespace tempest::gen {
     llvm::GlobalVariable* genClassDescValue(ClassDescriptorSym* clsSym);
     llvm::GlobalVariable* genClassDesc(ClassDescriptorSym* clsSym);
 
+    /** Generate the bitmap of reference fields that the collector uses to trace instances of
+        a class. Returns nullptr if instances don't contain any references. */
+    llvm::GlobalVariable* genTraceTable(
+        ClassDescriptorSym* clsSym,
+        llvm::StructType* clsType,
+        uint64_t instanceSize,
+        uint64_t elementSize);
+
     /** Generate static interface descriptor struct. */
     llvm::GlobalVariable* genInterfaceDescValue(InterfaceDescriptorSym* clsSym);
     llvm::GlobalVariable* genInterfaceDesc(InterfaceDescriptorSym* clsSym);
@@ -111,9 +124,25 @@ namespace tempest::gen {
     llvm::GlobalVariable* genClassInterfaceTransValue(ClassInterfaceTranslationSym* clsSym);
     llvm::GlobalVariable* genClassInterfaceTrans(ClassInterfaceTranslationSym* clsSym);
 
-    /** Return a reference to the allocator function for garbage-collected memory. */
+    /** Generate the itable of a class for an interface: an array of the class's
+        implementations of the interface methods, indexed by interface method index. */
+    llvm::GlobalVariable* genInterfaceMethodsValue(ClassInterfaceTranslationSym* clsSym);
+
+    /** Return a reference to the allocator function for garbage-collected memory. Generated
+        code only calls this when the thread's allocation buffer is full. */
     llvm::Function* getGCAlloc();
 
+    /** Return a reference to the runtime function that returns the current thread's
+        allocation context. */
+    llvm::Function* getGCAllocContext();
+
+    /** Return a reference to the write barrier, which marks the card of an object that a
+        reference was stored into. It's defined in this module, and is kept out of line until
+        opt::GCRoots has rewritten the safepoints: before that, the optimizer doesn't know
+        that an object may move during a call, and would reuse a card address computed before
+        the call for a store after it. */
+    llvm::Function* getGCWriteBarrier();
+
   private:
     llvm::LLVMContext& _context;
     std::unique_ptr<llvm::Module> _irModule;
@@ -126,7 +155,10 @@ namespace tempest::gen {
     CGTypeBuilder _types;
     CGDebugTypeBuilder _diTypeBuilder;
     llvm::Function* _gcAlloc = nullptr;
+    llvm::Function* _gcAllocContext = nullptr;
+    llvm::Function* _gcWriteBarrier = nullptr;
     bool _debug;
+    bool _writeBarriers = false;
   };
 }
 
@@ -71,8 +71,12 @@ namespace tempest::gen {
         }
       }
 
+      case Type::Kind::INTERFACE: {
+        return getInterfaceRefType();
+      }
+
       // // Nominal types
-      // STRUCT, INTERFACE, TRAIT, EXTENSION, ENUM,  // Composites
+      // STRUCT, TRAIT, EXTENSION, ENUM,  // Composites
       // ALIAS,          // An alias for another type
       // TYPE_VAR,       // Reference to a template parameter
 
@@ -199,6 +203,7 @@ namespace tempest::gen {
     unsigned int largestAlign = 0;
 
     if (!cgu->valueTypes.empty()) {
+      cgu->registerPayload = !cgu->hasRefType && !cgu->hasInterfaceType;
       for (auto mt : cgu->valueTypes) {
         auto ty = getMemberType(mt, {});
         auto size = _dataLayout->getTypeStoreSize(ty);
@@ -207,6 +212,13 @@ namespace tempest::gen {
           cgu->valueType = ty;
         }
         largestAlign = std::max(largestAlign, _dataLayout->getABITypeAlignment(ty));
+        if (!ty->isIntegerTy() && !ty->isFloatingPointTy()) {
+          cgu->registerPayload = false;
+        }
+      }
+      if (cgu->registerPayload) {
+        // Every member can be converted losslessly to an integer of the largest member's size.
+        cgu->valueType = llvm::IntegerType::get(_context, largestSize * 8);
       }
       if (cgu->hasRefType) {
         auto objectPtr = getMemberType(IntrinsicDefns::get()->objectClass->type(), {});
@@ -259,7 +271,10 @@ namespace tempest::gen {
     } else if (cgu->hasInterfaceType) {
       assert(false && "Implement");
     } else if (cgu->hasRefType) {
+      // Only classes and possibly void: no tag needed.
+      cgu->layout = CGUnionType::REFERENCE;
       cgu->type = cgu->valueType = getMemberType(IntrinsicDefns::get()->objectClass->type(), {});
+      cgu->ssaType = cgu->type;
     } else {
       assert(false && "Empty union?");
     }
@@ -276,17 +291,59 @@ namespace tempest::gen {
     return _objectType;
   }
 
+  void CGTypeBuilder::addReferenceMap(
+      llvm::Type* ty, uint64_t offset, llvm::SmallVectorImpl<uint64_t>& bitmap) {
+    if (auto ptrType = dyn_cast<llvm::PointerType>(ty)) {
+      if (ptrType->getAddressSpace() == 1) {
+        auto wordSize = _dataLayout->getPointerSize();
+        assert(offset % wordSize == 0);
+        auto word = offset / wordSize;
+        if (bitmap.size() <= word / 64) {
+          bitmap.resize(word / 64 + 1, 0);
+        }
+        bitmap[word / 64] |= uint64_t(1) << (word % 64);
+      }
+    } else if (auto structType = dyn_cast<llvm::StructType>(ty)) {
+      if (structType->isPacked()) {
+        // Tagged union. The payload is only a reference for some values of the tag, and
+        // class members can't be converted to a tagged union yet (see visitCastCreateUnion),
+        // so the payload never holds one.
+        return;
+      }
+      auto layout = _dataLayout->getStructLayout(structType);
+      for (unsigned i = 0; i < structType->getNumElements(); i += 1) {
+        addReferenceMap(
+            structType->getElementType(i), offset + layout->getElementOffset(i), bitmap);
+      }
+    } else if (auto arrayType = dyn_cast<llvm::ArrayType>(ty)) {
+      auto elementSize = _dataLayout->getTypeAllocSize(arrayType->getElementType());
+      for (uint64_t i = 0; i < arrayType->getNumElements(); i += 1) {
+        addReferenceMap(arrayType->getElementType(), offset + i * elementSize, bitmap);
+      }
+    }
+  }
+
   llvm::StructType* CGTypeBuilder::getClassDescType() {
     if (!_classDescType) {
       // Class descriptor fields:
       // - base class
       // - interface table
       // - method table
+      // - class ID
+      // - end of the range of subclass IDs
+      // - instance size, not including any flex-allocated elements
+      // - size of a flex-allocated element, or 0
+      // - reference bitmap of the instance, followed by that of an element
       _classDescType = llvm::StructType::create(_context, "ClassDescriptor");
-      llvm::Type* descFieldTypes[3] = {
+      llvm::Type* descFieldTypes[8] = {
         _classDescType->getPointerTo(),
         getClassInterfaceTransType()->getPointerTo(),
         llvm::Type::getVoidTy(_context)->getPointerTo()->getPointerTo(),
+        llvm::Type::getInt32Ty(_context),
+        llvm::Type::getInt32Ty(_context),
+        llvm::Type::getInt32Ty(_context),
+        llvm::Type::getInt32Ty(_context),
+        llvm::Type::getInt64Ty(_context)->getPointerTo(),
       };
       _classDescType->setBody(descFieldTypes);
     }
@@ -321,4 +378,32 @@ namespace tempest::gen {
     }
     return _classInterfaceTransType;
   }
+
+  llvm::StructType* CGTypeBuilder::getInterfaceRefType() {
+    if (!_interfaceRefType) {
+      // Interface reference fields:
+      // - object
+      // - itable of the object's class for the interface
+      _interfaceRefType = llvm::StructType::create(_context, "InterfaceRef");
+      llvm::Type* refFieldTypes[2] = {
+        llvm::PointerType::get(getObjectType(), 1), // GC address space
+        llvm::Type::getVoidTy(_context)->getPointerTo()->getPointerTo(),
+      };
+      _interfaceRefType->setBody(refFieldTypes);
+    }
+    return _interfaceRefType;
+  }
+
+  llvm::StructType* CGTypeBuilder::getAllocContextType() {
+    if (!_allocContextType) {
+      // Allocation context fields:
+      // - next free byte in the thread's allocation buffer
+      // - end of the buffer
+      _allocContextType = llvm::StructType::create(_context, "AllocContext");
+      auto bytePtrType = llvm::Type::getInt8Ty(_context)->getPointerTo(1); // GC address space
+      llvm::Type* contextFieldTypes[2] = { bytePtrType, bytePtrType };
+      _allocContextType->setBody(contextFieldTypes);
+    }
+    return _allocContextType;
+  }
 }
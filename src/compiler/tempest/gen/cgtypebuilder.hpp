@@ -41,6 +41,17 @@ namespace tempest::gen {
       VALUE_START = 3,
     };
 
+    /** How values of the union are represented. */
+    enum Layout {
+      /** A tag followed by a payload large enough for any member. */
+      TAGGED,
+
+      /** A single object pointer. The object's class descriptor serves as the tag, and void
+          is represented by null. Used when every member is a class or void. */
+      REFERENCE,
+    };
+
+    Layout layout = TAGGED;
     llvm::Type* type;
     llvm::Type* ssaType;
     llvm::IntegerType* tagType = nullptr;
@@ -49,10 +60,54 @@ namespace tempest::gen {
     bool hasInterfaceType = false;
     bool hasVoidType = false;
 
+    /** True if every member is a scalar that fits in 'valueType', which is then an integer
+        type. Values are built and stored as SSA aggregates, without going through memory. */
+    bool registerPayload = false;
+
     SmallVector<const Type*, 4> valueTypes;
     size_t valueStructIndex = 0;
   };
 
+  /** Indices of the fields of a class descriptor. */
+  enum ClassDescField {
+    CLASS_DESC_BASE,
+    CLASS_DESC_INTERFACES,
+    CLASS_DESC_METHODS,
+    CLASS_DESC_ID,
+    CLASS_DESC_ID_END,
+    CLASS_DESC_SIZE,
+    CLASS_DESC_ELEMENT_SIZE,
+    CLASS_DESC_TRACE,
+  };
+
+  /** Indices of the fields of the object header. For flex-allocated objects, the GC word
+      holds the number of elements until the collector moves the object. */
+  enum ObjectHeaderField {
+    OBJECT_CLASS,
+    OBJECT_GC,
+  };
+
+  /** Indices of the fields of an interface reference. A value of interface type is a pair of
+      the object and the itable of its class for that interface, so that calling a method
+      through it doesn't need to search for the itable. */
+  enum InterfaceRefField {
+    INTERFACE_REF_OBJECT,
+    INTERFACE_REF_METHODS,
+  };
+
+  /** Indices of the fields of a thread's allocation context. Objects are bump-allocated from
+      [cursor, limit); the runtime hands out buffers that are already zero-filled. */
+  enum AllocContextField {
+    ALLOC_CONTEXT_CURSOR,
+    ALLOC_CONTEXT_LIMIT,
+  };
+
+  /** Card table parameters, which must agree with the runtime. A card covers 2^CARD_SHIFT
+      bytes of the heap, and card indices wrap around at the size of the table. */
+  constexpr unsigned CARD_SHIFT = 9;
+  constexpr uint64_t CARD_INDEX_MASK = ((uint64_t(64) << 30) >> CARD_SHIFT) - 1;
+  constexpr uint8_t CARD_DIRTY = 1;
+
   /** Maps Tempest type expressions to LLVM types. */
   class CGTypeBuilder {
   public:
@@ -70,6 +125,13 @@ namespace tempest::gen {
     llvm::StructType* getClassDescType();
     llvm::StructType* getInterfaceDescType();
     llvm::StructType* getClassInterfaceTransType();
+    llvm::StructType* getInterfaceRefType();
+    llvm::StructType* getAllocContextType();
+
+    /** Add the references contained in a value of type 'ty', located 'offset' bytes from the
+        start of an object, to a bitmap that has one bit per pointer-sized word. */
+    void addReferenceMap(
+        llvm::Type* ty, uint64_t offset, llvm::SmallVectorImpl<uint64_t>& bitmap);
 
   private:
     llvm::Type* createClass(const UserDefinedType*, ArrayRef<const Type*> typeArgs);
@@ -90,6 +152,8 @@ namespace tempest::gen {
     llvm::Type* _objectType = nullptr;
     llvm::StructType* _classDescType = nullptr;
     llvm::StructType* _interfaceDescType = nullptr;
+    llvm::StructType* _interfaceRefType = nullptr;
+    llvm::StructType* _allocContextType = nullptr;
     llvm::StructType* _classInterfaceTransType = nullptr;
   };
 }
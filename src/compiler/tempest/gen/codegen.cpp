@@ -16,13 +16,22 @@ namespace tempest::gen {
   }
 
   void CodeGen::genSymbols(SymbolStore& symbols) {
+    // Declare all functions first, since method tables refer to them.
     for (auto sym : symbols.list()) {
       if (auto fsym = dyn_cast<FunctionSym>(sym)) {
         CGFunctionBuilder builder(*this, _module, fsym->typeArgs);
         assert(fsym->body);
         fsym->fnVal = builder.genFunctionValue(fsym->function);
-      } else if (auto clsSym = dyn_cast<ClassDescriptorSym>(sym)) {
+      }
+    }
+
+    for (auto sym : symbols.list()) {
+      if (auto clsSym = dyn_cast<ClassDescriptorSym>(sym)) {
         _module->genClassDesc(clsSym);
+      } else if (auto ifaceSym = dyn_cast<InterfaceDescriptorSym>(sym)) {
+        _module->genInterfaceDesc(ifaceSym);
+      } else if (auto transSym = dyn_cast<ClassInterfaceTranslationSym>(sym)) {
+        _module->genClassInterfaceTrans(transSym);
       }
     }
 
@@ -150,7 +150,8 @@ namespace tempest::gen {
         break;
       }
 
-      case Type::Kind::CLASS: {
+      case Type::Kind::CLASS:
+      case Type::Kind::INTERFACE: {
         auto udt = static_cast<const UserDefinedType*>(ty);
         getDefnLinkageName(out, udt->defn(), typeArgs);
         break;
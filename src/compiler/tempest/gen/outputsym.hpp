@@ -96,6 +96,16 @@ namespace tempest::gen {
     /** Table of implemented interfaces. */
     ArrayRef<ClassInterfaceTranslationSym*> interfaceTable;
 
+    /** Bitmap of the words in an instance that hold references, or nullptr if there
+        aren't any. */
+    llvm::GlobalVariable* traceTable = nullptr;
+
+    /** Preorder number of this class among all class descriptors, and one past the highest
+        number of any of its subclasses. An object is an instance of this class if and only if
+        the ID of its class is in [classId, classIdEnd). */
+    uint32_t classId = 0;
+    uint32_t classIdEnd = 0;
+
     ClassDescriptorSym(TypeDefn* typeDefn, ArrayRef<const Type*> typeArgs)
       : OutputSym(Kind::CLS_DESC, typeArgs)
       , typeDefn(typeDefn)
@@ -137,6 +147,10 @@ namespace tempest::gen {
     /** Type descriptor constant. */
     llvm::GlobalVariable* desc = nullptr;
 
+    /** The interface method table (itable): the class's implementation of each method of the
+        interface, in the interface's method order. */
+    llvm::GlobalVariable* methods = nullptr;
+
     ClassInterfaceTranslationSym(ClassDescriptorSym* cls, InterfaceDescriptorSym* iface)
       : OutputSym(Kind::CLS_IFACE_TRANS, llvm::ArrayRef<Type*>())
       , cls(cls)
@@ -2,20 +2,25 @@
 #include "llvm/Support/Casting.h"
 
 namespace tempest::gen {
+  /** Log of symbols referenced by this thread, if any. */
+  static thread_local std::vector<OutputSym*>* symbolLog = nullptr;
+
   FunctionSym* SymbolStore::addFunction(
       FunctionDefn* function, const ArrayRef<const Type*>& typeArgs) {
     assert(function->allTypeParams().size() == typeArgs.size());
     assert(function->body());
     SpecializationKey key(function, typeArgs);
+    std::lock_guard<std::mutex> lock(_mutex);
     auto it = _functions.find(key);
     if (it != _functions.end()) {
+      added(it->second, false);
       return it->second;
     }
 
     auto fs = new (_alloc) FunctionSym(function, _alloc.copyOf(typeArgs));
     SpecializationKey newKey(function, fs->typeArgs);
     _functions[newKey] = fs;
-    _list.push_back(fs);
+    added(fs, true);
     return fs;
   }
 
@@ -23,15 +28,17 @@ namespace tempest::gen {
       TypeDefn* typeDefn, const ArrayRef<const Type*>& typeArgs) {
     assert(typeDefn->allTypeParams().size() == typeArgs.size());
     SpecializationKey key(typeDefn, typeArgs);
+    std::lock_guard<std::mutex> lock(_mutex);
     auto it = _classes.find(key);
     if (it != _classes.end()) {
+      added(it->second, false);
       return it->second;
     }
 
     auto cds = new (_alloc) ClassDescriptorSym(typeDefn, _alloc.copyOf(typeArgs));
     SpecializationKey newKey(typeDefn, cds->typeArgs);
     _classes[newKey] = cds;
-    _list.push_back(cds);
+    added(cds, true);
     return cds;
   }
 
@@ -39,30 +46,34 @@ namespace tempest::gen {
       TypeDefn* typeDefn, const ArrayRef<const Type*>& typeArgs) {
     assert(typeDefn->allTypeParams().size() == typeArgs.size());
     SpecializationKey key(typeDefn, typeArgs);
+    std::lock_guard<std::mutex> lock(_mutex);
     auto it = _interfaces.find(key);
     if (it != _interfaces.end()) {
+      added(it->second, false);
       return it->second;
     }
 
     auto ids = new (_alloc) InterfaceDescriptorSym(typeDefn, _alloc.copyOf(typeArgs));
     SpecializationKey newKey(typeDefn, ids->typeArgs);
     _interfaces[newKey] = ids;
-    _list.push_back(ids);
+    added(ids, true);
     return ids;
   }
 
   GlobalVarSym* SymbolStore::addGlobalVar(
       ValueDefn* varDefn, const ArrayRef<const Type*>& typeArgs) {
     SpecializationKey key(varDefn, typeArgs);
+    std::lock_guard<std::mutex> lock(_mutex);
     auto it = _globals.find(key);
     if (it != _globals.end()) {
+      added(it->second, false);
       return it->second;
     }
 
     auto gs = new (_alloc) GlobalVarSym(varDefn, _alloc.copyOf(typeArgs));
     SpecializationKey newKey(varDefn, gs->typeArgs);
     _globals[newKey] = gs;
-    _list.push_back(gs);
+    added(gs, true);
     return gs;
   }
 
@@ -70,16 +81,94 @@ namespace tempest::gen {
       ClassDescriptorSym* cls,
       InterfaceDescriptorSym* iface) {
     auto key = std::make_pair(cls, iface);
+    std::lock_guard<std::mutex> lock(_mutex);
     auto it = _clsIfTrans.find(key);
     if (it != _clsIfTrans.end()) {
+      added(it->second, false);
       return it->second;
     }
     auto cit = new (_alloc) ClassInterfaceTranslationSym(cls, iface);
     _clsIfTrans[key] = cit;
-    _list.push_back(cit);
+    added(cit, true);
     return cit;
   }
 
+  void SymbolStore::beginRound() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    assert(!_inRound);
+    _inRound = true;
+  }
+
+  void SymbolStore::endRound(llvm::ArrayRef<std::vector<OutputSym*>> logs) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    assert(_inRound);
+    for (auto& log : logs) {
+      for (auto sym : log) {
+        if (_pending.erase(sym)) {
+          _list.push_back(sym);
+        }
+      }
+    }
+    assert(_pending.empty() && "Symbol added during a round without a log");
+    _inRound = false;
+  }
+
+  void SymbolStore::setLog(std::vector<OutputSym*>* log) {
+    symbolLog = log;
+  }
+
+  std::vector<OutputSym*>* SymbolStore::log() {
+    return symbolLog;
+  }
+
+  void SymbolStore::added(OutputSym* sym, bool isNew) {
+    if (isNew) {
+      if (_inRound) {
+        _pending.insert(sym);
+      } else {
+        _list.push_back(sym);
+      }
+    }
+    if (symbolLog) {
+      symbolLog->push_back(sym);
+    }
+  }
+
+  namespace {
+    typedef std::unordered_map<ClassDescriptorSym*, std::vector<ClassDescriptorSym*>> SubclassMap;
+
+    void numberClasses(ClassDescriptorSym* cls, const SubclassMap& subclasses, uint32_t& nextId) {
+      cls->classId = nextId++;
+      auto it = subclasses.find(cls);
+      if (it != subclasses.end()) {
+        for (auto sub : it->second) {
+          numberClasses(sub, subclasses, nextId);
+        }
+      }
+      cls->classIdEnd = nextId;
+    }
+  }
+
+  void SymbolStore::assignClassIds() {
+    // Classes are visited in list order, so the numbering is as deterministic as the list.
+    SubclassMap subclasses;
+    std::vector<ClassDescriptorSym*> roots;
+    for (auto sym : _list) {
+      if (auto cls = dyn_cast<ClassDescriptorSym>(sym)) {
+        if (cls->baseClsSym) {
+          subclasses[cls->baseClsSym].push_back(cls);
+        } else {
+          roots.push_back(cls);
+        }
+      }
+    }
+
+    uint32_t nextId = 0;
+    for (auto cls : roots) {
+      numberClasses(cls, subclasses, nextId);
+    }
+  }
+
   FunctionSym* SymbolStore::findFunction(StringRef name) {
     auto it = std::find_if(_functions.begin(), _functions.end(), [name](auto& sym) {
       return sym.second->function->name() == name;
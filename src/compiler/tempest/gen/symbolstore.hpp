@@ -5,6 +5,9 @@
   #include "tempest/gen/outputsym.hpp"
 #endif
 
+#include <mutex>
+#include <unordered_set>
+
 namespace tempest::gen {
   template<class A, class B>
   struct PairHash {
@@ -15,9 +18,11 @@ namespace tempest::gen {
     }
   };
 
-  /** Contains all of the output symbols. */
+  /** Contains all of the output symbols. Symbols may be added from multiple threads; each
+      distinct symbol is only created once. */
   class SymbolStore {
   public:
+    /** The store's allocator. Unlike the add methods, this is not thread-safe. */
     tempest::support::BumpPtrAllocator& alloc() { return _alloc; }
 
     /** Methods to add a symbol if it doesn't already exist. */
@@ -32,6 +37,28 @@ namespace tempest::gen {
     /** List of all output symbols in the order in which they were added. */
     std::vector<OutputSym*>& list() { return _list; }
 
+    /** Begin a round in which symbols are added from several threads at once. Until the
+        round ends, new symbols are held back from the list, and each thread records every
+        symbol it adds or looks up in the log set by 'setLog'. */
+    void beginRound();
+
+    /** End a round, appending the symbols created during it to the list in the order of
+        their first appearance in 'logs'. As long as each log is filled by a single thread and
+        the logs are passed in a fixed order, the resulting order doesn't depend on the
+        timing of the threads. */
+    void endRound(llvm::ArrayRef<std::vector<OutputSym*>> logs);
+
+    /** Set the log for symbols referenced by the calling thread. */
+    static void setLog(std::vector<OutputSym*>* log);
+
+    /** The log for symbols referenced by the calling thread, if any. */
+    static std::vector<OutputSym*>* log();
+
+    /** Number all class descriptors in preorder over the class hierarchy, so that the IDs of
+        each class and its subclasses form a contiguous range. Call once all symbols have been
+        added. */
+    void assignClassIds();
+
     /** Convenience functions for unit tests. */
     FunctionSym* findFunction(StringRef name);
     ClassDescriptorSym* findClass(StringRef name);
@@ -41,7 +68,11 @@ namespace tempest::gen {
         ClassDescriptorSym* cls, InterfaceDescriptorSym* ifc);
 
   private:
+    /** Called with the lock held whenever a symbol is added or found. */
+    void added(OutputSym* sym, bool isNew);
+
     tempest::support::BumpPtrAllocator _alloc;
+    std::mutex _mutex;
 
     std::unordered_map<
         SpecializationKey<FunctionDefn>,
@@ -64,6 +95,8 @@ namespace tempest::gen {
         GlobalVarSym*,
         SpecializationKeyHash<ValueDefn>> _globals;
     std::vector<OutputSym*> _list;
+    std::unordered_set<OutputSym*> _pending;
+    bool _inRound = false;
   };
 }
 
@@ -0,0 +1,41 @@
+#include "tempest/opt/gcroots.hpp"
+
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Pass.h>
+#include <llvm/Transforms/Scalar.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <memory>
+
+namespace tempest::opt {
+  using namespace llvm;
+  GCRoots::GCRoots(CGModule* mod)
+    : _mod(mod)
+  {
+    _pm = std::make_unique<llvm::legacy::PassManager>();
+    _pm->add(createRewriteStatepointsForGCLegacyPass());
+  }
+
+  void GCRoots::run() {
+    _pm->run(*_mod->irModule());
+    inlineWriteBarriers();
+  }
+
+  void GCRoots::inlineWriteBarriers() {
+    auto barrier = _mod->irModule()->getFunction("gc_write_barrier");
+    if (!barrier) {
+      return;
+    }
+    // The calls now take the relocated references, so it's safe to expose the card address
+    // computation.
+    SmallVector<CallInst*, 32> calls;
+    for (auto user : barrier->users()) {
+      calls.push_back(cast<CallInst>(user));
+    }
+    for (auto call : calls) {
+      InlineFunctionInfo info;
+      InlineFunction(*call, info);
+    }
+    barrier->eraseFromParent();
+  }
+}
@@ -0,0 +1,36 @@
+#ifndef TEMPEST_OPT_GCROOTS_HPP
+#define TEMPEST_OPT_GCROOTS_HPP 1
+
+#ifndef TEMPEST_GEN_CGMODULE_HPP
+  #include "tempest/gen/cgmodule.hpp"
+#endif
+
+#ifndef LLVM_IR_LEGACYPASSMANAGER_H
+  #include <llvm/IR/LegacyPassManager.h>
+#endif
+
+#include <memory>
+
+namespace tempest::opt {
+  using namespace tempest::gen;
+
+  /** Rewrites every call in a garbage-collected function as a statepoint, which records the
+      live references in that frame. The backend turns these into the stack maps that the
+      collector uses to find and update its roots. This has to run after the other
+      optimizations, since they don't know how to look through statepoints. Write barriers
+      are inlined afterwards (see CGModule::getGCWriteBarrier). */
+  class GCRoots {
+  public:
+    GCRoots(CGModule* mod);
+
+    void run();
+
+  private:
+    CGModule* _mod;
+    std::unique_ptr<llvm::legacy::PassManager> _pm;
+
+    void inlineWriteBarriers();
+  };
+}
+
+#endif
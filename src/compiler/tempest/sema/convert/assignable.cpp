@@ -1,5 +1,6 @@
 #include "tempest/error/diagnostics.hpp"
 #include "tempest/sema/convert/predicate.hpp"
+#include "tempest/sema/convert/relationcache.hpp"
 #include "tempest/sema/graph/primitivetype.hpp"
 #include "tempest/sema/infer/types.hpp"
 #include "tempest/sema/infer/overload.hpp"
@@ -14,9 +15,20 @@ namespace tempest::sema::convert {
   using tempest::sema::transform::TempMapTypeVars;
 
   ConversionResult isAssignable(const Type* dst, const Type* src) {
+    auto cache = RelationCache::current();
+    bool cacheable =
+        cache && RelationCache::isCacheable(dst) && RelationCache::isCacheable(src);
+    ConversionResult result;
+    if (cacheable && cache->lookup(RelationCache::Relation::ASSIGNABLE, dst, src, result)) {
+      return result;
+    }
     Env srcEnv;
     Env dstEnv;
-    return isAssignable(dst, 0, dstEnv, src, 0, srcEnv);
+    result = isAssignable(dst, 0, dstEnv, src, 0, srcEnv);
+    if (cacheable) {
+      cache->insert(RelationCache::Relation::ASSIGNABLE, dst, src, result);
+    }
+    return result;
   }
 
   ConversionResult isAssignable(
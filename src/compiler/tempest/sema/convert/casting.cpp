@@ -81,6 +81,14 @@ namespace tempest::sema::convert {
         }
       }
 
+      case Type::Kind::INTERFACE: {
+        if (unqualifiedAndUnspecialized(srcType)->kind == Type::Kind::CLASS) {
+          return new (_alloc) InterfaceCastOp(src->location, src, dst);
+        }
+        diag.fatal(src->location) << "Invalid cast: " << src->type << " => " << dst;
+        break;
+      }
+
       case Type::Kind::SPECIALIZED: {
         if (isEqual(dst, src->type)) {
           return src;
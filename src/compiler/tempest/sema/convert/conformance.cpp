@@ -0,0 +1,40 @@
+#include "tempest/compiler/compilationunit.hpp"
+#include "tempest/sema/convert/conformance.hpp"
+#include "tempest/sema/graph/defn.hpp"
+
+namespace tempest::sema::convert {
+  using tempest::compiler::CompilationUnit;
+
+  const Conformance* ConformanceCache::find(
+      const TypeDefn* src, const TypeArray& srcArgs,
+      const TypeDefn* dst, const TypeArray& dstArgs) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _entries.find(std::make_pair(
+        SpecializationKey<TypeDefn>(src, srcArgs),
+        SpecializationKey<TypeDefn>(dst, dstArgs)));
+    if (it != _entries.end()) {
+      _hits += 1;
+      return &it->second;
+    }
+    _misses += 1;
+    return nullptr;
+  }
+
+  Conformance& ConformanceCache::insert(
+      const TypeDefn* src, const TypeArray& srcArgs,
+      const TypeDefn* dst, const TypeArray& dstArgs,
+      Conformance&& conformance) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    // Keys don't own their type arrays, so make a stable copy.
+    auto key = std::make_pair(
+        SpecializationKey<TypeDefn>(src, _alloc.copyOf(srcArgs)),
+        SpecializationKey<TypeDefn>(dst, _alloc.copyOf(dstArgs)));
+    auto& entry = _entries[key];
+    entry = std::move(conformance);
+    return entry;
+  }
+
+  ConformanceCache* ConformanceCache::current() {
+    return CompilationUnit::theCU ? &CompilationUnit::theCU->conformance() : nullptr;
+  }
+}
@@ -0,0 +1,98 @@
+#ifndef TEMPEST_SEMA_CONVERT_CONFORMANCE_HPP
+#define TEMPEST_SEMA_CONVERT_CONFORMANCE_HPP 1
+
+#ifndef TEMPEST_SEMA_GRAPH_SPECKEY_HPP
+  #include "tempest/sema/graph/speckey.hpp"
+#endif
+
+#ifndef TEMPEST_SEMA_GRAPH_METHODTABLE_HPP
+  #include "tempest/sema/graph/methodtable.hpp"
+#endif
+
+#ifndef TEMPEST_SUPPORT_ALLOCATOR_HPP
+  #include "tempest/support/allocator.hpp"
+#endif
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+namespace tempest::sema::graph {
+  class TypeDefn;
+}
+
+namespace tempest::sema::convert {
+  using tempest::sema::graph::FunctionDefn;
+  using tempest::sema::graph::MethodTable;
+  using tempest::sema::graph::SpecializationKey;
+  using tempest::sema::graph::SpecializationKeyHash;
+  using tempest::sema::graph::TypeArray;
+  using tempest::sema::graph::TypeDefn;
+
+  /** Records whether a type conforms to an interface or trait, and if so, which members
+      of the type implement each of the interface's methods. */
+  struct Conformance {
+    /** True if the type satisfies the interface. */
+    bool conforms = false;
+
+    /** The interface methods, in the same order as 'witnesses'. */
+    std::vector<FunctionDefn*> requirements;
+
+    /** The method implementing each requirement. */
+    MethodTable witnesses;
+  };
+
+  /** Memoizes the results of conformance checks between a (possibly specialized) type
+      and an interface, so that each conformance is computed only once per compilation. Filled
+      in structurally by 'implementsMembers', and nominally by FindOverridesPass for the
+      interfaces listed in a type's 'implements' clause. Safe to use from multiple threads;
+      records are never removed, so returned pointers remain valid. */
+  class ConformanceCache {
+  public:
+    /** Return the conformance record for this pair of types, or nullptr if it has not
+        been computed yet. */
+    const Conformance* find(
+        const TypeDefn* src, const TypeArray& srcArgs,
+        const TypeDefn* dst, const TypeArray& dstArgs);
+
+    /** Add or replace the conformance record for this pair of types. */
+    Conformance& insert(
+        const TypeDefn* src, const TypeArray& srcArgs,
+        const TypeDefn* dst, const TypeArray& dstArgs,
+        Conformance&& conformance);
+
+    /** Number of entries. */
+    size_t size() const {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return _entries.size();
+    }
+
+    /** Number of lookups that found a previously computed conformance. */
+    size_t hits() const { return _hits; }
+
+    /** Number of lookups that did not find a conformance. */
+    size_t misses() const { return _misses; }
+
+    /** The conformance cache for the current compilation unit, or nullptr if there is none. */
+    static ConformanceCache* current();
+
+  private:
+    typedef std::pair<SpecializationKey<TypeDefn>, SpecializationKey<TypeDefn>> Key;
+
+    struct KeyHash {
+      std::size_t operator()(const Key& key) const {
+        std::size_t hash = SpecializationKeyHash<TypeDefn>()(key.first);
+        tempest::support::hash_combine(hash, SpecializationKeyHash<TypeDefn>()(key.second));
+        return hash;
+      }
+    };
+
+    mutable std::mutex _mutex;
+    tempest::support::BumpPtrAllocator _alloc;
+    std::unordered_map<Key, Conformance, KeyHash> _entries;
+    std::atomic<size_t> _hits = 0;
+    std::atomic<size_t> _misses = 0;
+  };
+}
+
+#endif
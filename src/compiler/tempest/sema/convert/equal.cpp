@@ -1,5 +1,6 @@
 #include "tempest/error/diagnostics.hpp"
 #include "tempest/sema/convert/predicate.hpp"
+#include "tempest/sema/convert/relationcache.hpp"
 #include "tempest/sema/graph/primitivetype.hpp"
 #include "tempest/sema/transform/applyspec.hpp"
 #include "llvm/Support/Casting.h"
@@ -11,9 +12,21 @@ namespace tempest::sema::convert {
   using tempest::sema::transform::TempMapTypeVars;
 
   bool isEqual(const Type* dst, const Type* src) {
+    auto cache = RelationCache::current();
+    bool cacheable =
+        cache && RelationCache::isCacheable(dst) && RelationCache::isCacheable(src);
+    ConversionResult cached;
+    if (cacheable && cache->lookup(RelationCache::Relation::EQUAL, dst, src, cached)) {
+      return cached.rank != ConversionRank::ERROR;
+    }
     Env srcEnv;
     Env dstEnv;
-    return isEqual(dst, 0, dstEnv, src, 0, srcEnv);
+    bool result = isEqual(dst, 0, dstEnv, src, 0, srcEnv);
+    if (cacheable) {
+      cache->insert(RelationCache::Relation::EQUAL, dst, src,
+          result ? ConversionRank::IDENTICAL : ConversionRank::ERROR);
+    }
+    return result;
   }
 
   bool isEqual(
@@ -1,5 +1,7 @@
 #include "tempest/error/diagnostics.hpp"
+#include "tempest/sema/convert/conformance.hpp"
 #include "tempest/sema/convert/predicate.hpp"
+#include "tempest/sema/convert/relationcache.hpp"
 #include "tempest/sema/graph/primitivetype.hpp"
 #include "tempest/sema/pass/resolvetypes.hpp"
 #include "tempest/sema/names/membernamelookup.hpp"
@@ -14,9 +16,20 @@ namespace tempest::sema::convert {
   using tempest::error::diag;
   using tempest::sema::transform::TempMapTypeVars;
 
-  bool implementsMembers(
+  static bool isCacheable(const Env& env) {
+    for (auto arg : env.args) {
+      if (!RelationCache::isCacheable(arg)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /** Check that 'src' has a member matching each member of 'dst', recording the matches. */
+  static bool findWitnesses(
       const TypeDefn* src, Env& srcEnv,
-      const TypeDefn* dst, Env& dstEnv) {
+      const TypeDefn* dst, Env& dstEnv,
+      Conformance& result) {
     assert(dst->type()->kind == Type::Kind::INTERFACE || dst->type()->kind == Type::Kind::TRAIT);
     // It must also implement all the members of the base interface or trait
     for (auto base : dst->extends()) {
@@ -27,14 +40,14 @@ namespace tempest::sema::convert {
         newEnv.params = sp->typeParams();
         newEnv.args = apply.transformArray(sp->typeArgs());
         if (auto baseDefn = dyn_cast<TypeDefn>(sp->generic())) {
-          if (!implementsMembers(src, srcEnv, baseDefn, newEnv)) {
+          if (!findWitnesses(src, srcEnv, baseDefn, newEnv, result)) {
             return false;
           }
         } else {
           assert(false && "Invalid base type");
         }
       } else if (auto baseDefn = dyn_cast<TypeDefn>(base)) {
-        if (!implementsMembers(src, srcEnv, baseDefn, dstEnv)) {
+        if (!findWitnesses(src, srcEnv, baseDefn, dstEnv, result)) {
           return false;
         }
       } else {
@@ -81,10 +94,28 @@ namespace tempest::sema::convert {
           if (!target) {
             return false;
           }
+          result.requirements.push_back(fdef);
+          result.witnesses.push_back({ target, {} });
         }
       }
     }
 
     return true;
   }
+
+  bool implementsMembers(
+      const TypeDefn* src, Env& srcEnv,
+      const TypeDefn* dst, Env& dstEnv) {
+    auto cache = ConformanceCache::current();
+    if (cache && isCacheable(srcEnv) && isCacheable(dstEnv)) {
+      if (auto conf = cache->find(src, srcEnv.args, dst, dstEnv.args)) {
+        return conf->conforms;
+      }
+      Conformance conf;
+      conf.conforms = findWitnesses(src, srcEnv, dst, dstEnv, conf);
+      return cache->insert(src, srcEnv.args, dst, dstEnv.args, std::move(conf)).conforms;
+    }
+    Conformance conf;
+    return findWitnesses(src, srcEnv, dst, dstEnv, conf);
+  }
 }
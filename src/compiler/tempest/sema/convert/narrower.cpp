@@ -1,5 +1,6 @@
 #include "tempest/error/diagnostics.hpp"
 #include "tempest/sema/convert/predicate.hpp"
+#include "tempest/sema/convert/relationcache.hpp"
 #include "tempest/sema/graph/primitivetype.hpp"
 #include "tempest/sema/infer/types.hpp"
 #include "tempest/sema/transform/applyspec.hpp"
@@ -13,8 +14,19 @@ namespace tempest::sema::convert {
   using tempest::sema::transform::TempMapTypeVars;
 
   bool isEqualOrNarrower(const Type* l, const Type* r) {
+    auto cache = RelationCache::current();
+    bool cacheable = cache && RelationCache::isCacheable(l) && RelationCache::isCacheable(r);
+    ConversionResult cached;
+    if (cacheable && cache->lookup(RelationCache::Relation::NARROWER, l, r, cached)) {
+      return cached.rank != ConversionRank::ERROR;
+    }
     Env emptyEnv;
-    return isEqualOrNarrower(l, emptyEnv, r, emptyEnv);
+    bool result = isEqualOrNarrower(l, emptyEnv, r, emptyEnv);
+    if (cacheable) {
+      cache->insert(RelationCache::Relation::NARROWER, l, r,
+          result ? ConversionRank::EXACT : ConversionRank::ERROR);
+    }
+    return result;
   }
 
   bool isEqualOrNarrower(
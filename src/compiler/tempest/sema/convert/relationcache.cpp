@@ -0,0 +1,71 @@
+#include "tempest/compiler/compilationunit.hpp"
+#include "tempest/sema/convert/relationcache.hpp"
+#include "tempest/sema/graph/defn.hpp"
+
+namespace tempest::sema::convert {
+  using namespace tempest::sema::graph;
+  using tempest::compiler::CompilationUnit;
+
+  bool RelationCache::isCacheable(const Type* t) {
+    // Derived types are keyed by address, which only identifies them if they are interned.
+    if (t->kind >= Type::Kind::UNION && t->kind <= Type::Kind::SINGLETON && !t->interned) {
+      return false;
+    }
+
+    switch (t->kind) {
+      case Type::Kind::CONTINGENT:
+      case Type::Kind::INFERRED:
+        return false;
+
+      case Type::Kind::UNION: {
+        for (auto m : static_cast<const UnionType*>(t)->members) {
+          if (!isCacheable(m)) {
+            return false;
+          }
+        }
+        return true;
+      }
+
+      case Type::Kind::TUPLE: {
+        for (auto m : static_cast<const TupleType*>(t)->members) {
+          if (!isCacheable(m)) {
+            return false;
+          }
+        }
+        return true;
+      }
+
+      case Type::Kind::FUNCTION: {
+        auto ft = static_cast<const FunctionType*>(t);
+        if (!isCacheable(ft->returnType)) {
+          return false;
+        }
+        for (auto param : ft->paramTypes) {
+          if (!isCacheable(param)) {
+            return false;
+          }
+        }
+        return true;
+      }
+
+      case Type::Kind::MODIFIED:
+        return isCacheable(static_cast<const ModifiedType*>(t)->base);
+
+      case Type::Kind::SPECIALIZED: {
+        for (auto arg : static_cast<const SpecializedType*>(t)->spec->typeArgs()) {
+          if (!isCacheable(arg)) {
+            return false;
+          }
+        }
+        return true;
+      }
+
+      default:
+        return true;
+    }
+  }
+
+  RelationCache* RelationCache::current() {
+    return CompilationUnit::theCU ? &CompilationUnit::theCU->relations() : nullptr;
+  }
+}
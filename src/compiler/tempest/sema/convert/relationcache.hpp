@@ -0,0 +1,116 @@
+#ifndef TEMPEST_SEMA_CONVERT_RELATIONCACHE_HPP
+#define TEMPEST_SEMA_CONVERT_RELATIONCACHE_HPP 1
+
+#ifndef TEMPEST_SEMA_GRAPH_TYPE_HPP
+  #include "tempest/sema/graph/type.hpp"
+#endif
+
+#ifndef TEMPEST_SEMA_CONVERT_RESULT_HPP
+  #include "tempest/sema/convert/result.hpp"
+#endif
+
+#ifndef TEMPEST_SUPPORT_HASHING_HPP
+  #include "tempest/support/hashing.hpp"
+#endif
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+namespace tempest::sema::convert {
+  using tempest::sema::graph::Type;
+
+  /** Memoizes the results of type relation predicates (assignable, equal, subtype, narrower)
+      and of unification for pairs of canonical types. Only relations that can be computed
+      without a type environment are cached; types which contain inference variables are never
+      cached, since their meaning depends on the state of the constraint solver. Safe to use
+      from multiple threads. */
+  class RelationCache {
+  public:
+    enum class Relation : uint8_t {
+      ASSIGNABLE,
+      EQUAL,
+      SUBTYPE,
+      NARROWER,
+
+      // Unification under each of the infer::TypeRelation predicates.
+      UNIFY_EQUAL,
+      UNIFY_SUBTYPE,
+      UNIFY_SUPERTYPE,
+      UNIFY_ASSIGNABLE_FROM,
+      UNIFY_ASSIGNABLE_TO,
+    };
+
+    /** Look up a previously computed relation. Returns true if found. */
+    bool lookup(Relation rel, const void* dst, const void* src, ConversionResult& result) {
+      std::lock_guard<std::mutex> lock(_mutex);
+      auto it = _entries.find(Key{ dst, src, rel });
+      if (it != _entries.end()) {
+        _hits += 1;
+        result = it->second;
+        return true;
+      }
+      _misses += 1;
+      return false;
+    }
+
+    /** Record the result of a relation. */
+    void insert(Relation rel, const void* dst, const void* src, const ConversionResult& result) {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _entries[Key{ dst, src, rel }] = result;
+    }
+
+    /** Discard all cached results (but not the statistics). */
+    void clear() {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _entries.clear();
+    }
+
+    /** Number of cached entries. */
+    size_t size() const {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return _entries.size();
+    }
+
+    /** Number of lookups that found a cached result. */
+    size_t hits() const { return _hits; }
+
+    /** Number of lookups that did not find a cached result. */
+    size_t misses() const { return _misses; }
+
+    /** True if the relation between these types can be cached - that is, neither type
+        contains a type variable that is being solved for, and every structural type in it
+        is interned, so that its address identifies it. */
+    static bool isCacheable(const Type* t);
+
+    /** The relation cache for the current compilation unit, or nullptr if there is none. */
+    static RelationCache* current();
+
+  private:
+    struct Key {
+      const void* dst;
+      const void* src;
+      Relation rel;
+
+      friend bool operator==(const Key& lhs, const Key& rhs) {
+        return lhs.dst == rhs.dst && lhs.src == rhs.src && lhs.rel == rhs.rel;
+      }
+    };
+
+    struct KeyHash {
+      std::size_t operator()(const Key& key) const {
+        std::size_t result = std::hash<const void*>()(key.dst);
+        tempest::support::hash_combine(result, std::hash<const void*>()(key.src));
+        tempest::support::hash_combine(result, size_t(key.rel));
+        return result;
+      }
+    };
+
+    mutable std::mutex _mutex;
+    std::unordered_map<Key, ConversionResult, KeyHash> _entries;
+    std::atomic<size_t> _hits = 0;
+    std::atomic<size_t> _misses = 0;
+  };
+}
+
+#endif
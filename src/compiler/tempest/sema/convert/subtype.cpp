@@ -1,5 +1,6 @@
 #include "tempest/error/diagnostics.hpp"
 #include "tempest/sema/convert/predicate.hpp"
+#include "tempest/sema/convert/relationcache.hpp"
 #include "tempest/sema/graph/primitivetype.hpp"
 #include "tempest/sema/transform/applyspec.hpp"
 
@@ -9,9 +10,30 @@ namespace tempest::sema::convert {
   using tempest::error::diag;
   using tempest::sema::transform::TempMapTypeVars;
 
+  static bool isSubtypeImpl(
+      const TypeDefn* st, Env& stEnv,
+      const TypeDefn* bt, Env& btEnv);
+
   bool isSubtype(
       const TypeDefn* st, Env& stEnv,
       const TypeDefn* bt, Env& btEnv) {
+    // Relations between unspecialized definitions don't depend on the environment.
+    auto cache = stEnv.args.empty() && btEnv.args.empty() ? RelationCache::current() : nullptr;
+    ConversionResult cached;
+    if (cache && cache->lookup(RelationCache::Relation::SUBTYPE, bt, st, cached)) {
+      return cached.rank != ConversionRank::ERROR;
+    }
+    bool result = isSubtypeImpl(st, stEnv, bt, btEnv);
+    if (cache) {
+      cache->insert(RelationCache::Relation::SUBTYPE, bt, st,
+          result ? ConversionRank::EXACT : ConversionRank::ERROR);
+    }
+    return result;
+  }
+
+  static bool isSubtypeImpl(
+      const TypeDefn* st, Env& stEnv,
+      const TypeDefn* bt, Env& btEnv) {
     if (bt == st) {
       if (btEnv.args.size() != stEnv.args.size()) {
         return false;
@@ -0,0 +1,82 @@
+#include "tempest/sema/graph/classhierarchy.hpp"
+#include "tempest/sema/graph/defn.hpp"
+#include "tempest/sema/graph/module.hpp"
+#include "tempest/sema/graph/type.hpp"
+#include "llvm/Support/Casting.h"
+#include <unordered_set>
+
+namespace tempest::sema::graph {
+  void ClassHierarchy::addModule(Module* mod) {
+    for (auto defn : mod->members()) {
+      if (auto td = dyn_cast<TypeDefn>(defn)) {
+        addClass(td);
+      }
+    }
+  }
+
+  void ClassHierarchy::addClass(TypeDefn* td) {
+    if (td->type() && td->type()->kind == Type::Kind::CLASS && td->extends().size() > 0) {
+      auto base = cast<TypeDefn>(unwrapSpecialization(td->extends()[0]));
+      auto& subs = _subclasses[base];
+      if (std::find(subs.begin(), subs.end(), td) == subs.end()) {
+        subs.push_back(td);
+      }
+    }
+    for (auto member : td->members()) {
+      if (auto nested = dyn_cast<TypeDefn>(member)) {
+        addClass(nested);
+      }
+    }
+  }
+
+  bool ClassHierarchy::findTargets(
+      TypeDefn* cls,
+      FunctionDefn* method,
+      llvm::SmallVectorImpl<MethodTableEntry>& targets,
+      size_t maxTargets) const {
+    if (cls->type()->kind != Type::Kind::CLASS ||
+        method->isStatic() ||
+        method->isConstructor() ||
+        method->methodIndex() < 0) {
+      return false;
+    }
+    size_t index = method->methodIndex();
+
+    // Visit the class and all its descendants; any that can be instantiated contributes the
+    // method in its table slot.
+    llvm::SmallVector<TypeDefn*, 8> queue;
+    std::unordered_set<FunctionDefn*> seen;
+    queue.push_back(cls);
+    while (!queue.empty()) {
+      auto td = queue.pop_back_val();
+      if (index >= td->methods().size()) {
+        return false;
+      }
+      if (!td->isAbstract()) {
+        auto& entry = td->methods()[index];
+        if (entry.method == nullptr || entry.method->isAbstract()) {
+          return false;
+        }
+        if (seen.insert(entry.method).second) {
+          if (targets.size() >= maxTargets) {
+            return false;
+          }
+          targets.push_back(entry);
+        }
+      }
+      auto it = _subclasses.find(td);
+      if (it != _subclasses.end()) {
+        queue.append(it->second.begin(), it->second.end());
+      }
+    }
+    return true;
+  }
+
+  llvm::ArrayRef<TypeDefn*> ClassHierarchy::subclasses(TypeDefn* cls) const {
+    auto it = _subclasses.find(cls);
+    if (it != _subclasses.end()) {
+      return it->second;
+    }
+    return {};
+  }
+}
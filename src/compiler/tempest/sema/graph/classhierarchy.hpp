@@ -0,0 +1,54 @@
+#ifndef TEMPEST_SEMA_GRAPH_CLASSHIERARCHY_HPP
+#define TEMPEST_SEMA_GRAPH_CLASSHIERARCHY_HPP 1
+
+#ifndef TEMPEST_SEMA_GRAPH_METHODTABLE_HPP
+  #include "tempest/sema/graph/methodtable.hpp"
+#endif
+
+#ifndef LLVM_ADT_SMALLVECTOR_H
+  #include <llvm/ADT/SmallVector.h>
+#endif
+
+#include <unordered_map>
+
+namespace tempest::sema::graph {
+  class FunctionDefn;
+  class Module;
+  class TypeDefn;
+
+  /** The class hierarchy of a whole program, used to find out which methods a virtual call
+      could dispatch to. Relies on the method tables built by FindOverridesPass, in which a
+      subclass keeps each inherited method at the same index as its base class.
+
+      The answers are only sound if every module that could define a subclass has been added,
+      which is the case when the whole program is compiled from source. */
+  class ClassHierarchy {
+  public:
+    /** Calls with more possible targets than this aren't worth dispatching by type tests. */
+    static constexpr size_t MAX_GUARDED_TARGETS = 3;
+
+    /** Record the classes defined in a module, including nested classes. */
+    void addModule(Module* mod);
+
+    /** Record a class and its nested classes. */
+    void addClass(TypeDefn* td);
+
+    /** Find the distinct methods that calling 'method' on an instance of 'cls', or of any of
+        its subclasses, could run. Only classes that can be instantiated are considered.
+        Returns false if the targets can't be determined, for example because the method
+        isn't a virtual method of a class, or there are more than 'maxTargets' of them. */
+    bool findTargets(
+        TypeDefn* cls,
+        FunctionDefn* method,
+        llvm::SmallVectorImpl<MethodTableEntry>& targets,
+        size_t maxTargets = MAX_GUARDED_TARGETS) const;
+
+    /** Direct subclasses of a class. */
+    llvm::ArrayRef<TypeDefn*> subclasses(TypeDefn* cls) const;
+
+  private:
+    std::unordered_map<TypeDefn*, llvm::SmallVector<TypeDefn*, 4>> _subclasses;
+  };
+}
+
+#endif
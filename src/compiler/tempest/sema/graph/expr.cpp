@@ -50,8 +50,8 @@ namespace tempest::sema::graph {
       case Kind::LOGICAL_OR: return "LOGICAL_OR";
     //   case Kind::RANGE: return "RANGE";
     //   case Kind::PACK: return "PACK";
-    //   case Kind::AS_TYPE: return "AS_TYPE";
-    //   case Kind::IS_TYPE: return "IS_TYPE";
+      case Kind::AS_TYPE: return "AS_TYPE";
+      case Kind::IS_TYPE: return "IS_TYPE";
     // #  case Kind::IN: return "IN";
     // #  case Kind::NOT_IN: return "NOT_IN";
     //   case Kind::RETURNS: return "RETURNS";
@@ -122,6 +122,7 @@ namespace tempest::sema::graph {
       case Kind::CAST_FP_EXTEND: return "CAST_FP_EXTEND";
       case Kind::CAST_FP_TRUNC: return "CAST_FP_TRUNC";
       case Kind::CAST_CREATE_UNION: return "CAST_CREATE_UNION";
+      case Kind::CAST_CREATE_INTERFACE: return "CAST_CREATE_INTERFACE";
 
     //   case Kind::BASE: return "BASE";
     //   case Kind::OPER: return "OPER";
@@ -78,8 +78,8 @@ namespace tempest::sema::graph {
       LOGICAL_AND, LOGICAL_OR,
     //   RANGE,
     //   PACK,
-    //   AS_TYPE,
-    //   IS_TYPE,
+      AS_TYPE,
+      IS_TYPE,
     // #  IN,
     // #  NOT_IN,
     //   RETURNS,
@@ -170,6 +170,7 @@ namespace tempest::sema::graph {
     //   IFACE_CAST,                   # Cast from type to interface which it is known to support.
     //   DYN_IFACE_CAST,               # Cast from type to interface, throw if fail.
       CAST_CREATE_UNION,        // Construct a union type from one of it's members.
+      CAST_CREATE_INTERFACE,    // Construct an interface reference from an object.
     //   UNION_CTOR_CAST,              # Cast to a union type
     //   UNION_MEMBER_CAST,            # Cast from a union type
     //   BOX_CAST,                     # Cast from value type to reference type.
@@ -187,7 +188,16 @@ namespace tempest::sema::graph {
       INFIX_END = REF_EQ,
     };
 
+    /** Whether specializing an expression can give different results for different type
+        arguments. Invariant expressions can be shared between specializations. */
+    enum class TypeDependence : uint8_t {
+      UNKNOWN,      // Not computed yet; treated as dependent.
+      INVARIANT,
+      DEPENDENT,
+    };
+
     const Kind kind;
+    TypeDependence typeDependence = TypeDependence::UNKNOWN;
     const Location location;
     const Type* type = nullptr;
 
@@ -15,6 +15,11 @@ namespace tempest::sema::graph {
   public:
     gen::OutputSym* sym;
     Expr* stem = nullptr;
+
+    /** For ALLOC_OBJ, true if the object never outlives the function call that allocates it,
+        so it can be allocated on the stack. */
+    bool noEscape = false;
+
     SymbolRefExpr(
           Kind kind,
           Location location,
@@ -38,6 +43,11 @@ namespace tempest::sema::graph {
   public:
     gen::OutputSym* cls;
     Expr* size = nullptr;
+
+    /** True if the object never outlives the function call that allocates it, and its size
+        is a small constant, so it can be allocated on the stack. */
+    bool noEscape = false;
+
     FlexAllocExpr(
           Location location,
           gen::OutputSym* cls,
@@ -5,6 +5,10 @@
   #include "tempest/sema/graph/expr.hpp"
 #endif
 
+namespace tempest::gen {
+  class OutputSym;
+}
+
 namespace tempest::sema::graph {
   class ApplyFnOp;
 
@@ -32,6 +36,7 @@ namespace tempest::sema::graph {
         case Kind::CAST_INT_TRUNCATE:
         case Kind::CAST_FP_EXTEND:
         case Kind::CAST_FP_TRUNC:
+        case Kind::CAST_CREATE_INTERFACE:
           return true;
         default:
           return false;
@@ -39,6 +44,22 @@ namespace tempest::sema::graph {
     }
   };
 
+  /** Conversion of an object to a reference to an interface that its class implements. */
+  class InterfaceCastOp : public UnaryOp {
+  public:
+    /** Translation of the object's class to the interface, filled in when the expression
+        is lowered. */
+    gen::OutputSym* trans = nullptr;
+
+    InterfaceCastOp(Location location, Expr* arg, const Type* type)
+      : UnaryOp(Kind::CAST_CREATE_INTERFACE, location, arg, type)
+    {}
+
+    /** Dynamic casting support. */
+    static bool classof(const InterfaceCastOp* e) { return true; }
+    static bool classof(const Expr* e) { return e->kind == Kind::CAST_CREATE_INTERFACE; }
+  };
+
   /** Infix operator. */
   class BinaryOp : public Expr {
   public:
@@ -90,6 +111,34 @@ namespace tempest::sema::graph {
     }
   };
 
+  /** Test of whether an object is an instance of a class ('is'), or a conditional downcast
+      to that class ('as'). */
+  class TypeTestOp : public Expr {
+  public:
+    Expr* arg;
+    const Type* testType;
+
+    /** Class descriptor of the test type, filled in when the expression is lowered. */
+    gen::OutputSym* cls = nullptr;
+
+    TypeTestOp(
+          Kind kind,
+          Location location,
+          Expr* arg,
+          const Type* testType,
+          const Type* type = nullptr)
+      : Expr(kind, location, type)
+      , arg(arg)
+      , testType(testType)
+    {}
+
+    /** Dynamic casting support. */
+    static bool classof(const TypeTestOp* e) { return true; }
+    static bool classof(const Expr* e) {
+      return e->kind == Kind::IS_TYPE || e->kind == Kind::AS_TYPE;
+    }
+  };
+
   /** Operator with a variable number of arguments. */
   class ApplyFnOp : public Expr {
   public:
@@ -555,6 +555,14 @@ namespace tempest::sema::graph {
         break;
       }
 
+      case Expr::Kind::NOT: {
+        auto op = static_cast<const UnaryOp*>(e);
+        out << "(not ";
+        visitExpr(op->arg);
+        out << ")";
+        break;
+      }
+
       case Expr::Kind::CAST_SIGN_EXTEND: {
         auto op = static_cast<const UnaryOp*>(e);
         out << "(sext ";
@@ -595,6 +603,23 @@ namespace tempest::sema::graph {
         break;
       }
 
+      case Expr::Kind::IS_TYPE:
+      case Expr::Kind::AS_TYPE: {
+        auto op = static_cast<const TypeTestOp*>(e);
+        out << (e->kind == Expr::Kind::IS_TYPE ? "(is " : "(as ");
+        visitExpr(op->arg);
+        out << " " << op->testType << ")";
+        break;
+      }
+
+      case Expr::Kind::CAST_CREATE_INTERFACE: {
+        auto op = static_cast<const UnaryOp*>(e);
+        out << "(iface ";
+        visitExpr(op->arg);
+        out << ")";
+        break;
+      }
+
       case Expr::Kind::RETURN: {
         auto op = static_cast<const UnaryOp*>(e);
         out << "(return ";
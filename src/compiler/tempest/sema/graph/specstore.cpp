@@ -13,25 +13,27 @@ namespace tempest::sema::graph {
     _specs.clear();
   }
 
+  TypeArray SpecializationStore::copyOf(const TypeArray& types) {
+    std::lock_guard<std::mutex> lock(_allocMutex);
+    return _alloc.copyOf(types);
+  }
+
   SpecializedDefn* SpecializationStore::specialize(GenericDefn* base, const TypeArray& typeArgs) {
     assert(!typeArgs.empty());
     assert(isa<GenericDefn>(base));
     for (auto ta : typeArgs) {
       assert(ta);
     }
-    SpecializationKey<Defn> key(base, typeArgs);
-    auto it = _specs.find(key);
-    if (it != _specs.end()) {
-      return it->second;
-    }
-
-    auto spec = new (_alloc) SpecializedDefn(base, _alloc.copyOf(typeArgs), base->allTypeParams());
-    if (auto typeDefn = llvm::dyn_cast<TypeDefn>(base)) {
-      spec->setType(new (_alloc) SpecializedType(spec));
-    }
-    SpecializationKey<Defn> newKey(base, _alloc.copyOf(typeArgs));
-    _specs[newKey] = spec;
-    return spec;
+    return _specs.getOrCreate(SpecializationKey<Defn>(base, typeArgs), [&](auto& alloc) {
+      auto argsCopy = alloc.copyOf(typeArgs);
+      auto spec = new (alloc) SpecializedDefn(base, argsCopy, base->allTypeParams());
+      if (llvm::isa<TypeDefn>(base)) {
+        auto st = new (alloc) SpecializedType(spec);
+        st->interned = true;
+        spec->setType(st);
+      }
+      return std::make_pair(SpecializationKey<Defn>(base, argsCopy), spec);
+    });
   }
 
   SpecializedDefn* SpecializationStore::specialize(Defn* base, const TypeArray& typeArgs) {
@@ -47,19 +49,15 @@ namespace tempest::sema::graph {
     }
 
     assert(genericParent);
-    SpecializationKey<Defn> key(base, typeArgs);
-    auto it = _specs.find(key);
-    if (it != _specs.end()) {
-      return it->second;
-    }
-
-    auto spec = new (_alloc)
-        SpecializedDefn(base, _alloc.copyOf(typeArgs), genericParent->allTypeParams());
-    if (auto typeDefn = llvm::dyn_cast<TypeDefn>(base)) {
-      spec->setType(new (_alloc) SpecializedType(spec));
-    }
-    SpecializationKey<Defn> newKey(base, _alloc.copyOf(typeArgs));
-    _specs[newKey] = spec;
-    return spec;
+    return _specs.getOrCreate(SpecializationKey<Defn>(base, typeArgs), [&](auto& alloc) {
+      auto argsCopy = alloc.copyOf(typeArgs);
+      auto spec = new (alloc) SpecializedDefn(base, argsCopy, genericParent->allTypeParams());
+      if (llvm::isa<TypeDefn>(base)) {
+        auto st = new (alloc) SpecializedType(spec);
+        st->interned = true;
+        spec->setType(st);
+      }
+      return std::make_pair(SpecializationKey<Defn>(base, argsCopy), spec);
+    });
   }
 }
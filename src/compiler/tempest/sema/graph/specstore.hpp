@@ -9,12 +9,18 @@
   #include "tempest/sema/graph/speckey.hpp"
 #endif
 
+#ifndef TEMPEST_SUPPORT_SHARDEDMAP_HPP
+  #include "tempest/support/shardedmap.hpp"
+#endif
+
+#include <mutex>
 #include <unordered_set>
 
 namespace tempest::sema::graph {
   using tempest::support::hash_combine;
 
-  /** A store of canonicalized, uniqued derived types. */
+  /** A store of canonicalized, uniqued specializations. Specializing is thread-safe, and
+      always returns the same instance for the same definition and type arguments. */
   class SpecializationStore {
   public:
     SpecializationStore(tempest::support::BumpPtrAllocator& alloc) : _alloc(alloc) {}
@@ -23,20 +29,24 @@ namespace tempest::sema::graph {
     /** TypeStore has its own allocator. */
     tempest::support::BumpPtrAllocator& alloc() { return _alloc; }
 
+    /** Make a copy of a type array within the store's allocator. Unlike 'alloc().copyOf()',
+        this may be called from multiple threads. */
+    TypeArray copyOf(const TypeArray& types);
+
     /** Specialize a generic definition. */
     SpecializedDefn* specialize(GenericDefn* base, const TypeArray& typeArgs);
 
     /** Specialize a member definition (which could be a member of a generic). */
     SpecializedDefn* specialize(Defn* base, const TypeArray& typeArgs);
 
-    /** The map of all specializations. */
-    std::unordered_map<SpecializationKey<Defn>, SpecializedDefn*, SpecializationKeyHash<Defn>>&
-        specializations() { return _specs; }
+    /** The number of distinct specializations. */
+    size_t size() const { return _specs.size(); }
 
   private:
     tempest::support::BumpPtrAllocator& _alloc;
-    std::unordered_map<SpecializationKey<Defn>, SpecializedDefn*, SpecializationKeyHash<Defn>>
-        _specs;
+    std::mutex _allocMutex;
+    tempest::support::ShardedMap<
+        SpecializationKey<Defn>, SpecializedDefn*, SpecializationKeyHash<Defn>> _specs;
   };
 }
 
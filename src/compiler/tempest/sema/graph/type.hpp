@@ -64,6 +64,11 @@ namespace tempest::sema::graph {
 
     const Kind kind;
 
+    /** True if this is the only instance of its structure, and lives as long as the
+        compilation unit. Set by TypeStore and SpecializationStore; temporary types built
+        elsewhere, e.g. during inference, may share an address with an unrelated type later. */
+    bool interned = false;
+
     // Return the name of the specified kind.
     static const char* KindName(Kind kind);
 
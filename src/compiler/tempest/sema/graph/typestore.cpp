@@ -72,12 +72,12 @@ namespace tempest::sema::graph {
 
   TypeStore::~TypeStore() {
     // Clear out all of the maps before the allocator goes away.
+    _intTypes.clear();
     _unionTypes.clear();
     _tupleTypes.clear();
     _functionTypes.clear();
     _modifiedTypes.clear();
     _singletonTypes.clear();
-    _addressTypes.clear();
     _alloc.Reset();
   }
 
@@ -87,30 +87,21 @@ namespace tempest::sema::graph {
     std::sort(sortedMembers.begin(), sortedMembers.end(), TypeOrder());
 
     // Return matching union instance if already exists.
-    TypeKey key(sortedMembers);
-    auto it = _unionTypes.find(key);
-    if (it != _unionTypes.end()) {
-      return it->second;
-    }
-
-    // Allocate type arrays of both the original and sorted orders.
-    auto membersCopy = _alloc.copyOf(sortedMembers);
-    auto ut = new (_alloc) UnionType(membersCopy);
-    _unionTypes[TypeKey(membersCopy)] = ut;
-    return ut;
+    return _unionTypes.getOrCreate(TypeKey(sortedMembers), [&](auto& alloc) {
+      auto membersCopy = alloc.copyOf(sortedMembers);
+      auto ut = new (alloc) UnionType(membersCopy);
+      ut->interned = true;
+      return std::make_pair(TypeKey(membersCopy), ut);
+    });
   }
 
   TupleType* TypeStore::createTupleType(const TypeArray& members) {
-    TypeKey key(members);
-    auto it = _tupleTypes.find(key);
-    if (it != _tupleTypes.end()) {
-      return it->second;
-    }
-
-    auto keyCopy = _alloc.copyOf(members);
-    auto tt = new (_alloc) TupleType(keyCopy);
-    _tupleTypes[TypeKey(keyCopy)] = tt;
-    return tt;
+    return _tupleTypes.getOrCreate(TypeKey(members), [&](auto& alloc) {
+      auto keyCopy = alloc.copyOf(members);
+      auto tt = new (alloc) TupleType(keyCopy);
+      tt->interned = true;
+      return std::make_pair(TypeKey(keyCopy), tt);
+    });
   }
 
   const ModifiedType* TypeStore::createModifiedType(const Type* base, uint32_t modifiers) {
@@ -122,26 +113,20 @@ namespace tempest::sema::graph {
     }
 
     auto key = std::pair<const Type*, uint32_t>(base, modifiers);
-    auto it = _modifiedTypes.find(key);
-    if (it != _modifiedTypes.end()) {
-      return it->second;
-    }
-
-    auto ct = new (_alloc) ModifiedType(base, modifiers);
-    _modifiedTypes[key] = ct;
-    return ct;
+    return _modifiedTypes.getOrCreate(key, [&](auto& alloc) {
+      auto mt = new (alloc) ModifiedType(base, modifiers);
+      mt->interned = true;
+      return std::make_pair(key, mt);
+    });
   }
 
   SingletonType* TypeStore::createSingletonType(const Expr* expr) {
     SingletonKey key(expr);
-    auto it = _singletonTypes.find(key);
-    if (it != _singletonTypes.end()) {
-      return it->second;
-    }
-
-    auto ct = new (_alloc) SingletonType(expr);
-    _singletonTypes[key] = ct;
-    return ct;
+    return _singletonTypes.getOrCreate(key, [&](auto& alloc) {
+      auto st = new (alloc) SingletonType(expr);
+      st->interned = true;
+      return std::make_pair(key, st);
+    });
   }
 
   FunctionType* TypeStore::createFunctionType(
@@ -155,28 +140,23 @@ namespace tempest::sema::graph {
     signature.push_back(returnType);
     signature.insert(signature.end(), paramTypes.begin(), paramTypes.end());
     auto key = FunctionTypeKey(signature, isMutableSelf, isVariadic);
-    auto it = _functionTypes.find(key);
-    if (it != _functionTypes.end()) {
-      return it->second;
-    }
-    auto paramTypesCopy = _alloc.copyOf(paramTypes);
-    auto signatureCopy = _alloc.copyOf(signature);
-    auto ft = new (_alloc) FunctionType(
-        returnType, paramTypesCopy, isMutableSelf, isVariadic);
-    _functionTypes[FunctionTypeKey(signatureCopy, isMutableSelf, isVariadic)] = ft;
-    return ft;
+    return _functionTypes.getOrCreate(key, [&](auto& alloc) {
+      auto paramTypesCopy = alloc.copyOf(paramTypes);
+      auto signatureCopy = alloc.copyOf(signature);
+      auto ft = new (alloc) FunctionType(
+          returnType, paramTypesCopy, isMutableSelf, isVariadic);
+      ft->interned = true;
+      return std::make_pair(FunctionTypeKey(signatureCopy, isMutableSelf, isVariadic), ft);
+    });
   }
 
   IntegerType* TypeStore::createIntegerType(llvm::APInt& intVal, bool isUnsigned) {
     int32_t bits = intVal.getMinSignedBits();
     IntKey key({ bits, intVal.isNegative(), isUnsigned });
-    auto it = _intTypes.find(key);
-    if (it != _intTypes.end()) {
-      return it->second;
-    }
-
-    auto nt = new (_alloc) IntegerType("integer", bits, isUnsigned, intVal.isNegative());
-    _intTypes[key] = nt;
-    return nt;
+    return _intTypes.getOrCreate(key, [&](auto& alloc) {
+      auto it = new (alloc) IntegerType("integer", bits, isUnsigned, intVal.isNegative());
+      it->interned = true;
+      return std::make_pair(key, it);
+    });
   }
 }
@@ -25,6 +25,10 @@
   #include "tempest/support/hashing.hpp"
 #endif
 
+#ifndef TEMPEST_SUPPORT_SHARDEDMAP_HPP
+  #include "tempest/support/shardedmap.hpp"
+#endif
+
 #include <unordered_map>
 #include <unordered_set>
 
@@ -72,12 +76,15 @@ namespace tempest::sema::graph {
     bool isUnsigned;
   };
 
-  /** A store of canonicalized, uniqued derived types. */
+  /** A store of canonicalized, uniqued derived types. The create methods are thread-safe,
+      and always return the same instance for structurally identical types regardless
+      of which thread asks first. */
   class TypeStore {
   public:
     ~TypeStore();
 
-    /** TypeStore has its own allocator. */
+    /** TypeStore has its own allocator. Unlike the create methods, this is not thread-safe;
+        it's meant for passes that run on a single thread. */
     tempest::support::BumpPtrAllocator& alloc() { return _alloc; }
 
     /** Create a union type from the given type key. */
@@ -135,14 +142,14 @@ namespace tempest::sema::graph {
     };
 
     tempest::support::BumpPtrAllocator _alloc;
-    std::unordered_map<IntKey, IntegerType*, IntKeyHash, IntKeyEqual> _intTypes;
-    std::unordered_map<TypeKey, UnionType*, TypeKeyHash> _unionTypes;
-    std::unordered_map<TypeKey, TupleType*, TypeKeyHash> _tupleTypes;
-    std::unordered_map<FunctionTypeKey, FunctionType*, FunctionTypeKeyHash> _functionTypes;
-    std::unordered_map<ModifiedKey, ModifiedType*, ModifiedKeyHash> _modifiedTypes;
-    std::unordered_map<SingletonKey, SingletonType*, SingletonKeyHash> _singletonTypes;
-    std::unordered_map<SpecializedDefn*, SpecializedType*> _specializdTypes;
-    std::unordered_set<Type*> _addressTypes;
+    tempest::support::ShardedMap<IntKey, IntegerType*, IntKeyHash, IntKeyEqual> _intTypes;
+    tempest::support::ShardedMap<TypeKey, UnionType*, TypeKeyHash> _unionTypes;
+    tempest::support::ShardedMap<TypeKey, TupleType*, TypeKeyHash> _tupleTypes;
+    tempest::support::ShardedMap<FunctionTypeKey, FunctionType*, FunctionTypeKeyHash>
+        _functionTypes;
+    tempest::support::ShardedMap<ModifiedKey, ModifiedType*, ModifiedKeyHash> _modifiedTypes;
+    tempest::support::ShardedMap<SingletonKey, SingletonType*, SingletonKeyHash>
+        _singletonTypes;
   //     self.valueRefTypes = {}
   };
 }
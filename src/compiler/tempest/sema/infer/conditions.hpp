@@ -5,7 +5,9 @@
   #include "tempest/common.hpp"
 #endif
 
+#include "llvm/Support/MathExtras.h"
 #include <initializer_list>
+#include <iterator>
 
 namespace tempest::sema::infer {
   class OverloadCandidate;
@@ -36,61 +38,110 @@ namespace tempest::sema::infer {
       makes it more restrictive, while adding choices within a conjunct makes it less
       restrictive.
 
-      Because sets are typically very small (1 or 2 elements), we use a sorted SmallVector to store
-      the entries and do linear searches for membership tests rather than a fancy unordered
-      set.
+      Conjuncts are kept in a vector sorted by site, and the choices within each conjunct
+      are a bitmask, so that testing and combining conditions doesn't require allocation for
+      any reasonably-sized overload set.
   */
   class Conditions {
   public:
-    /** The set of choices for a given overload site. */
+    /** The set of choices for a given overload site, stored as a bitmask of candidate
+        ordinals. Set operations work a word at a time, and only sites with more than 64
+        candidates need memory beyond the conjunct itself. */
     class Conjunct {
     public:
-      typedef SmallVector<size_t, 2> Choices;
-      typedef Choices::const_iterator const_iterator;
+      typedef uint64_t Word;
+      static constexpr size_t WORD_BITS = 64;
+
+      /** Iterates over the choices in ascending order. */
+      class const_iterator {
+      public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef size_t value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const size_t* pointer;
+        typedef size_t reference;
+
+        const_iterator(const Conjunct* conjunct, size_t choice)
+          : _conjunct(conjunct)
+          , _choice(choice)
+        {}
+
+        size_t operator*() const { return _choice; }
+
+        /** The nth choice after this one. */
+        size_t operator[](size_t n) const {
+          auto it = *this;
+          while (n-- > 0) {
+            ++it;
+          }
+          return *it;
+        }
+
+        const_iterator& operator++() {
+          _choice = _conjunct->nextChoice(_choice + 1);
+          return *this;
+        }
+
+        const_iterator operator++(int) {
+          auto result = *this;
+          ++*this;
+          return result;
+        }
+
+        bool operator==(const const_iterator& other) const { return _choice == other._choice; }
+        bool operator!=(const const_iterator& other) const { return _choice != other._choice; }
+
+      private:
+        const Conjunct* _conjunct;
+        size_t _choice;
+      };
 
       Conjunct(size_t site) : _site(site) {}
       Conjunct(size_t site, size_t choice) : _site(site) { add(choice); }
-      Conjunct(const Conjunct& src) : _site(src._site), _choices(src._choices) {}
-      Conjunct(Conjunct&& src) : _site(src._site), _choices(std::move(src._choices)) {}
-      Conjunct(std::initializer_list<size_t> src) {
+      Conjunct(const Conjunct& src) : _site(src._site), _words(src._words) {}
+      Conjunct(Conjunct&& src) : _site(src._site), _words(std::move(src._words)) {}
+      Conjunct(std::initializer_list<size_t> src) : _site(0) {
         addAll(llvm::ArrayRef<size_t>(src));
       }
 
       size_t site() const { return _site; }
 
       bool empty() const {
-        return _choices.empty();
+        // Trailing zero words are always trimmed.
+        return _words.empty();
       }
 
       size_t size() const {
-        return _choices.size();
+        size_t result = 0;
+        for (auto word : _words) {
+          result += llvm::countPopulation(word);
+        }
+        return result;
       }
 
-      const_iterator begin() const { return _choices.begin(); }
-      const_iterator end() const { return _choices.end(); }
+      const_iterator begin() const { return const_iterator(this, nextChoice(0)); }
+      const_iterator end() const { return const_iterator(this, _words.size() * WORD_BITS); }
 
       Conjunct& operator=(const Conjunct& src) {
         _site = src._site;
-        _choices.assign(src._choices.begin(), src._choices.end());
+        _words.assign(src._words.begin(), src._words.end());
         return *this;
       }
 
       Conjunct& operator=(Conjunct&& src) {
         _site = src._site;
-        _choices = std::move(src._choices);
+        _words = std::move(src._words);
         return *this;
       }
 
       bool contains(size_t candidate) const {
-        return std::find(_choices.begin(), _choices.end(), candidate) != _choices.end();
+        auto index = candidate / WORD_BITS;
+        return index < _words.size() && (_words[index] & bit(candidate)) != 0;
       }
 
       /** True if this set equals another conjunct. */
       bool equal(const Conjunct& other) const {
-        return other._site == _site &&
-            std::equal(
-                _choices.begin(), _choices.end(),
-                other._choices.begin(), other._choices.end());
+        return other._site == _site && other._words == _words;
       }
 
       bool operator==(const Conjunct& other) const {
@@ -99,33 +150,53 @@ namespace tempest::sema::infer {
 
       /** True if this set includes all the conditions of `subset`. */
       bool isSuperset(const Conjunct& subset) const {
-        return _site == subset._site &&
-            std::includes(
-                _choices.begin(), _choices.end(),
-                subset._choices.begin(), subset._choices.end());
+        return subset.isSubset(*this);
       }
 
       /** True if this set is a subset of `superset`. */
       bool isSubset(const Conjunct& superset) const {
-        return _site == superset._site &&
-            std::includes(
-                superset._choices.begin(), superset._choices.end(),
-                _choices.begin(), _choices.end());
+        if (_site != superset._site || _words.size() > superset._words.size()) {
+          return false;
+        }
+        for (size_t i = 0; i < _words.size(); i += 1) {
+          if ((_words[i] & ~superset._words[i]) != 0) {
+            return false;
+          }
+        }
+        return true;
       }
 
-      /** Add elements to the set. Maintains sorted order. */
-      bool add(size_t choice) {
-        if (!contains(choice)) {
-          _choices.insert(std::lower_bound(_choices.begin(), _choices.end(), choice), choice);
-          return true;
+      /** True if this set and `other` have any choices in common. */
+      bool intersects(const Conjunct& other) const {
+        auto n = std::min(_words.size(), other._words.size());
+        for (size_t i = 0; i < n; i += 1) {
+          if ((_words[i] & other._words[i]) != 0) {
+            return true;
+          }
         }
         return false;
       }
 
+      /** Add elements to the set. */
+      bool add(size_t choice) {
+        auto index = choice / WORD_BITS;
+        if (index >= _words.size()) {
+          _words.resize(index + 1, 0);
+        }
+        if ((_words[index] & bit(choice)) != 0) {
+          return false;
+        }
+        _words[index] |= bit(choice);
+        return true;
+      }
+
       /** Add a collection of elements to the set. */
       void addAll(const Conjunct& src) {
-        for (auto choice : src._choices) {
-          add(choice);
+        if (src._words.size() > _words.size()) {
+          _words.resize(src._words.size(), 0);
+        }
+        for (size_t i = 0; i < src._words.size(); i += 1) {
+          _words[i] |= src._words[i];
         }
       }
 
@@ -137,21 +208,49 @@ namespace tempest::sema::infer {
 
       /** Retains only the elements that are in both sets. */
       void intersectWith(const Conjunct& src) {
-        _choices.erase(std::remove_if(
-            _choices.begin(),
-            _choices.end(),
-            [src](size_t choice) { return !src.contains(choice); }));
+        if (_words.size() > src._words.size()) {
+          _words.resize(src._words.size());
+        }
+        for (size_t i = 0; i < _words.size(); i += 1) {
+          _words[i] &= src._words[i];
+        }
+        trim();
       }
 
       /** True if there is at least one viable choice in this conjunct. */
-      bool isViable(const ConstraintSolver& cs);
+      bool isViable(const ConstraintSolver& cs) const;
 
     private:
       /** Which site the choices apply to. */
       size_t _site;
 
-      /** The set of valid choices for those sites. */
-      Choices _choices;
+      /** Bitmask of the valid choices for that site. */
+      SmallVector<Word, 1> _words;
+
+      static Word bit(size_t choice) {
+        return Word(1) << (choice % WORD_BITS);
+      }
+
+      /** Return the first choice >= 'from', or the end position if there is none. */
+      size_t nextChoice(size_t from) const {
+        for (size_t index = from / WORD_BITS; index < _words.size(); index += 1) {
+          auto word = _words[index];
+          if (index == from / WORD_BITS) {
+            word &= ~Word(0) << (from % WORD_BITS);
+          }
+          if (word != 0) {
+            return index * WORD_BITS + llvm::countTrailingZeros(word);
+          }
+        }
+        return _words.size() * WORD_BITS;
+      }
+
+      /** Remove trailing empty words, so that equal sets have equal representations. */
+      void trim() {
+        while (!_words.empty() && _words.back() == 0) {
+          _words.pop_back();
+        }
+      }
     };
 
     typedef SmallVector<Conjunct, 3> Conjuncts;
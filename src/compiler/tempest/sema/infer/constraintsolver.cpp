@@ -1,9 +1,16 @@
 #include "tempest/error/diagnostics.hpp"
 #include "tempest/sema/convert/predicate.hpp"
+#include "tempest/sema/convert/relationcache.hpp"
 #include "tempest/sema/graph/primitivetype.hpp"
 #include "tempest/sema/infer/constraintsolver.hpp"
 #include "tempest/sema/infer/unification.hpp"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/EquivalenceClasses.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <memory>
 
 namespace std {
   inline ::std::ostream& operator<<(::std::ostream& os, const std::vector<size_t>& perm) {
@@ -23,23 +30,302 @@ namespace tempest::sema::infer {
   using namespace tempest::sema::convert;
   using tempest::error::diag;
 
+  /** Collect the ordinals of all overload sites whose choice of candidate can affect
+      conversions to or from type 't'. */
+  static void collectSiteDependencies(
+      const Type* t,
+      llvm::SmallPtrSetImpl<const Type*>& visited,
+      llvm::SmallVectorImpl<size_t>& sites) {
+    if (!visited.insert(t).second) {
+      return;
+    }
+    switch (t->kind) {
+      case Type::Kind::INFERRED: {
+        for (auto& constraint : static_cast<const InferredType*>(t)->constraints) {
+          for (auto& cj : constraint.when) {
+            sites.push_back(cj.site());
+          }
+          collectSiteDependencies(constraint.value, visited, sites);
+        }
+        break;
+      }
+
+      case Type::Kind::CONTINGENT: {
+        for (auto& entry : static_cast<const ContingentType*>(t)->entries) {
+          if (entry.when) {
+            sites.push_back(entry.when->site->ordinal);
+          }
+          collectSiteDependencies(entry.type, visited, sites);
+        }
+        break;
+      }
+
+      case Type::Kind::UNION: {
+        for (auto m : static_cast<const UnionType*>(t)->members) {
+          collectSiteDependencies(m, visited, sites);
+        }
+        break;
+      }
+
+      case Type::Kind::TUPLE: {
+        for (auto m : static_cast<const TupleType*>(t)->members) {
+          collectSiteDependencies(m, visited, sites);
+        }
+        break;
+      }
+
+      case Type::Kind::FUNCTION: {
+        auto ft = static_cast<const FunctionType*>(t);
+        collectSiteDependencies(ft->returnType, visited, sites);
+        for (auto param : ft->paramTypes) {
+          collectSiteDependencies(param, visited, sites);
+        }
+        break;
+      }
+
+      case Type::Kind::MODIFIED:
+        collectSiteDependencies(static_cast<const ModifiedType*>(t)->base, visited, sites);
+        break;
+
+      case Type::Kind::SPECIALIZED: {
+        for (auto arg : static_cast<const SpecializedType*>(t)->spec->typeArgs()) {
+          collectSiteDependencies(arg, visited, sites);
+        }
+        break;
+      }
+
+      default:
+        break;
+    }
+  }
+
+  namespace {
+    /** Arenas that are not in use by any solver on this thread. Reset arenas keep their
+        first slab, so steady-state solving doesn't go back to malloc. */
+    thread_local std::vector<std::unique_ptr<tempest::support::BumpPtrAllocator>> freeArenas;
+  }
+
+  ConstraintSolver::~ConstraintSolver() {
+    // Sites and candidates live in the arena, so only their destructors need to run.
+    for (auto site : _sites) {
+      site->~OverloadSite();
+    }
+    releaseArena(_alloc);
+  }
+
+  tempest::support::BumpPtrAllocator& ConstraintSolver::acquireArena() {
+    if (freeArenas.empty()) {
+      return *new tempest::support::BumpPtrAllocator();
+    }
+    auto arena = freeArenas.back().release();
+    freeArenas.pop_back();
+    return *arena;
+  }
+
+  void ConstraintSolver::releaseArena(tempest::support::BumpPtrAllocator& arena) {
+    arena.Reset();
+    freeArenas.emplace_back(&arena);
+  }
+
   void ConstraintSolver::addSite(OverloadSite* site) {
     site->ordinal = _sites.size();
     _sites.push_back(site);
   }
 
   void ConstraintSolver::run() {
+    if (!profile && !traceSites) {
+      solveOrReplay();
+      return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    bool cached = solveOrReplay();
+    auto stats = this->stats();
+    stats.time = std::chrono::steady_clock::now() - start;
+    stats.cached = cached;
+    if (profile) {
+      profile->record(stats);
+    }
+    if (traceSites) {
+      diag.debug(location) << "Solved " << stats.numSites << " sites with "
+          << stats.numCandidates << " candidates in " << stats.rejectionPasses
+          << " rejection passes and " << stats.permutations << " permutations"
+          << (cached ? " (from cache):" : ":");
+      traceCandidates();
+    }
+  }
+
+  bool ConstraintSolver::solveOrReplay() {
+    auto cache = OverloadCache::current();
+    OverloadCache::Key key;
+    if (cache && computeCacheKey(key)) {
+      if (auto entry = cache->find(key)) {
+        replaySolution(*entry);
+        checkNonCandidateConstraints();
+        return true;
+      }
+
+      auto errorCount = diag.errorCount();
+      solve();
+      if (!_failed && errorCount == diag.errorCount()) {
+        recordSolution(*cache, key);
+      }
+      return false;
+    }
+
+    solve();
+    return false;
+  }
+
+  SolverStats ConstraintSolver::stats() const {
+    SolverStats result;
+    result.location = location;
+    result.numSites = _sites.size();
+    for (auto site : _sites) {
+      result.numCandidates += site->candidates.size();
+      result.maxCandidates = std::max(result.maxCandidates, site->candidates.size());
+    }
+    result.rejectionPasses = _rejectionPasses;
+    result.rejectionChecks = _rejectionChecks;
+    result.permutations = _permutations;
+    result.searchSteps = _searchSteps;
+    return result;
+  }
+
+  void ConstraintSolver::traceCandidates() {
+    diag.indent();
+    for (auto site : _sites) {
+      diag.debug(site->location) << "Site " << site->ordinal << ":";
+      diag.indent();
+      reportCandidateStatus(site);
+      diag.unindent();
+    }
+    diag.unindent();
+  }
+
+  bool ConstraintSolver::computeCacheKey(OverloadCache::Key& key) const {
+    if (_sites.size() != 1 || _sites[0]->kind != OverloadKind::CALL) {
+      return false;
+    }
+
+    // Explicit bindings are derived from the candidates' type parameters, so they are
+    // covered by the candidate list and don't need to be part of the key.
+    auto site = static_cast<CallSite*>(_sites[0]);
+    key.push_back(site->candidates.size());
+    for (auto oc : site->candidates) {
+      key.push_back(uintptr_t(oc->getMember()));
+      // Type arguments which are not being inferred come from either an explicit
+      // specialization or the enclosing generic context.
+      key.push_back(oc->typeArgs.size());
+      for (auto typeArg : oc->typeArgs) {
+        if (!typeArg) {
+          return false;
+        } else if (typeArg->kind == Type::Kind::INFERRED) {
+          key.push_back(0);
+        } else if (RelationCache::isCacheable(typeArg)) {
+          key.push_back(uintptr_t(typeArg));
+        } else {
+          return false;
+        }
+      }
+    }
+
+    key.push_back(site->argTypes.size());
+    for (auto argType : site->argTypes) {
+      if (!RelationCache::isCacheable(argType)) {
+        return false;
+      }
+      key.push_back(uintptr_t(argType));
+    }
+
+    // The expected type. The source of the assignment is either a plain type, the
+    // contingent return type of the site, or the return type of one of its candidates.
+    key.push_back(_assignments.size());
+    for (auto& assign : _assignments) {
+      if (!RelationCache::isCacheable(assign.dstType)) {
+        return false;
+      }
+      key.push_back(uintptr_t(assign.dstType));
+      if (RelationCache::isCacheable(assign.srcType)) {
+        key.push_back(0);
+        key.push_back(uintptr_t(assign.srcType));
+      } else if (auto contingent = dyn_cast<ContingentType>(assign.srcType)) {
+        if (contingent->entries.size() != site->candidates.size()) {
+          return false;
+        }
+        for (size_t i = 0; i < contingent->entries.size(); i += 1) {
+          if (contingent->entries[i].when != site->candidates[i]) {
+            return false;
+          }
+        }
+        key.push_back(1);
+      } else {
+        auto it = std::find_if(
+            site->candidates.begin(), site->candidates.end(),
+            [&assign](auto oc) {
+              return static_cast<CallCandidate*>(oc)->returnType == assign.srcType;
+            });
+        if (it == site->candidates.end()) {
+          return false;
+        }
+        key.push_back(2);
+        key.push_back((*it)->ordinal);
+      }
+    }
+    return true;
+  }
+
+  void ConstraintSolver::replaySolution(const OverloadCache::Entry& entry) {
+    auto site = _sites[0];
+    for (auto oc : site->candidates) {
+      if (oc->ordinal != entry.choice && !oc->isRejected()) {
+        oc->rejection.reason = Rejection::NOT_BEST;
+      }
+    }
+    auto chosen = site->candidates[entry.choice];
+    assert(!chosen->isRejected());
+    chosen->accepted = true;
+    chosen->conversionResults = entry.conversionResults;
+    for (size_t i = 0; i < chosen->typeArgs.size(); i += 1) {
+      if (auto inferred = dyn_cast<InferredType>(chosen->typeArgs[i])) {
+        inferred->value = entry.typeArgs[i];
+      }
+    }
+  }
+
+  void ConstraintSolver::recordSolution(OverloadCache& cache, const OverloadCache::Key& key) {
+    auto chosen = _sites[0]->singularCandidate();
+    OverloadCache::Entry entry;
+    entry.choice = chosen->ordinal;
+    entry.conversionResults = chosen->conversionResults;
+    for (auto typeArg : chosen->typeArgs) {
+      if (auto inferred = dyn_cast<InferredType>(typeArg)) {
+        // Solutions that refer to other inference variables are specific to this problem.
+        if (!inferred->value || !RelationCache::isCacheable(inferred->value)) {
+          return;
+        }
+        entry.typeArgs.push_back(inferred->value);
+      } else {
+        entry.typeArgs.push_back(nullptr);
+      }
+    }
+    cache.insert(key, std::move(entry));
+  }
+
+  void ConstraintSolver::solve() {
     unifyConstraints();
     if (_failed) {
       return;
     }
 
+    _rejectionPasses += 1;
     findRankUpperBound();
     if (_failed) {
       return;
     }
 
     if (!isSingularSolution()) {
+      _rejectionPasses += 1;
       narrowPassRejection();
       if (_failed) {
         return;
@@ -47,6 +333,7 @@ namespace tempest::sema::infer {
     }
 
     if (!isSingularSolution()) {
+      _rejectionPasses += 1;
       findBestRankedOverloads();
       if (_failed) {
         return;
@@ -54,6 +341,7 @@ namespace tempest::sema::infer {
     }
 
     if (!isSingularSolution()) {
+      _rejectionPasses += 1;
       cullCandidatesBySpecificity();
     }
 
@@ -73,7 +361,8 @@ namespace tempest::sema::infer {
       if (auto callSite = dyn_cast<CallSite>(site)) {
         for (auto oc : site->candidates) {
           auto cc = static_cast<CallCandidate*>(oc);
-          std::vector<UnificationResult> unificationResults;
+          auto& unificationResults = _unificationResults;
+          unificationResults.clear();
           Conditions when;
           if (site->candidates.size() > 0) {
             when.add(callSite->ordinal, cc->ordinal);
@@ -93,8 +382,8 @@ namespace tempest::sema::infer {
           }
 
           for (auto& result : unificationResults) {
-            result.param->constraints.push_back(
-                InferredType::Constraint(result.value, result.predicate, result.conditions));
+            result.param->constraints.push_back(InferredType::Constraint(
+                result.value, result.predicate, std::move(result.conditions)));
           }
         }
       }
@@ -102,7 +391,8 @@ namespace tempest::sema::infer {
 
     for (auto& assign : _assignments) {
       Conditions when;
-      std::vector<UnificationResult> unificationResults;
+      auto& unificationResults = _unificationResults;
+      unificationResults.clear();
       if (!unify(
           unificationResults,
           assign.dstType,
@@ -116,25 +406,29 @@ namespace tempest::sema::infer {
         break;
       }
       for (auto& result : unificationResults) {
-        result.param->constraints.push_back(
-            InferredType::Constraint(result.value, result.predicate, result.conditions));
+        result.param->constraints.push_back(InferredType::Constraint(
+            result.value, result.predicate, std::move(result.conditions)));
       }
     }
   }
 
+  bool Conditions::Conjunct::isViable(const ConstraintSolver& cs) const {
+    auto& candidates = cs.sites()[_site]->candidates;
+    for (auto choice : *this) {
+      if (candidates[choice]->isViable()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
   bool ConstraintSolver::isViable(const Conditions& cond) {
-    return std::all_of(
-      cond.begin(), cond.end(),
-      [cond, this](const Conditions::Conjunct& cj) {
-        auto candidates = _sites[cj.site()]->candidates;
-        for (auto choice : cj) {
-          if (candidates[choice]->isViable()) {
-            return true;
-          }
-        }
+    for (auto& cj : cond) {
+      if (!cj.isViable(*this)) {
         return false;
       }
-    );
+    }
+    return true;
   }
 
   bool ConstraintSolver::isSingularSolution() const {
@@ -153,40 +447,90 @@ namespace tempest::sema::infer {
     }
 
     // Attempt to remove all candidates from consideration that would result in a conversion
-    // error.
-    for (;;) {
-      bool rejection = false;
-      for (auto& constraint : _bindings) {
+    // error. Each check is run once; after that, it is only run again if a candidate is
+    // rejected at one of the sites it depends on.
+    std::vector<RejectionCheck> checks;
+    for (auto& constraint : _bindings) {
+      checks.push_back({ &constraint, nullptr, 0, true });
+    }
+    for (auto site : _sites) {
+      if (site->kind == OverloadKind::CALL) {
+        auto callSite = static_cast<CallSite*>(site);
+        for (size_t i = 0; i < callSite->argTypes.size(); i += 1) {
+          checks.push_back({ nullptr, callSite, i, true });
+        }
+      } else {
+        assert(false && "Implement overload kind");
+      }
+    }
+
+    std::vector<llvm::SmallVector<size_t, 4>> dependents(_sites.size());
+    for (size_t i = 0; i < checks.size(); i += 1) {
+      llvm::SmallVector<size_t, 8> sites;
+      llvm::SmallPtrSet<const Type*, 8> visited;
+      auto& check = checks[i];
+      if (check.binding) {
+        collectSiteDependencies(check.binding->dstType, visited, sites);
+        collectSiteDependencies(check.binding->srcType, visited, sites);
+      } else {
+        collectSiteDependencies(check.site->argTypes[check.argIndex], visited, sites);
+        for (auto oc : check.site->candidates) {
+          if (oc->isRejected()) {
+            continue;
+          }
+          auto cc = static_cast<CallCandidate*>(oc);
+          collectSiteDependencies(
+              cc->paramTypes[cc->paramAssignments[check.argIndex]], visited, sites);
+        }
+      }
+      std::sort(sites.begin(), sites.end());
+      sites.erase(std::unique(sites.begin(), sites.end()), sites.end());
+      for (auto site : sites) {
+        dependents[site].push_back(i);
+      }
+    }
+
+    std::deque<size_t> worklist;
+    for (size_t i = 0; i < checks.size(); i += 1) {
+      worklist.push_back(i);
+    }
+    while (!worklist.empty()) {
+      auto& check = checks[worklist.front()];
+      worklist.pop_front();
+      check.queued = false;
+      _rejectionChecks += 1;
+
+      OverloadSite* rejectedAt = nullptr;
+      if (check.binding) {
+        auto& constraint = *check.binding;
         if (constraint.candidate->isViable()) {
           if (constraint.predicate == TypeRelation::SUBTYPE) {
             if (!isEqualOrNarrower(constraint.dstType, constraint.srcType)) {
               constraint.candidate->rejection.reason = Rejection::UNSATISFIED_TYPE_CONSTRAINT;
               constraint.candidate->rejection.constraint = &constraint;
-              rejection = true;
+              rejectedAt = constraint.candidate->site;
             }
           }
         }
+      } else if (rejectByParamAssignment(check.site, check.argIndex)) {
+        rejectedAt = check.site;
       }
 
-      for (auto site : _sites) {
-        if (site->kind == OverloadKind::CALL) {
-          auto callSite = static_cast<CallSite*>(site);
-          for (size_t i = 0; i < callSite->argTypes.size(); i += 1) {
-            rejection = rejection || rejectByParamAssignment(callSite, i);
+      if (rejectedAt) {
+        for (auto index : dependents[rejectedAt->ordinal]) {
+          if (!checks[index].queued) {
+            checks[index].queued = true;
+            worklist.push_back(index);
           }
-        } else {
-          assert(false && "Implement overload kind");
-        }
-
-        if (site->allRejected()) {
-          _failed = true;
-          reportSiteRejections(site);
-          return;
         }
       }
+    }
 
-      if (!rejection) {
-        break;
+    for (auto site : _sites) {
+      if (site->allRejected()) {
+        _failed = true;
+        reportSiteRejections(site);
+        return;
       }
     }
 
@@ -332,22 +676,42 @@ namespace tempest::sema::infer {
     }
   }
 
+  size_t ConstraintSolver::defaultSearchBudget = 100000;
+  SolverProfile* ConstraintSolver::profile = nullptr;
+  bool ConstraintSolver::traceSites = false;
+  bool ConstraintSolver::boundPruning = true;
+
   void ConstraintSolver::findBestRankedOverloads() {
-    // Set up pruning flags
     _currentPermutation.resize(_sites.size());
     _bestPermutationCount = 0;
     _bestPermutation.resize(_sites.size());
+    _bestPermutationSet.clear();
     _bestRankings.setToWorst();
+    _searchSteps = 0;
+
+    // Unassigned sites keep all of their candidates, so that the bound is optimistic.
     for (auto site : _sites) {
-      site->pruneAll(true);
+      site->pruneAll(false);
     }
-    findBestRankedOverloads(_sites, 0);
+
+    // Assign the sites with the fewest remaining candidates first; this keeps the search
+    // tree narrow near the root and tightens the bound as early as possible.
+    std::vector<OverloadSite*> order(_sites.begin(), _sites.end());
+    std::stable_sort(order.begin(), order.end(), [](OverloadSite* a, OverloadSite* b) {
+      return a->numViable() < b->numViable();
+    });
+    findBestRankedOverloads(order, 0);
     for (auto site : _sites) {
       site->pruneAll(false);
     }
 
     // diag.debug() << "Best permutation count: " << _bestPermutationCount;
-    if (_bestRankings.isError()) {
+    if (_searchSteps > _searchBudget) {
+      _failed = true;
+      diag.error(location) << "Expression is too ambiguous: overload resolution gave up after "
+          << _searchBudget << " steps.";
+      diag.info() << "Consider adding explicit types or casts to narrow down the choices.";
+    } else if (_bestRankings.isError()) {
       _failed = true;
       diag.error(location) << "Unable to find a type solution for expression.";
       // diag.info() << "Best overload candidates are:";
@@ -372,19 +736,37 @@ namespace tempest::sema::infer {
 
   void ConstraintSolver::findBestRankedOverloads(
       const llvm::ArrayRef<OverloadSite*>& sites, size_t index) {
+    if (++_searchSteps > _searchBudget) {
+      return;
+    }
+
     if (index < sites.size()) {
+      // Since the sites before 'index' are fixed, any constraint conditioned on one of their
+      // other candidates is no longer viable. If even the best case for the remaining sites
+      // is worse than a solution we already have, then there's no point in going further.
+      if (boundPruning && index > 0 &&
+          _bestRankings.isBetterThan(computeRankingsUpperBound())) {
+        return;
+      }
+
       auto site = sites[index];
+      site->pruneAll(true);
       for (size_t i = 0; i < site->candidates.size(); i += 1) {
         auto oc = site->candidates[i];
         if (oc->rejection.reason != Rejection::NONE) {
           continue;
         }
         oc->pruned = false;
-        _currentPermutation[index] = i;
+        _currentPermutation[site->ordinal] = i;
         findBestRankedOverloads(sites, index + 1);
         oc->pruned = true;
+        if (_searchSteps > _searchBudget) {
+          break;
+        }
       }
+      site->pruneAll(false);
     } else {
+      _permutations += 1;
       ConversionRankTotals rankings = computeRankingsForConfiguration();
       if (rankings.isBetterThan(_bestRankings)) {
         _bestPermutationSet.clear();
@@ -402,6 +784,38 @@ namespace tempest::sema::infer {
     }
   }
 
+  ConversionRankTotals ConstraintSolver::computeRankingsUpperBound() {
+    // Choosing a candidate at a site can only make other conversions worse, since it removes
+    // possibilities, so the best conversion of each argument over all viable candidates
+    // is an upper bound.
+    ConversionRankTotals rankings;
+    for (auto site : _sites) {
+      if (site->kind == OverloadKind::CALL) {
+        auto callSite = static_cast<CallSite*>(site);
+        for (size_t i = 0; i < callSite->argTypes.size(); i += 1) {
+          rankings.count[int(paramConversion(callSite, i).rank)] += 1;
+        }
+      } else {
+        assert(false && "Implement overload kind");
+      }
+    }
+    for (auto& assign : _assignments) {
+      auto result = isAssignable(assign.dstType, assign.srcType);
+      rankings.count[int(result.rank)] += 1;
+    }
+    for (auto& constraint : _bindings) {
+      // Only count the constraints of candidates that are certain to be chosen.
+      if (constraint.candidate->isViable() && constraint.candidate->site->numViable() == 1) {
+        if (constraint.predicate == TypeRelation::SUBTYPE) {
+          if (!isEqualOrNarrower(constraint.dstType, constraint.srcType)) {
+            rankings.count[int(ConversionRank::ERROR)] += 1;
+          }
+        }
+      }
+    }
+    return rankings;
+  }
+
   ConversionRankTotals ConstraintSolver::computeRankingsForConfiguration() {
     ConversionRankTotals rankings;
     for (auto site : _sites) {
@@ -760,6 +1174,22 @@ namespace tempest::sema::infer {
   void ConstraintSolver::computeUniqueValueForTypeVars() {
     llvm::EquivalenceClasses<const InferredType*> ec;
 
+    // The solution is fixed at this point, so viability of each constraint only needs to
+    // be evaluated once.
+    llvm::DenseMap<const InferredType*, SmallVector<const InferredType::Constraint*, 4>> viable;
+    auto viableConstraints = [&viable](const InferredType* inferred) -> auto& {
+      auto it = viable.find(inferred);
+      if (it == viable.end()) {
+        it = viable.try_emplace(inferred).first;
+        for (auto& constraint : inferred->constraints) {
+          if (inferred->isViable(constraint)) {
+            it->second.push_back(&constraint);
+          }
+        }
+      }
+      return it->second;
+    };
+
     // Find all type variables that are equivalent.
     for (auto site : _sites) {
       auto oc = site->singularCandidate();
@@ -768,11 +1198,9 @@ namespace tempest::sema::infer {
         if (auto inferred = dyn_cast_or_null<InferredType>(typeArg)) {
           inferred->value = nullptr;
           ec.insert(inferred);
-          for (auto& constraint : inferred->constraints) {
-            if (inferred->isViable(constraint)) {
-              if (auto value = dyn_cast<InferredType>(constraint.value)) {
-                ec.unionSets(inferred, value);
-              }
+          for (auto constraint : viableConstraints(inferred)) {
+            if (auto value = dyn_cast<InferredType>(constraint->value)) {
+              ec.unionSets(inferred, value);
             }
           }
         }
@@ -781,55 +1209,56 @@ namespace tempest::sema::infer {
 
     // For each equivalent set, find all of the constraints
     for (auto it = ec.begin(); it != ec.end(); ++it) {
+      if (!it->isLeader()) {
+        continue;
+      }
       const Type* equivalent = nullptr;
       const Type* assignableFrom = nullptr;
       const Type* assignableTo = nullptr;
       for (auto mit = ec.member_begin(it); mit != ec.member_end(); ++mit) {
-        auto inferred = *mit;
-        for (auto& constraint : inferred->constraints) {
-          if (inferred->isViable(constraint)) {
-            if (constraint.value->kind != Type::Kind::INFERRED) {
-              if (constraint.predicate == TypeRelation::EQUAL) {
-                // If there are multiple equal constraints, they must be equal to each other.
-                if (!equivalent) {
-                  equivalent = constraint.value;
-                } else if (!isEqual(equivalent, constraint.value)) {
+        for (auto cp : viableConstraints(*mit)) {
+          auto& constraint = *cp;
+          if (constraint.value->kind != Type::Kind::INFERRED) {
+            if (constraint.predicate == TypeRelation::EQUAL) {
+              // If there are multiple equal constraints, they must be equal to each other.
+              if (!equivalent) {
+                equivalent = constraint.value;
+              } else if (!isEqual(equivalent, constraint.value)) {
+                assert(false && "Inconsistent");
+              }
+            } else if (constraint.predicate == TypeRelation::ASSIGNABLE_FROM) {
+              // If there are multiple assignableFroms, then pick the more general one,
+              // that is, the one that can be assigned from all the others. If they are
+              // disjoint, that's an error.
+              if (!assignableFrom) {
+                assignableFrom = constraint.value;
+              } else if (isAssignable(assignableFrom, constraint.value).rank ==
+                  ConversionRank::ERROR) {
+                if (isAssignable(constraint.value, assignableFrom) ==
+                    ConversionRank::ERROR) {
                   assert(false && "Inconsistent");
-                }
-              } else if (constraint.predicate == TypeRelation::ASSIGNABLE_FROM) {
-                // If there are multiple assignableFroms, then pick the more general one,
-                // that is, the one that can be assigned from all the others. If they are
-                // disjoint, that's an error.
-                if (!assignableFrom) {
+                } else {
                   assignableFrom = constraint.value;
-                } else if (isAssignable(assignableFrom, constraint.value).rank ==
-                    ConversionRank::ERROR) {
-                  if (isAssignable(constraint.value, assignableFrom) ==
-                      ConversionRank::ERROR) {
-                    assert(false && "Inconsistent");
-                  } else {
-                    assignableFrom = constraint.value;
-                  }
                 }
-              } else if (constraint.predicate == TypeRelation::ASSIGNABLE_TO) {
-                // If there are multiple assignableTos, then pick the more specific one,
-                // that is, the one that can be assigned to all the others. If they are
-                // disjoint, that's an error.
-                if (!assignableTo) {
-                  assignableTo = constraint.value;
-                } else if (isAssignable(constraint.value, assignableTo).rank ==
+              }
+            } else if (constraint.predicate == TypeRelation::ASSIGNABLE_TO) {
+              // If there are multiple assignableTos, then pick the more specific one,
+              // that is, the one that can be assigned to all the others. If they are
+              // disjoint, that's an error.
+              if (!assignableTo) {
+                assignableTo = constraint.value;
+              } else if (isAssignable(constraint.value, assignableTo).rank ==
+                  ConversionRank::ERROR) {
+                if (isAssignable(assignableTo, constraint.value) ==
                     ConversionRank::ERROR) {
-                  if (isAssignable(assignableTo, constraint.value) ==
-                      ConversionRank::ERROR) {
-                    assert(false && "Inconsistent");
-                  } else {
-                    assignableTo = constraint.value;
-                  }
+                  assert(false && "Inconsistent");
+                } else {
+                  assignableTo = constraint.value;
                 }
-              } else {
-                // TODO: other constraint types.
-                assert(false && "Invalid predicate");
               }
+            } else {
+              // TODO: other constraint types.
+              assert(false && "Invalid predicate");
             }
           }
         }
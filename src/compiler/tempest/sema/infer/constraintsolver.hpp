@@ -13,6 +13,18 @@
   #include "tempest/sema/convert/result.hpp"
 #endif
 
+#ifndef TEMPEST_SEMA_INFER_UNIFICATION_HPP
+  #include "tempest/sema/infer/unification.hpp"
+#endif
+
+#ifndef TEMPEST_SEMA_INFER_OVERLOADCACHE_HPP
+  #include "tempest/sema/infer/overloadcache.hpp"
+#endif
+
+#ifndef TEMPEST_SEMA_INFER_SOLVERPROFILE_HPP
+  #include "tempest/sema/infer/solverprofile.hpp"
+#endif
+
 #ifndef TEMPEST_SUPPORT_ALLOCATOR_HPP
   #include "tempest/support/allocator.hpp"
 #endif
@@ -51,17 +63,28 @@ namespace tempest::sema::infer {
   public:
     source::Location location;
 
+    /** Default for the maximum number of steps the overload search may take. */
+    static size_t defaultSearchBudget;
+
+    /** If set, statistics for every solver run are recorded here. */
+    static SolverProfile* profile;
+
+    /** If true, print the final status of every candidate at each site after solving. */
+    static bool traceSites;
+
+    /** If false, the overload search ranks every permutation instead of skipping those
+        which can't beat the best solution found so far. */
+    static bool boundPruning;
+
     ConstraintSolver(
         const source::Location& location
         )
       : location(location)
+      , _alloc(acquireArena())
+      , _searchBudget(defaultSearchBudget)
     {}
 
-    ~ConstraintSolver() {
-      for (auto site : _sites) {
-        delete site;
-      }
-    }
+    ~ConstraintSolver();
 
     tempest::support::BumpPtrAllocator& alloc() { return _alloc; }
 
@@ -90,6 +113,8 @@ namespace tempest::sema::infer {
 
     void addSite(OverloadSite* site);
 
+    /** Solve the constraints, or replay the solution of an identical problem from the
+        overload cache. */
     void run();
     bool failed() const { return _failed; }
     void unifyConstraints();
@@ -101,10 +126,19 @@ namespace tempest::sema::infer {
     /** Reject candidates by restricting a single site to each candidate in turn. */
     void narrowPassRejection();
 
-    /** Brute-force search of all overload permutations to find the best ranking. */
+    /** Branch-and-bound search of overload permutations to find the best ranking. */
     void findBestRankedOverloads();
     void findBestRankedOverloads(const llvm::ArrayRef<OverloadSite*>& sites, size_t index);
 
+    /** Set the maximum number of steps the overload search may take before giving up. */
+    void setSearchBudget(size_t budget) { _searchBudget = budget; }
+
+    /** Number of steps taken by the most recent overload search. */
+    size_t searchSteps() const { return _searchSteps; }
+
+    /** Statistics for the most recent run. Timing is only measured when profiling. */
+    SolverStats stats() const;
+
     void cullCandidatesBySpecificity();
 
     void checkNonCandidateConstraints();
@@ -114,7 +148,18 @@ namespace tempest::sema::infer {
     bool isSingularSolution() const;
 
   private:
-    tempest::support::BumpPtrAllocator _alloc;
+    /** A test which can reject candidates while computing the rank upper bound: either an
+        explicit binding, or the conversion of one argument at a call site. */
+    struct RejectionCheck {
+      ExplicitConstraint* binding;
+      CallSite* site;
+      size_t argIndex;
+      bool queued;
+    };
+
+    /** Arena for objects owned by this solver: sites, candidates, inferred types and
+        contingent types. Objects placed here must not outlive the solver. */
+    tempest::support::BumpPtrAllocator& _alloc;
     std::vector<AssignmentConstraint> _assignments;
     std::vector<ExplicitConstraint> _bindings;
     std::vector<OverloadSite*> _sites;
@@ -123,10 +168,52 @@ namespace tempest::sema::infer {
     std::unordered_set<uint32_t> _bestPermutationSet;
     size_t _bestPermutationCount;
     ConversionRankTotals _bestRankings;
+    size_t _searchBudget;
+    size_t _searchSteps = 0;
+    size_t _permutations = 0;
+    size_t _rejectionPasses = 0;
+    size_t _rejectionChecks = 0;
     bool _failed = false;
 
+    /** Scratch buffer for unification results, reused for each candidate. */
+    std::vector<UnificationResult> _unificationResults;
+
+    /** Take an arena from the current thread's pool, or create one if the pool is empty.
+        Solvers can nest (inferring a callee's signature may start a new solver), so each
+        live solver has an arena of its own. */
+    static tempest::support::BumpPtrAllocator& acquireArena();
+
+    /** Reset an arena and return it to the current thread's pool. */
+    static void releaseArena(tempest::support::BumpPtrAllocator& arena);
+
+    /** Solve the constraints, or replay a cached solution. Returns true if the solution
+        came from the cache. */
+    bool solveOrReplay();
+
+    /** Run each phase of the solver in turn. */
+    void solve();
+
+    /** Print the status of every candidate, for tracing. */
+    void traceCandidates();
+
+    /** Compute the overload cache signature of this problem. Returns false if the problem
+        can't be cached, which is the case unless there is exactly one call site and none
+        of the argument or expected types depend on inference variables. */
+    bool computeCacheKey(OverloadCache::Key& key) const;
+
+    /** Apply a previously recorded solution to the sole call site. */
+    void replaySolution(const OverloadCache::Entry& entry);
+
+    /** Record the solution of the sole call site. */
+    void recordSolution(OverloadCache& cache, const OverloadCache::Key& key);
+
     ConversionRankTotals computeRankingsForConfiguration();
 
+    /** Compute the best rankings that any completion of the current partial assignment
+        could achieve. Sites that have not been assigned yet have all of their remaining
+        candidates unpruned. */
+    ConversionRankTotals computeRankingsUpperBound();
+
     /** Find the best possible conversion for the nth parameter at a call site, checking
         all remaining viable overloads. */
     ConversionResult paramConversion(CallSite* site, size_t argIndex);
@@ -6,11 +6,10 @@ namespace tempest::sema::infer {
   using tempest::error::diag;
 
   OverloadCandidate::~OverloadCandidate() {
-    // Delete any inferred types (and the tables they contain) that got allocated.
-    // Everything else can be left since it's pool-allocated.
+    // Inferred types are arena-allocated, but the constraint tables they contain are not.
     for (auto type : typeArgs) {
       if (type && type->kind == Type::Kind::INFERRED) {
-        delete type;
+        static_cast<const InferredType*>(type)->~InferredType();
       }
     }
   }
@@ -17,6 +17,10 @@
   #include "tempest/sema/infer/rejection.hpp"
 #endif
 
+#ifndef TEMPEST_SUPPORT_ALLOCATOR_HPP
+  #include "tempest/support/allocator.hpp"
+#endif
+
 #ifndef LLVM_ADT_SMALLVECTOR_H
   #include <llvm/ADT/SmallVector.h>
 #endif
@@ -177,9 +181,10 @@ namespace tempest::sema::infer {
       , location(location)
     {}
 
-    ~OverloadSite() {
+    virtual ~OverloadSite() {
+      // Candidates are arena-allocated along with the site.
       for (auto oc : candidates) {
-        delete oc;
+        oc->~OverloadCandidate();
       }
     }
 
@@ -253,8 +258,9 @@ namespace tempest::sema::infer {
       , argTypes(argTypes.begin(), argTypes.end())
     {}
 
-    CallCandidate* addCandidate(Member* method, Expr* stem) {
-      auto cc = new CallCandidate(this, candidates.size(), method, stem);
+    CallCandidate* addCandidate(
+        tempest::support::BumpPtrAllocator& alloc, Member* method, Expr* stem) {
+      auto cc = new (alloc) CallCandidate(this, candidates.size(), method, stem);
       candidates.push_back(cc);
       return cc;
     }
@@ -0,0 +1,10 @@
+#include "tempest/compiler/compilationunit.hpp"
+#include "tempest/sema/infer/overloadcache.hpp"
+
+namespace tempest::sema::infer {
+  using tempest::compiler::CompilationUnit;
+
+  OverloadCache* OverloadCache::current() {
+    return CompilationUnit::theCU ? &CompilationUnit::theCU->overloads() : nullptr;
+  }
+}
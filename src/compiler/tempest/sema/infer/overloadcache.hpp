@@ -0,0 +1,99 @@
+#ifndef TEMPEST_SEMA_INFER_OVERLOADCACHE_HPP
+#define TEMPEST_SEMA_INFER_OVERLOADCACHE_HPP 1
+
+#ifndef TEMPEST_SEMA_GRAPH_TYPE_HPP
+  #include "tempest/sema/graph/type.hpp"
+#endif
+
+#ifndef TEMPEST_SEMA_CONVERT_RESULT_HPP
+  #include "tempest/sema/convert/result.hpp"
+#endif
+
+#ifndef TEMPEST_SUPPORT_HASHING_HPP
+  #include "tempest/support/hashing.hpp"
+#endif
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace tempest::sema::infer {
+  using tempest::sema::graph::Type;
+  using tempest::sema::convert::ConversionRankTotals;
+
+  /** Memoizes the outcome of overload resolution for call sites which have the same set of
+      candidates, the same argument types and the same expected result type, so that common
+      calls such as integer operators are only searched once per compilation. The key is an
+      opaque signature computed by the constraint solver; only solutions that succeeded
+      without diagnostics are recorded. Safe to use from multiple threads. */
+  class OverloadCache {
+  public:
+    typedef std::vector<uintptr_t> Key;
+
+    /** The recorded solution for a call site. */
+    struct Entry {
+      /** Ordinal of the chosen candidate. */
+      size_t choice;
+
+      /** Solved values for the chosen candidate's inferred type arguments, in the same
+          order as its type arguments; null for those which were not inferred. */
+      std::vector<const Type*> typeArgs;
+
+      /** Conversion rankings of the chosen candidate. */
+      ConversionRankTotals conversionResults;
+    };
+
+    /** Return the recorded solution for this signature, or nullptr if there is none. Entries
+        are never removed, so the returned pointer remains valid. */
+    const Entry* find(const Key& key) {
+      std::lock_guard<std::mutex> lock(_mutex);
+      auto it = _entries.find(key);
+      if (it != _entries.end()) {
+        _hits += 1;
+        return &it->second;
+      }
+      _misses += 1;
+      return nullptr;
+    }
+
+    /** Record the solution for a signature. */
+    void insert(const Key& key, Entry&& entry) {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _entries.emplace(key, std::move(entry));
+    }
+
+    /** Number of entries. */
+    size_t size() const {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return _entries.size();
+    }
+
+    /** Number of lookups that found a previously recorded solution. */
+    size_t hits() const { return _hits; }
+
+    /** Number of lookups that did not find a recorded solution. */
+    size_t misses() const { return _misses; }
+
+    /** The overload cache for the current compilation unit, or nullptr if there is none. */
+    static OverloadCache* current();
+
+  private:
+    struct KeyHash {
+      std::size_t operator()(const Key& key) const {
+        std::size_t result = key.size();
+        for (auto word : key) {
+          tempest::support::hash_combine(result, std::hash<uintptr_t>()(word));
+        }
+        return result;
+      }
+    };
+
+    mutable std::mutex _mutex;
+    std::unordered_map<Key, Entry, KeyHash> _entries;
+    std::atomic<size_t> _hits = 0;
+    std::atomic<size_t> _misses = 0;
+  };
+}
+
+#endif
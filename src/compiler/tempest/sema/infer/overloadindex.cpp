@@ -0,0 +1,152 @@
+#include "tempest/sema/graph/defn.hpp"
+#include "tempest/sema/infer/overloadindex.hpp"
+#include <algorithm>
+
+namespace tempest::sema::infer {
+  using namespace tempest::sema::graph;
+
+  OverloadIndex::OverloadIndex(llvm::ArrayRef<Member*> members) {
+    _entries.reserve(members.size());
+    for (size_t i = 0; i < members.size(); i += 1) {
+      auto function = cast<FunctionDefn>(unwrapSpecialization(members[i]));
+      auto& params = function->params();
+
+      // Mirror ParameterAssignmentsBuilder for positional arguments: arguments fill params
+      // in order up to the first keyword-only param, the variadic param absorbs the rest,
+      // and every non-variadic param without a default must be filled.
+      size_t maxArgs = 0;
+      while (maxArgs < params.size() && !params[maxArgs]->isKeywordOnly()) {
+        maxArgs += 1;
+      }
+      if (function->isVariadic() && maxArgs == params.size()) {
+        maxArgs = size_t(-1);
+      }
+      size_t numParams = function->isVariadic() ? params.size() - 1 : params.size();
+      size_t minArgs = 0;
+      for (size_t p = 0; p < numParams; p += 1) {
+        if (!params[p]->init()) {
+          minArgs = p + 1;
+        }
+      }
+
+      Category firstParam = Category::ANY;
+      if (!params.empty()) {
+        if (function->type()) {
+          firstParam = categoryOf(function->type()->paramTypes[0]);
+        } else if (params[0]->type()) {
+          firstParam = categoryOf(params[0]->type());
+        } else {
+          _complete = false;
+        }
+      }
+
+      _entries.push_back({ minArgs, maxArgs, firstParam });
+      if (minArgs == maxArgs) {
+        _byArity[minArgs].push_back(i);
+      } else {
+        _ranged.push_back(i);
+      }
+    }
+  }
+
+  void OverloadIndex::findPlausible(
+      llvm::ArrayRef<const Type*> argTypes, llvm::SmallVectorImpl<size_t>& out) const {
+    auto numArgs = argTypes.size();
+    auto accepts = [this, numArgs, argTypes](size_t i) {
+      auto& entry = _entries[i];
+      if (numArgs < entry.minArgs || numArgs > entry.maxArgs) {
+        return false;
+      }
+      return numArgs == 0 || isCompatible(entry.firstParam, argTypes[0]);
+    };
+
+    // Both lists are in member order, so merging them preserves the order of the set.
+    static const llvm::SmallVector<size_t, 4> none;
+    auto it = _byArity.find(numArgs);
+    auto& fixed = it != _byArity.end() ? it->second : none;
+    auto fi = fixed.begin();
+    auto ri = _ranged.begin();
+    while (fi != fixed.end() || ri != _ranged.end()) {
+      size_t i;
+      if (ri == _ranged.end() || (fi != fixed.end() && *fi < *ri)) {
+        i = *fi++;
+      } else {
+        i = *ri++;
+      }
+      if (accepts(i)) {
+        out.push_back(i);
+      }
+    }
+  }
+
+  OverloadIndex::Category OverloadIndex::categoryOf(const Type* paramType) {
+    if (auto mt = dyn_cast<ModifiedType>(paramType)) {
+      paramType = mt->base;
+    }
+    switch (paramType->kind) {
+      case Type::Kind::VOID: return Category::VOID;
+      case Type::Kind::BOOLEAN: return Category::BOOLEAN;
+      case Type::Kind::INTEGER: return Category::INTEGER;
+      case Type::Kind::FLOAT: return Category::FLOAT;
+      default: return Category::ANY;
+    }
+  }
+
+  bool OverloadIndex::isCompatible(Category category, const Type* argType) {
+    if (category == Category::ANY) {
+      return true;
+    }
+    if (auto mt = dyn_cast<ModifiedType>(argType)) {
+      argType = mt->base;
+    }
+    // Only arguments whose own kind is fixed can be ruled out. Inferred, contingent,
+    // union, alias and type variable arguments have to go through unification.
+    switch (argType->kind) {
+      case Type::Kind::VOID:
+        return category == Category::VOID;
+      case Type::Kind::BOOLEAN:
+        return category == Category::BOOLEAN;
+      case Type::Kind::INTEGER:
+        return category == Category::INTEGER;
+      case Type::Kind::FLOAT:
+        return category == Category::FLOAT;
+      case Type::Kind::ENUM:
+        // Enums are assignable to integers.
+        return category == Category::INTEGER;
+      case Type::Kind::CLASS:
+      case Type::Kind::STRUCT:
+      case Type::Kind::INTERFACE:
+      case Type::Kind::TRAIT:
+      case Type::Kind::TUPLE:
+      case Type::Kind::FUNCTION:
+        return false;
+      default:
+        return true;
+    }
+  }
+
+  const OverloadIndex* OverloadIndexStore::get(
+      llvm::ArrayRef<Member*> members, std::unique_ptr<OverloadIndex>& temp) {
+    Key key(members.begin(), members.end());
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      auto it = _entries.find(key);
+      if (it != _entries.end()) {
+        return it->second.get();
+      }
+    }
+
+    // Build outside the lock; if another thread got there first, keep theirs.
+    auto index = std::make_unique<OverloadIndex>(members);
+    if (!index->isComplete()) {
+      temp = std::move(index);
+      return temp.get();
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto& entry = _entries[key];
+    if (!entry) {
+      entry = std::move(index);
+    }
+    return entry.get();
+  }
+}
@@ -0,0 +1,119 @@
+#ifndef TEMPEST_SEMA_INFER_OVERLOADINDEX_HPP
+#define TEMPEST_SEMA_INFER_OVERLOADINDEX_HPP 1
+
+#ifndef TEMPEST_SEMA_GRAPH_TYPE_HPP
+  #include "tempest/sema/graph/type.hpp"
+#endif
+
+#ifndef TEMPEST_SUPPORT_HASHING_HPP
+  #include "tempest/support/hashing.hpp"
+#endif
+
+#ifndef LLVM_ADT_SMALLVECTOR_H
+  #include <llvm/ADT/SmallVector.h>
+#endif
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace tempest::sema::graph {
+  class Member;
+}
+
+namespace tempest::sema::infer {
+  using tempest::sema::graph::Member;
+  using tempest::sema::graph::Type;
+
+  /** An index over the members of an overload set, used to skip members that could not
+      possibly accept the arguments at a call site before any candidates are created for them.
+      Members are classified by the range of positional argument counts they accept and by the
+      kind of their first parameter type. The filtering is conservative: a member is only
+      excluded if parameter assignment or unification would certainly reject it. */
+  class OverloadIndex {
+  public:
+    /** Overload sets smaller than this aren't worth indexing. */
+    static constexpr size_t MIN_MEMBERS = 4;
+
+    /** Coarse classification of a parameter type. Only types whose assignability can be
+        decided by kind alone get a category other than ANY. */
+    enum class Category : uint8_t {
+      ANY,
+      VOID,
+      BOOLEAN,
+      INTEGER,
+      FLOAT,
+    };
+
+    /** Build an index of the members of an overload set. Each member must be a function
+        or a specialization of one. */
+    OverloadIndex(llvm::ArrayRef<Member*> members);
+
+    /** True if the signature of every member was known when the index was built. If not,
+        the index is still correct, but filters less than it could. */
+    bool isComplete() const { return _complete; }
+
+    /** Fill in the positions, in their original order, of the members which could accept a
+        call with these positional argument types. */
+    void findPlausible(
+        llvm::ArrayRef<const Type*> argTypes, llvm::SmallVectorImpl<size_t>& out) const;
+
+    /** Classify a parameter type. */
+    static Category categoryOf(const Type* paramType);
+
+    /** False if an argument of type 'argType' can never be assigned to a parameter of the
+        given category. */
+    static bool isCompatible(Category category, const Type* argType);
+
+  private:
+    struct Entry {
+      size_t minArgs;
+      size_t maxArgs;
+      Category firstParam;
+    };
+
+    std::vector<Entry> _entries;
+
+    /** Members that take a fixed number of arguments, by arity. */
+    std::unordered_map<size_t, llvm::SmallVector<size_t, 4>> _byArity;
+
+    /** Members with default or variadic parameters, which accept a range of arities. */
+    llvm::SmallVector<size_t, 4> _ranged;
+    bool _complete = true;
+  };
+
+  /** Per-compilation store of overload set indices, keyed by the list of members in the set.
+      Safe to use from multiple threads. */
+  class OverloadIndexStore {
+  public:
+    /** Return the index for this overload set, building it if needed. The result is owned
+        by the store if it's complete; otherwise it is owned by 'temp'. */
+    const OverloadIndex* get(
+        llvm::ArrayRef<Member*> members, std::unique_ptr<OverloadIndex>& temp);
+
+    /** Number of indexed overload sets. */
+    size_t size() const {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return _entries.size();
+    }
+
+  private:
+    typedef std::vector<Member*> Key;
+
+    struct KeyHash {
+      std::size_t operator()(const Key& key) const {
+        std::size_t result = key.size();
+        for (auto member : key) {
+          tempest::support::hash_combine(result, std::hash<Member*>()(member));
+        }
+        return result;
+      }
+    };
+
+    mutable std::mutex _mutex;
+    std::unordered_map<Key, std::unique_ptr<OverloadIndex>, KeyHash> _entries;
+  };
+}
+
+#endif
@@ -0,0 +1,66 @@
+#include "tempest/error/diagnostics.hpp"
+#include "tempest/sema/infer/solverprofile.hpp"
+#include <algorithm>
+
+namespace tempest::sema::infer {
+  using tempest::error::diag;
+
+  namespace {
+    /** Orders the slowest run first. As a heap order, this keeps the fastest of the
+        retained runs at the top, where it can be replaced. */
+    bool slowerFirst(const SolverStats& a, const SolverStats& b) {
+      return a.time > b.time;
+    }
+
+    double toMillis(std::chrono::nanoseconds time) {
+      return std::chrono::duration<double, std::milli>(time).count();
+    }
+  }
+
+  void SolverProfile::record(const SolverStats& stats) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _runs += 1;
+    _totalTime += stats.time;
+    _permutations += stats.permutations;
+    if (stats.cached) {
+      _cachedRuns += 1;
+    }
+
+    if (_maxSlowest == 0) {
+      return;
+    } else if (_slowest.size() < _maxSlowest) {
+      _slowest.push_back(stats);
+      std::push_heap(_slowest.begin(), _slowest.end(), slowerFirst);
+    } else if (stats.time > _slowest.front().time) {
+      std::pop_heap(_slowest.begin(), _slowest.end(), slowerFirst);
+      _slowest.back() = stats;
+      std::push_heap(_slowest.begin(), _slowest.end(), slowerFirst);
+    }
+  }
+
+  std::vector<SolverStats> SolverProfile::slowest() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::vector<SolverStats> result(_slowest);
+    std::sort(result.begin(), result.end(), slowerFirst);
+    return result;
+  }
+
+  void SolverProfile::report() const {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      diag.info() << "Constraint solver: " << _runs << " runs (" << _cachedRuns
+          << " from cache), " << _permutations << " permutations, "
+          << toMillis(_totalTime) << " ms total.";
+    }
+    for (auto& stats : slowest()) {
+      diag.info(stats.location) << toMillis(stats.time) << " ms: "
+          << stats.numSites << " sites, "
+          << stats.numCandidates << " candidates (at most " << stats.maxCandidates
+          << " per site), "
+          << stats.rejectionPasses << " rejection passes ("
+          << stats.rejectionChecks << " checks), "
+          << stats.permutations << " permutations in " << stats.searchSteps << " steps"
+          << (stats.cached ? ", from cache." : ".");
+    }
+  }
+}
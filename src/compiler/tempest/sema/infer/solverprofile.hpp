@@ -0,0 +1,94 @@
+#ifndef TEMPEST_SEMA_INFER_SOLVERPROFILE_HPP
+#define TEMPEST_SEMA_INFER_SOLVERPROFILE_HPP 1
+
+#ifndef TEMPEST_SOURCE_LOCATION_HPP
+  #include "tempest/source/location.hpp"
+#endif
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+namespace tempest::sema::infer {
+
+  /** Measurements of a single run of the constraint solver. */
+  struct SolverStats {
+    /** Location of the expression being solved. */
+    source::Location location;
+
+    /** Number of overload sites in the expression. */
+    size_t numSites = 0;
+
+    /** Total number of candidates over all sites. */
+    size_t numCandidates = 0;
+
+    /** Number of candidates at the most heavily overloaded site. */
+    size_t maxCandidates = 0;
+
+    /** Number of candidate rejection passes that were needed. */
+    size_t rejectionPasses = 0;
+
+    /** Number of times a binding or argument was checked for candidates to reject. */
+    size_t rejectionChecks = 0;
+
+    /** Number of complete overload permutations ranked by the search. */
+    size_t permutations = 0;
+
+    /** Number of steps taken by the search, including pruned partial permutations. */
+    size_t searchSteps = 0;
+
+    /** True if the solution was replayed from the overload cache. */
+    bool cached = false;
+
+    /** Wall-clock time taken by the solver. */
+    std::chrono::nanoseconds time = std::chrono::nanoseconds::zero();
+  };
+
+  /** Collects solver statistics over a compilation and keeps the slowest runs, so that the
+      expressions which make inference expensive can be found. Safe to use from multiple
+      threads. */
+  class SolverProfile {
+  public:
+    SolverProfile(size_t maxSlowest = 10) : _maxSlowest(maxSlowest) {}
+
+    /** Add the statistics for one solver run. */
+    void record(const SolverStats& stats);
+
+    /** Number of solver runs recorded. */
+    size_t runs() const {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return _runs;
+    }
+
+    /** Number of runs which were replayed from the overload cache. */
+    size_t cachedRuns() const {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return _cachedRuns;
+    }
+
+    /** Total time spent in the solver. */
+    std::chrono::nanoseconds totalTime() const {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return _totalTime;
+    }
+
+    /** The slowest runs, slowest first. */
+    std::vector<SolverStats> slowest() const;
+
+    /** Print a summary and the slowest runs as diagnostic info messages. */
+    void report() const;
+
+  private:
+    mutable std::mutex _mutex;
+    size_t _maxSlowest;
+    size_t _runs = 0;
+    size_t _cachedRuns = 0;
+    size_t _permutations = 0;
+    std::chrono::nanoseconds _totalTime = std::chrono::nanoseconds::zero();
+
+    /** Min-heap on time, so the fastest of the slow runs is the one evicted. */
+    std::vector<SolverStats> _slowest;
+  };
+}
+
+#endif
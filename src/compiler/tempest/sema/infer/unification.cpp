@@ -1,7 +1,9 @@
+#include "tempest/compiler/compilationunit.hpp"
 #include "tempest/error/diagnostics.hpp"
 #include "tempest/sema/graph/defn.hpp"
 #include "tempest/sema/graph/env.hpp"
 #include "tempest/sema/convert/predicate.hpp"
+#include "tempest/sema/convert/relationcache.hpp"
 #include "tempest/sema/infer/types.hpp"
 #include "tempest/sema/infer/unification.hpp"
 #include "tempest/sema/transform/applyspec.hpp"
@@ -9,6 +11,7 @@
 namespace tempest::sema::infer {
   using namespace tempest::sema::graph;
   using namespace tempest::sema::convert;
+  using tempest::compiler::CompilationUnit;
   using tempest::error::diag;
   using tempest::sema::transform::TempMapTypeVars;
 
@@ -17,6 +20,17 @@ namespace tempest::sema::infer {
         t->kind == Type::Kind::ENUM;
   }
 
+  /** Union of the leftover members of a union unification. Bindings outlive this call (they
+      end up in constraint solutions and in the relation cache), so the union is interned by
+      the compilation unit's type store when there is one. */
+  const Type* leftoverUnion(
+      const TypeArray& members, tempest::support::BumpPtrAllocator& alloc) {
+    if (CompilationUnit::theCU) {
+      return CompilationUnit::theCU->types().createUnionType(members);
+    }
+    return new (alloc) UnionType(alloc.copyOf(members));
+  }
+
   /** Separate a union into inferred and non-inferred members. A union can have at most a single
       inferred member in order for unification to be successful. */
   bool separateInferredMembers(
@@ -83,28 +97,52 @@ namespace tempest::sema::infer {
         predicate == TypeRelation::SUBTYPE) {
       // In order for a union to be assignable to X, all members of the union
       // must be able to unify with X.
-      std::vector<UnificationResult> memberResult;
+      auto mark = result.size();
       for (auto member : members) {
-        if (!unify(memberResult, member, ltEnv, rt, rtEnv, when, predicate, alloc)) {
-          // Don't keep member result if failed
+        if (!unify(result, member, ltEnv, rt, rtEnv, when, predicate, alloc)) {
+          // Don't keep member results if failed
+          result.erase(result.begin() + mark, result.end());
           return false;
         }
       }
-
-      // Do keep member result if succeeded.
-      result.insert(result.end(), memberResult.begin(), memberResult.end());
       return true;
     } else {
       assert(false && "Bad binding predicate");
     }
   }
 
+  static RelationCache::Relation unifyRelation(TypeRelation predicate) {
+    switch (predicate) {
+      case TypeRelation::EQUAL: return RelationCache::Relation::UNIFY_EQUAL;
+      case TypeRelation::SUBTYPE: return RelationCache::Relation::UNIFY_SUBTYPE;
+      case TypeRelation::SUPERTYPE: return RelationCache::Relation::UNIFY_SUPERTYPE;
+      case TypeRelation::ASSIGNABLE_FROM: return RelationCache::Relation::UNIFY_ASSIGNABLE_FROM;
+      case TypeRelation::ASSIGNABLE_TO: return RelationCache::Relation::UNIFY_ASSIGNABLE_TO;
+    }
+  }
+
   bool unify(
     std::vector<UnificationResult>& result, const Type* lt, const Type* rt, Conditions& when,
     TypeRelation predicate, tempest::support::BumpPtrAllocator& alloc)
   {
     Env ltEnv;
     Env rtEnv;
+
+    // If neither side contains an inferred type, then unification can't bind anything, and
+    // the outcome depends only on the two types and the predicate.
+    auto cache = RelationCache::current();
+    if (cache && RelationCache::isCacheable(lt) && RelationCache::isCacheable(rt)) {
+      auto rel = unifyRelation(predicate);
+      ConversionResult cached;
+      if (cache->lookup(rel, lt, rt, cached)) {
+        return cached.rank != ConversionRank::ERROR;
+      }
+      auto success = unify(result, lt, ltEnv, rt, rtEnv, when, predicate, alloc);
+      cache->insert(rel, lt, rt,
+          ConversionResult(success ? ConversionRank::IDENTICAL : ConversionRank::ERROR));
+      return success;
+    }
+
     return unify(result, lt, ltEnv, rt, rtEnv, when, predicate, alloc);
   }
 
@@ -314,14 +352,19 @@ namespace tempest::sema::infer {
 
         // Now find all the types which are common to both, unification-wise.
         // This algorithm assumes that each side has at most one matching entry on the
-        // other side. We really ought to discard all matching entries.
-        std::vector<UnificationResult> memberResult;
+        // other side. We really ought to discard all matching entries. Member results are
+        // appended directly to 'result', and discarded on failure.
+        auto mark = result.size();
+        auto fail = [&result, mark]() {
+          result.erase(result.begin() + mark, result.end());
+          return false;
+        };
         for (auto lit = ltMembers.begin(); lit != ltMembers.end(); ) {
           auto ltMember = *lit;
           auto rit = std::find_if(rtMembers.begin(), rtMembers.end(),
-              [&memberResult, ltMember, &ltEnv, &rtEnv, &when, predicate, &alloc]
+              [&result, ltMember, &ltEnv, &rtEnv, &when, predicate, &alloc]
               (const Type* rtMember) {
-                return unify(memberResult, ltMember, ltEnv,
+                return unify(result, ltMember, ltEnv,
                     rtMember, rtEnv, when, predicate, alloc);
               });
 
@@ -338,13 +381,12 @@ namespace tempest::sema::infer {
           // Leftover entries, but no variable to bind them to
           if (rtInferred) {
             if (ltMembers.size() == 1) {
-              memberResult.push_back({
+              result.push_back({
                   rtInferred, ltMembers[0],
                   inverseRelation(predicate), when });
             } else {
-              auto tempUnion = new (alloc) UnionType(alloc.copyOf(ltMembers));
-              memberResult.push_back({
-                  rtInferred, tempUnion,
+              result.push_back({
+                  rtInferred, leftoverUnion(ltMembers, alloc),
                   inverseRelation(predicate), when });
             }
             ltMembers.clear();
@@ -354,16 +396,15 @@ namespace tempest::sema::infer {
             predicate == TypeRelation::ASSIGNABLE_FROM ||
             predicate == TypeRelation::SUPERTYPE)) {
           // Right hand inferred type member is unknown
-          return false;
+          return fail();
         }
 
         if (!rtMembers.empty()) {
           if (ltInferred) {
             if (rtMembers.size() == 1) {
-              memberResult.push_back({ ltInferred, rtMembers[0], predicate, when });
+              result.push_back({ ltInferred, rtMembers[0], predicate, when });
             } else {
-              auto tempUnion = new (alloc) UnionType(alloc.copyOf(rtMembers));
-              memberResult.push_back({ ltInferred, tempUnion, predicate, when });
+              result.push_back({ ltInferred, leftoverUnion(rtMembers, alloc), predicate, when });
             }
             rtMembers.clear();
           }
@@ -372,7 +413,7 @@ namespace tempest::sema::infer {
             predicate == TypeRelation::ASSIGNABLE_TO ||
             predicate == TypeRelation::SUBTYPE)) {
           // Left hand inferred type member is unknown
-          return false;
+          return fail();
         }
 
         // If there's anything remaining on the left side:
@@ -380,7 +421,7 @@ namespace tempest::sema::infer {
             predicate == TypeRelation::ASSIGNABLE_TO ||
             predicate == TypeRelation::SUBTYPE ||
             predicate == TypeRelation::EQUAL)) {
-          return false;
+          return fail();
         }
 
         // If there's anything remaining on the right side:
@@ -388,10 +429,9 @@ namespace tempest::sema::infer {
             predicate == TypeRelation::ASSIGNABLE_FROM ||
             predicate == TypeRelation::SUPERTYPE ||
             predicate == TypeRelation::EQUAL)) {
-          return false;
+          return fail();
         }
 
-        result.insert(result.end(), memberResult.begin(), memberResult.end());
         return true;
       }
 
@@ -418,22 +458,20 @@ namespace tempest::sema::infer {
         auto ltTuple = static_cast<const TupleType*>(lt);
         auto rtTuple = static_cast<const TupleType*>(rt);
         if (ltTuple->members.size() == rtTuple->members.size()) {
-          std::vector<UnificationResult> memberResult;
+          auto mark = result.size();
           auto memberPredicate = predicate;
           if (memberPredicate == TypeRelation::SUBTYPE ||
               memberPredicate == TypeRelation::SUPERTYPE) {
             memberPredicate = TypeRelation::EQUAL;
           }
           for (size_t i = 0; i < ltTuple->members.size(); i += 1) {
-            if (!unify(memberResult,
+            if (!unify(result,
                 ltTuple->members[i], ltEnv,
                 rtTuple->members[i], rtEnv, when, memberPredicate, alloc)) {
+              result.erase(result.begin() + mark, result.end());
               return false;
             }
           }
-
-          // Add member results to overall results and succeed
-          result.insert(result.end(), memberResult.begin(), memberResult.end());
           return true;
         }
       }
@@ -452,17 +490,15 @@ namespace tempest::sema::infer {
       if (lt == rt) {
         auto udt = static_cast<const UserDefinedType*>(lt);
         auto td = udt->defn();
-        std::vector<UnificationResult> paramResult;
+        auto mark = result.size();
         for (auto param : td->allTypeParams()) {
-          if (!unify(paramResult,
+          if (!unify(result,
               param->typeVar(), ltEnv,
               param->typeVar(), rtEnv, when, TypeRelation::EQUAL, alloc)) {
+            result.erase(result.begin() + mark, result.end());
             return false;
           }
         }
-
-        // Add param results to overall results and succeed
-        result.insert(result.end(), paramResult.begin(), paramResult.end());
         return true;
       }
 
@@ -19,7 +19,7 @@ namespace tempest::sema::graph {
 }
 
 namespace tempest::sema::infer {
-  using tempest::sema::convert::Env;
+  using tempest::sema::graph::Env;
   using tempest::sema::graph::Type;
   using tempest::sema::graph::TypeParameter;
 
@@ -49,8 +49,11 @@ namespace tempest::sema::infer {
   };
 
   /** Unification algorithm.
-      Guarantee: `result` will be empty if unification fails. This is very important because
-      unify calls itself recursively and builds up the result upon successful unifications. */
+      Results are appended to `result`, which callers can reuse between calls to avoid
+      reallocating it. Guarantee: `result` will be left unchanged if unification fails. This is
+      very important because unify calls itself recursively and builds up the result upon
+      successful unifications. Unifications of types that contain no inferred types are
+      memoized in the relation cache. */
   bool unify(
     std::vector<UnificationResult>& result, const Type* lt, const Type* rt, Conditions& when,
     TypeRelation predicate, tempest::support::BumpPtrAllocator& alloc);
@@ -383,6 +383,7 @@ namespace tempest::sema::pass {
         break;
       }
 
+      case Expr::Kind::NOT:
       case Expr::Kind::NEGATE:
       case Expr::Kind::COMPLEMENT:
       case Expr::Kind::CAST_SIGN_EXTEND:
@@ -390,12 +391,18 @@ namespace tempest::sema::pass {
       case Expr::Kind::CAST_INT_TRUNCATE:
       case Expr::Kind::CAST_FP_EXTEND:
       case Expr::Kind::CAST_FP_TRUNC:
-      case Expr::Kind::CAST_CREATE_UNION: {
+      case Expr::Kind::CAST_CREATE_UNION:
+      case Expr::Kind::CAST_CREATE_INTERFACE: {
         auto op = static_cast<UnaryOp*>(e);
         visitExpr(op->arg, flow);
         break;
       }
 
+      case Expr::Kind::IS_TYPE:
+      case Expr::Kind::AS_TYPE:
+        visitExpr(static_cast<TypeTestOp*>(e)->arg, flow);
+        break;
+
       case Expr::Kind::ASSIGN: {
         auto op = static_cast<BinaryOp*>(e);
         visitExpr(op->args[1], flow);
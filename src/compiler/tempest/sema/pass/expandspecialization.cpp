@@ -6,9 +6,13 @@
 #include "tempest/sema/graph/expr_op.hpp"
 #include "tempest/sema/pass/expandspecialization.hpp"
 #include "tempest/sema/transform/mapenv.hpp"
+#include "tempest/sema/transform/typedependence.hpp"
 #include "tempest/sema/transform/visitor.hpp"
 #include "llvm/Support/Casting.h"
 #include <assert.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 
 namespace tempest::sema::pass {
   using llvm::StringRef;
@@ -17,6 +21,9 @@ namespace tempest::sema::pass {
   using namespace tempest::gen;
   using tempest::sema::transform::MapEnvTransform;
 
+  /** Allocator for the worker thread running on this thread, if any. */
+  static thread_local tempest::support::BumpPtrAllocator* workerAlloc = nullptr;
+
   bool isDirectlyCallable(FunctionDefn* fd) {
     if (fd->intrinsic() != IntrinsicFn::NONE) {
       return false;
@@ -53,18 +60,33 @@ namespace tempest::sema::pass {
   /** Replace all reference to type variables with the bound values in an environment. */
   class SpecializationExprTransform final : public transform::ExprTransform {
   public:
-    SpecializationExprTransform(CompilationUnit& cu, Env& env)
-      : transform::ExprTransform(cu.types().alloc())
+    SpecializationExprTransform(
+        CompilationUnit& cu, Env& env, SharedExpansions& shared, const ClassHierarchy& classes)
+      : transform::ExprTransform(workerAlloc ? *workerAlloc : cu.types().alloc())
       , _cu(cu)
       , _env(env)
+      , _shared(shared)
+      , _classes(classes)
       , _typeTransform(cu, env)
     {}
 
+    /** Number of nodes expanded by this transform, not counting shared ones. */
+    size_t numNodes() const { return _numNodes; }
+
     Expr* transform(Expr* e) override {
       if (e == nullptr) {
         return e;
       }
 
+      // Type-invariant parts of a generic body are only expanded once. (A function that isn't
+      // generic is only expanded once anyway.)
+      if (!_inShared &&
+          !_env.args.empty() &&
+          e->typeDependence == Expr::TypeDependence::INVARIANT) {
+        return expandShared(e);
+      }
+      _numNodes += 1;
+
       switch (e->kind) {
         case Expr::Kind::FUNCTION_REF:
         case Expr::Kind::TYPE_REF: {
@@ -93,7 +115,10 @@ namespace tempest::sema::pass {
             if (isDirectlyCallable(fd)) {
               auto sym = _cu.symbols().addFunction(fd, typeArgs);
               assert(sym->kind == OutputSym::Kind::FUNCTION);
-              return new (_cu.types().alloc()) SymbolRefExpr(
+              return new (alloc()) SymbolRefExpr(
+                  Expr::Kind::GLOBAL_REF, dref->location, sym, type, stem);
+            } else if (auto sym = devirtualize(fd, typeArgs, stem)) {
+              return new (alloc()) SymbolRefExpr(
                   Expr::Kind::GLOBAL_REF, dref->location, sym, type, stem);
             } else {
               // It's a virtual method call or an intrinsic.
@@ -150,16 +175,43 @@ namespace tempest::sema::pass {
         }
 
         case Expr::Kind::ALLOC_OBJ: {
-          auto sref = static_cast<SymbolRefExpr*>(e);
+          // Make a new node rather than setting the symbol on the original, which is shared
+          // by every specialization.
+          ClassDescriptorSym* cls;
           if (auto sp = dyn_cast<SpecializedType>(e->type)) {
             MapEnvTransform transform(_cu.types(), _cu.spec(), _env.params, _env.args);
             auto typeArgs = transform.transformArray(sp->spec->typeArgs());
-            sref->sym = _cu.symbols().addClass(cast<TypeDefn>(sp->spec->generic()), typeArgs);
-            return transform::ExprTransform::transform(e);
+            cls = _cu.symbols().addClass(cast<TypeDefn>(sp->spec->generic()), typeArgs);
+          } else {
+            auto udt = cast<UserDefinedType>(e->type);
+            cls = _cu.symbols().addClass(udt->defn(), _env.args);
           }
-          auto udt = cast<UserDefinedType>(e->type);
-          sref->sym = _cu.symbols().addClass(udt->defn(), _env.args);
-          return transform::ExprTransform::transform(e);
+          return new (alloc()) SymbolRefExpr(e->kind, e->location, cls, transformType(e->type));
+        }
+
+        case Expr::Kind::IS_TYPE:
+        case Expr::Kind::AS_TYPE: {
+          auto op = static_cast<TypeTestOp*>(e);
+          auto result = new (alloc()) TypeTestOp(
+              e->kind, e->location, transform(op->arg), op->testType, transformType(e->type));
+          ArrayRef<const Type*> typeArgs;
+          auto td = typeDefnOf(op->testType, typeArgs);
+          result->cls = _cu.symbols().addClass(td, typeArgs);
+          return result;
+        }
+
+        case Expr::Kind::CAST_CREATE_INTERFACE: {
+          auto op = static_cast<InterfaceCastOp*>(e);
+          auto result = new (alloc()) InterfaceCastOp(
+              e->location, transform(op->arg), transformType(e->type));
+          ArrayRef<const Type*> clsTypeArgs;
+          ArrayRef<const Type*> ifaceTypeArgs;
+          auto clsDefn = typeDefnOf(result->arg->type, clsTypeArgs);
+          auto ifaceDefn = typeDefnOf(result->type, ifaceTypeArgs);
+          result->trans = _cu.symbols().addClassInterfaceTranslation(
+              _cu.symbols().addClass(clsDefn, clsTypeArgs),
+              _cu.symbols().addInterface(ifaceDefn, ifaceTypeArgs));
+          return result;
         }
 
         default:
@@ -178,11 +230,103 @@ namespace tempest::sema::pass {
     // }
 
   private:
-    tempest::support::BumpPtrAllocator& alloc() { return _cu.types().alloc(); }
+    tempest::support::BumpPtrAllocator& alloc() {
+      return workerAlloc ? *workerAlloc : _cu.types().alloc();
+    }
+
+    /** If the class hierarchy shows that a method call can only run one method, return the
+        symbol for that method. */
+    FunctionSym* devirtualize(FunctionDefn* fd, ArrayRef<const Type*> typeArgs, Expr* stem) {
+      if (fd->intrinsic() != IntrinsicFn::NONE ||
+          typeArgs.size() != fd->allTypeParams().size()) {
+        return nullptr;
+      }
+
+      // Use the type of the receiver if we know it, otherwise the class defining the method.
+      auto cls = stem ? classOf(stem->type) : nullptr;
+      if (!cls) {
+        cls = dyn_cast_or_null<TypeDefn>(fd->definedIn());
+        if (!cls) {
+          return nullptr;
+        }
+      }
+
+      SmallVector<MethodTableEntry, 1> targets;
+      if (!_classes.findTargets(cls, fd, targets, 1) || targets.empty()) {
+        return nullptr;
+      }
+      auto target = targets[0].method;
+      if (target->intrinsic() != IntrinsicFn::NONE || !target->body()) {
+        return nullptr;
+      } else if (target == fd) {
+        return _cu.symbols().addFunction(fd, typeArgs);
+      } else if (target->allTypeParams().empty()) {
+        // An override in a subclass; its type arguments would come from the subclass, so
+        // only non-generic overrides can be called directly.
+        return _cu.symbols().addFunction(target, {});
+      }
+      return nullptr;
+    }
+
+    /** Return the definition and type arguments of an expanded class or interface type. */
+    TypeDefn* typeDefnOf(const Type* type, ArrayRef<const Type*>& typeArgs) {
+      type = unqualified(type);
+      if (auto st = dyn_cast<SpecializedType>(type)) {
+        typeArgs = st->spec->typeArgs();
+        return cast<TypeDefn>(st->spec->generic());
+      }
+      // A bare reference to a generic type names the enclosing specialization.
+      auto td = cast<UserDefinedType>(type)->defn();
+      if (!td->allTypeParams().empty()) {
+        typeArgs = _env.args;
+      }
+      return td;
+    }
+
+    static TypeDefn* classOf(const Type* type) {
+      if (auto mt = dyn_cast_or_null<ModifiedType>(type)) {
+        type = mt->base;
+      }
+      if (auto st = dyn_cast_or_null<SpecializedType>(type)) {
+        return dyn_cast<TypeDefn>(st->spec->generic());
+      } else if (auto udt = dyn_cast_or_null<UserDefinedType>(type)) {
+        return udt->kind == Type::Kind::CLASS ? udt->defn() : nullptr;
+      }
+      return nullptr;
+    }
+
+    Expr* expandShared(Expr* e) {
+      if (auto entry = _shared.find(e)) {
+        _shared.addShared(entry->numNodes);
+        if (auto log = SymbolStore::log()) {
+          log->insert(log->end(), entry->symbols.begin(), entry->symbols.end());
+        }
+        return entry->expr;
+      }
+
+      // Keep track of the symbols the expansion refers to, so that later users of the
+      // shared expansion can report the same references.
+      auto outerLog = SymbolStore::log();
+      std::vector<OutputSym*> symbols;
+      SymbolStore::setLog(&symbols);
+      size_t startNodes = _numNodes;
+      _inShared = true;
+      auto result = transform(e);
+      _inShared = false;
+      SymbolStore::setLog(outerLog);
+      if (outerLog) {
+        outerLog->insert(outerLog->end(), symbols.begin(), symbols.end());
+      }
+      return _shared.insert(e, { result, std::move(symbols), _numNodes - startNodes })->expr;
+    }
 
     CompilationUnit& _cu;
     Env& _env;
+    SharedExpansions& _shared;
+    const ClassHierarchy& _classes;
     SpecializeTypeTransform _typeTransform;
+    size_t _numNodes = 0;
+    bool _inShared = false;
   };
 
   void ExpandSpecializationPass::run() {
@@ -192,21 +336,95 @@ namespace tempest::sema::pass {
     while (_importSourcesProcessed < _cu.importSourceModules().size()) {
       process(_cu.importSourceModules()[_importSourcesProcessed++]);
     }
+    if (_numThreads > 1) {
+      runParallel();
+    }
     while (_symbolsProcessed < _cu.symbols().list().size()) {
-      auto sym = _cu.symbols().list()[_symbolsProcessed++];
-      if (auto fsym = dyn_cast<FunctionSym>(sym)) {
-        visitFunctionSym(fsym);
-      } else if (auto csym = dyn_cast<ClassDescriptorSym>(sym)) {
-        visitClassDescriptorSym(csym);
-      } else if (auto isym = dyn_cast<InterfaceDescriptorSym>(sym)) {
-        visitInterfaceDescriptorSym(isym);
-      } else if (auto vsym = dyn_cast<GlobalVarSym>(sym)) {
-        visitGlobalVarSym(vsym);
+      visitSymbol(_cu.symbols().list()[_symbolsProcessed++]);
+    }
+
+    // Now that all classes are known, number them for subclass tests.
+    _cu.symbols().assignClassIds();
+
+    // With every body expanded, find the allocations that can go on the stack.
+    _escapes.run(_cu.symbols().list());
+  }
+
+  void ExpandSpecializationPass::runParallel() {
+    auto& symbols = _cu.symbols();
+    std::vector<tempest::support::BumpPtrAllocator*> arenas;
+    for (unsigned i = 0; i < _numThreads; ++i) {
+      arenas.push_back(&_cu.createArena());
+    }
+
+    while (_symbolsProcessed < symbols.list().size()) {
+      // Each symbol in the round gets its own log of referenced symbols, so that the new
+      // symbols can be ordered by which symbol referenced them first.
+      size_t begin = _symbolsProcessed;
+      size_t end = symbols.list().size();
+      std::vector<std::vector<OutputSym*>> logs(end - begin);
+      std::atomic<size_t> next = begin;
+      auto worker = [&](tempest::support::BumpPtrAllocator* alloc) {
+        CompilationUnit::theCU = &_cu;
+        workerAlloc = alloc;
+        for (;;) {
+          size_t index = next++;
+          if (index >= end) {
+            break;
+          }
+          SymbolStore::setLog(&logs[index - begin]);
+          visitSymbol(symbols.list()[index]);
+        }
+        SymbolStore::setLog(nullptr);
+        workerAlloc = nullptr;
+        CompilationUnit::theCU = nullptr;
+      };
+
+      symbols.beginRound();
+      std::vector<std::thread> threads;
+      size_t numWorkers = std::min<size_t>(_numThreads, end - begin);
+      for (size_t i = 0; i < numWorkers; ++i) {
+        threads.emplace_back(worker, arenas[i]);
+      }
+      for (auto& th : threads) {
+        th.join();
+      }
+      symbols.endRound(logs);
+      _symbolsProcessed = end;
+    }
+  }
+
+  void ExpandSpecializationPass::visitSymbol(OutputSym* sym) {
+    if (auto fsym = dyn_cast<FunctionSym>(sym)) {
+      visitFunctionSym(fsym);
+    } else if (auto csym = dyn_cast<ClassDescriptorSym>(sym)) {
+      visitClassDescriptorSym(csym);
+    } else if (auto isym = dyn_cast<InterfaceDescriptorSym>(sym)) {
+      visitInterfaceDescriptorSym(isym);
+    } else if (auto tsym = dyn_cast<ClassInterfaceTranslationSym>(sym)) {
+      visitClassInterfaceTranslationSym(tsym);
+    } else if (auto vsym = dyn_cast<GlobalVarSym>(sym)) {
+      visitGlobalVarSym(vsym);
+    }
+  }
+
+  void ExpandSpecializationPass::markBodies(DefnArray members) {
+    for (auto defn : members) {
+      if (auto fd = dyn_cast<FunctionDefn>(defn)) {
+        if (fd->body()) {
+          transform::markTypeDependence(fd->body());
+        }
+      } else if (auto td = dyn_cast<TypeDefn>(defn)) {
+        markBodies(td->members());
       }
     }
   }
 
   void ExpandSpecializationPass::process(Module* mod) {
+    // Find out which parts of function bodies can be shared between specializations.
+    markBodies(mod->members());
+    _classes.addModule(mod);
+
     // Add all top-level members as output symbols.
     for (auto d : mod->members()) {
       switch (d->kind) {
@@ -267,6 +485,7 @@ namespace tempest::sema::pass {
 
   void ExpandSpecializationPass::visitClassDescriptorSym(ClassDescriptorSym* csym) {
     auto td = csym->typeDefn;
+    auto& alloc = workerAlloc ? *workerAlloc : _cu.spec().alloc();
     MapEnvTransform transform(_cu.types(), _cu.spec(), td->allTypeParams(), csym->typeArgs);
 
     // Base class reference
@@ -287,7 +506,7 @@ namespace tempest::sema::pass {
             transform.transformArray(method.typeArgs));
         methodTable.push_back(fsym);
       }
-      csym->methodTable = _cu.spec().alloc().copyOf(methodTable);
+      csym->methodTable = alloc.copyOf(methodTable);
 
       for (auto& member : td->members()) {
         if (auto fd = dyn_cast<FunctionDefn>(member)) {
@@ -308,26 +527,43 @@ namespace tempest::sema::pass {
         if (idef->type()->kind == Type::Kind::INTERFACE) {
           typeArgs = transform.transformArray(typeArgs);
           auto isym = _cu.symbols().addInterface(idef, typeArgs);
-          auto tsym = _cu.symbols().addClassInterfaceTranslation(csym, isym);
-          if (tsym->methodTable.empty()) {
-            assert(i < td->interfaceMethods().size());
-            const auto& ifaceMethods = td->interfaceMethods()[i];
-            SmallVector<FunctionSym*, 16> ifaceMethodSyms;
-            for (auto& method : ifaceMethods) {
-              assert(method.method);
-              auto fsym = _cu.symbols().addFunction(
-                  method.method,
-                  transform.transformArray(method.typeArgs));
-              ifaceMethodSyms.push_back(fsym);
-            }
-            tsym->methodTable = _cu.spec().alloc().copyOf(ifaceMethodSyms);
-          }
-          interfaceTable.push_back(tsym);
+          interfaceTable.push_back(_cu.symbols().addClassInterfaceTranslation(csym, isym));
         }
         // TODO: Include inherited interfaces
       }
-      csym->interfaceTable = _cu.spec().alloc().copyOf(interfaceTable);
+      csym->interfaceTable = alloc.copyOf(interfaceTable);
+    }
+  }
+
+  void ExpandSpecializationPass::visitClassInterfaceTranslationSym(
+      ClassInterfaceTranslationSym* tsym) {
+    auto td = tsym->cls->typeDefn;
+    auto idef = tsym->iface->typeDefn;
+    auto& alloc = workerAlloc ? *workerAlloc : _cu.spec().alloc();
+    MapEnvTransform transform(_cu.types(), _cu.spec(), td->allTypeParams(), tsym->cls->typeArgs);
+
+    // Conformance is looked up with the interface's type arguments as the class declares
+    // them; a class that conforms without declaring the interface uses the concrete ones.
+    ArrayRef<const Type*> declaredTypeArgs = tsym->iface->typeArgs;
+    for (auto interfaceType : td->implements()) {
+      ArrayRef<const Type*> typeArgs;
+      if (unwrapSpecialization(interfaceType, typeArgs) == idef) {
+        declaredTypeArgs = typeArgs;
+        break;
+      }
+    }
+
+    auto conf = _cu.conformance().find(td, {}, idef, declaredTypeArgs);
+    assert(conf && conf->conforms);
+    SmallVector<FunctionSym*, 16> ifaceMethodSyms;
+    for (auto& method : conf->witnesses) {
+      assert(method.method);
+      auto fsym = _cu.symbols().addFunction(
+          method.method,
+          transform.transformArray(method.typeArgs));
+      ifaceMethodSyms.push_back(fsym);
     }
+    tsym->methodTable = alloc.copyOf(ifaceMethodSyms);
   }
 
   void ExpandSpecializationPass::visitInterfaceDescriptorSym(InterfaceDescriptorSym* isym) {
@@ -366,7 +602,9 @@ namespace tempest::sema::pass {
   }
 
   Expr* ExpandSpecializationPass::expandExpr(Expr* expr, Env& env) {
-    SpecializationExprTransform transform(_cu, env);
-    return transform.transform(expr);
+    SpecializationExprTransform transform(_cu, env, _shared, _classes);
+    auto result = transform.transform(expr);
+    _shared.addExpanded(transform.numNodes());
+    return result;
   }
 }
@@ -13,10 +13,25 @@
   #include "tempest/sema/graph/typestore.hpp"
 #endif
 
+#ifndef TEMPEST_SEMA_GRAPH_CLASSHIERARCHY_HPP
+  #include "tempest/sema/graph/classhierarchy.hpp"
+#endif
+
+#ifndef TEMPEST_SEMA_TRANSFORM_ESCAPEANALYSIS_HPP
+  #include "tempest/sema/transform/escapeanalysis.hpp"
+#endif
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
 namespace tempest::gen {
+  class OutputSym;
   class FunctionSym;
   class ClassDescriptorSym;
   class InterfaceDescriptorSym;
+  class ClassInterfaceTranslationSym;
   class GlobalVarSym;
 }
 
@@ -25,21 +40,88 @@ namespace tempest::sema::pass {
   using tempest::sema::graph::Module;
   using namespace tempest::sema::graph;
 
+  /** Expansions of type-invariant subexpressions of generic function bodies. Since such an
+      expansion comes out the same for every specialization, it is done once and shared
+      between them. Safe to use from multiple threads. */
+  class SharedExpansions {
+  public:
+    struct Entry {
+      /** The expanded expression. */
+      Expr* expr;
+
+      /** Output symbols referenced by the expansion, in order. */
+      std::vector<gen::OutputSym*> symbols;
+
+      /** Number of expression nodes in the original subtree. */
+      size_t numNodes;
+    };
+
+    /** Look up the expansion of an expression. */
+    const Entry* find(Expr* e) {
+      std::lock_guard<std::mutex> lock(_mutex);
+      auto it = _entries.find(e);
+      return it != _entries.end() ? &it->second : nullptr;
+    }
+
+    /** Add an expansion. If another thread got there first, returns their entry instead. */
+    const Entry* insert(Expr* e, Entry&& entry) {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return &_entries.emplace(e, std::move(entry)).first->second;
+    }
+
+    /** Number of expression nodes expanded, and number reused from earlier expansions. */
+    size_t expandedNodes() const { return _expandedNodes; }
+    size_t sharedNodes() const { return _sharedNodes; }
+
+    void addExpanded(size_t count) { _expandedNodes += count; }
+    void addShared(size_t count) { _sharedNodes += count; }
+
+  private:
+    std::mutex _mutex;
+    std::unordered_map<Expr*, Entry> _entries;
+    std::atomic<size_t> _expandedNodes = 0;
+    std::atomic<size_t> _sharedNodes = 0;
+  };
+
   /** Helper which can do eager type resolution. */
   class ExpandSpecializationPass {
   public:
-    ExpandSpecializationPass(CompilationUnit& cu) : _cu(cu) {}
+    /** Construct an expansion pass. If 'numThreads' is greater than one, output symbols are
+        expanded concurrently on that many worker threads. */
+    ExpandSpecializationPass(CompilationUnit& cu, unsigned numThreads = 1)
+      : _cu(cu)
+      , _numThreads(numThreads)
+    {}
 
     void run();
 
+    /** Expand all pending output symbols on worker threads. Symbols are expanded in rounds:
+        each round takes every symbol not yet expanded, and any symbols they reference are
+        added to the list at the end of the round in the same order that a serial run
+        would have added them. */
+    void runParallel();
+
     /** Process a single module. */
     void process(Module* mod);
 
+    /** Statistics on how much of the specialized function bodies were shared. */
+    const SharedExpansions& shared() const { return _shared; }
+
+    /** Hierarchy of all classes in the processed modules, used to turn method calls that
+        can only have one target into direct calls. */
+    const ClassHierarchy& classes() const { return _classes; }
+
+    /** Escape analysis of the expanded function bodies, which marks the object allocations
+        that can be placed on the stack. */
+    const transform::EscapeAnalysis& escapes() const { return _escapes; }
+
     // Output symbols
 
+    void visitSymbol(gen::OutputSym* sym);
     void visitFunctionSym(gen::FunctionSym* fsym);
     void visitClassDescriptorSym(gen::ClassDescriptorSym* cls);
     void visitInterfaceDescriptorSym(gen::InterfaceDescriptorSym* ifc);
+    void visitClassInterfaceTranslationSym(gen::ClassInterfaceTranslationSym* tsym);
     void visitGlobalVarSym(gen::GlobalVarSym* gvar);
 
     // Defns
@@ -63,11 +145,16 @@ namespace tempest::sema::pass {
 
   protected:
     CompilationUnit& _cu;
+    unsigned _numThreads;
     size_t _sourcesProcessed = 0;
     size_t _importSourcesProcessed = 0;
     size_t _symbolsProcessed = 0;
     Module* _module = nullptr;
+    SharedExpansions _shared;
+    ClassHierarchy _classes;
+    transform::EscapeAnalysis _escapes;
 
+    void markBodies(DefnArray members);
     void addSpecialization(SpecializedDefn* sp);
   };
 }
@@ -141,6 +141,21 @@ namespace tempest::sema::pass {
     visitMembers(td->members(), td);
     appendNewMethods(td);
     td->setOverridesFound(true);
+
+    // Record the interface tables so that codegen doesn't need to recompute them.
+    if (td->type()->kind == Type::Kind::CLASS || td->type()->kind == Type::Kind::STRUCT) {
+      for (size_t i = 0; i < td->implements().size(); i += 1) {
+        ArrayRef<const Type*> baseTypeArgs;
+        auto baseDefn = cast<TypeDefn>(unwrapSpecialization(td->implements()[i], baseTypeArgs));
+        convert::Conformance conf;
+        conf.conforms = true;
+        for (auto& entry : baseDefn->methods()) {
+          conf.requirements.push_back(entry.method);
+        }
+        conf.witnesses = td->interfaceMethods()[i];
+        _cu.conformance().insert(td, {}, baseDefn, baseTypeArgs, std::move(conf));
+      }
+    }
   }
 
   void FindOverridesPass::visitMembers(const DefnList& members, TypeDefn* td) {
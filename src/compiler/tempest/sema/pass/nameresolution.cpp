@@ -894,9 +894,26 @@ namespace tempest::sema::pass {
       // LOGICAL_AND,
       // LOGICAL_OR,
       // RANGE,
-      // AS_TYPE,
-      // IS,
-      // IS_NOT,
+
+      case ast::Node::Kind::AS_TYPE: {
+        auto op = static_cast<const ast::Oper*>(node);
+        auto arg = visitExpr(scope, op->operands[0]);
+        auto type = resolveType(scope, op->operands[1]);
+        return new (*_alloc) TypeTestOp(Expr::Kind::AS_TYPE, node->location, arg, type);
+      }
+
+      case ast::Node::Kind::IS:
+      case ast::Node::Kind::IS_NOT: {
+        auto op = static_cast<const ast::Oper*>(node);
+        auto arg = visitExpr(scope, op->operands[0]);
+        auto type = resolveType(scope, op->operands[1]);
+        Expr* result = new (*_alloc) TypeTestOp(Expr::Kind::IS_TYPE, node->location, arg, type);
+        if (node->kind == ast::Node::Kind::IS_NOT) {
+          result = new (*_alloc) UnaryOp(Expr::Kind::NOT, node->location, result);
+        }
+        return result;
+      }
+
       // IN,
       // NOT_IN,
       // RETURNS,
@@ -12,6 +12,7 @@
 #include "tempest/sema/infer/conditions.hpp"
 #include "tempest/sema/infer/constraintsolver.hpp"
 #include "tempest/sema/infer/overload.hpp"
+#include "tempest/sema/infer/overloadindex.hpp"
 #include "tempest/sema/infer/paramassignments.hpp"
 #include "tempest/sema/infer/solution.hpp"
 #include "tempest/sema/infer/types.hpp"
@@ -25,6 +26,11 @@
 #include "tempest/sema/transform/visitor.hpp"
 #include "llvm/Support/Casting.h"
 #include <assert.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 namespace tempest::sema::pass {
   using llvm::StringRef;
@@ -38,16 +44,111 @@ namespace tempest::sema::pass {
   using tempest::sema::infer::ContingentType;
   using tempest::sema::infer::InferredType;
   using tempest::sema::infer::OverloadCandidate;
+  using tempest::sema::infer::OverloadIndex;
   using tempest::sema::infer::OverloadKind;
   using tempest::sema::infer::ParameterAssignmentsBuilder;
   using tempest::sema::infer::ParamError;
+  using tempest::sema::infer::Rejection;
   using tempest::sema::infer::SolutionTransform;
   using tempest::sema::infer::TypeRelation;
   using tempest::sema::transform::MapEnvTransform;
 
+  /** Ensures that each definition is resolved exactly once, even when several threads
+      request it at the same time. A thread that wants a definition which is being resolved
+      by another thread waits for it; if that would deadlock (because the other thread is
+      directly or indirectly waiting on this one) then the definition depends on itself. */
+  class ResolutionGate {
+  public:
+    enum Claim {
+      RESOLVED,     // Already resolved, nothing to do.
+      CLAIMED,      // Caller is now responsible for resolving the definition.
+      CYCLE,        // Definition depends on itself.
+    };
+
+    Claim claim(Defn* d) {
+      std::unique_lock<std::mutex> lock(_mutex);
+      auto self = std::this_thread::get_id();
+      for (;;) {
+        if (d->isResolved()) {
+          return RESOLVED;
+        }
+        if (!d->isResolving()) {
+          d->setResolving(true);
+          _owners[d] = self;
+          return CLAIMED;
+        }
+        if (isWaitingOn(self, d)) {
+          return CYCLE;
+        }
+        _waitingFor[self] = d;
+        _resolved.wait(lock);
+        _waitingFor.erase(self);
+      }
+    }
+
+    void release(Defn* d) {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        d->setResolving(false);
+        d->setResolved(true);
+        _owners.erase(d);
+      }
+      _resolved.notify_all();
+    }
+
+    static ResolutionGate& get() {
+      static ResolutionGate gate;
+      return gate;
+    }
+
+  private:
+    std::mutex _mutex;
+    std::condition_variable _resolved;
+    std::unordered_map<Defn*, std::thread::id> _owners;
+    std::unordered_map<std::thread::id, Defn*> _waitingFor;
+
+    /** True if the owner of 'd' is 'thread', or is waiting (transitively) on 'thread'. */
+    bool isWaitingOn(std::thread::id thread, Defn* d) {
+      for (;;) {
+        auto owner = _owners.find(d);
+        if (owner == _owners.end()) {
+          return false;
+        }
+        if (owner->second == thread) {
+          return true;
+        }
+        auto waiting = _waitingFor.find(owner->second);
+        if (waiting == _waitingFor.end()) {
+          return false;
+        }
+        d = waiting->second;
+      }
+    }
+  };
+
+  /** Allocator for the worker thread running on this thread, if any. */
+  static thread_local tempest::support::BumpPtrAllocator* workerAlloc = nullptr;
+
+  /** Find all functions with bodies, including methods of types. */
+  static void collectFunctions(DefnArray members, std::vector<FunctionDefn*>& out) {
+    for (auto defn : members) {
+      if (auto fd = dyn_cast<FunctionDefn>(defn)) {
+        if (fd->body()) {
+          out.push_back(fd);
+        }
+      } else if (auto td = dyn_cast<TypeDefn>(defn)) {
+        collectFunctions(td->members(), out);
+      }
+    }
+  }
+
   // Processing
 
   void ResolveTypesPass::run() {
+    if (_numThreads > 1) {
+      runParallel();
+    }
+    // Anything not already resolved by the workers (which is everything in the serial case).
     while (_sourcesProcessed < _cu.sourceModules().size()) {
       process(_cu.sourceModules()[_sourcesProcessed++]);
     }
@@ -56,6 +157,45 @@ namespace tempest::sema::pass {
     }
   }
 
+  void ResolveTypesPass::runParallel() {
+    std::vector<FunctionDefn*> functions;
+    for (auto mod : _cu.sourceModules()) {
+      collectFunctions(mod->members(), functions);
+    }
+    for (auto mod : _cu.importSourceModules()) {
+      collectFunctions(mod->members(), functions);
+    }
+
+    // Make sure lazily-constructed singletons exist before the workers start.
+    intrinsic::IntrinsicDefns::get();
+
+    // Worker threads claim functions from the list in order. Anything a function depends on
+    // (signatures, variable types, other functions) is resolved on demand by the claiming
+    // thread, or waited for if some other thread got there first.
+    std::atomic<size_t> next = 0;
+    auto worker = [&](tempest::support::BumpPtrAllocator* alloc) {
+      CompilationUnit::theCU = &_cu;
+      workerAlloc = alloc;
+      for (;;) {
+        size_t index = next++;
+        if (index >= functions.size()) {
+          break;
+        }
+        resolve(functions[index]);
+      }
+      workerAlloc = nullptr;
+      CompilationUnit::theCU = nullptr;
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < _numThreads; ++i) {
+      threads.emplace_back(worker, &_cu.createArena());
+    }
+    for (auto& th : threads) {
+      th.join();
+    }
+  }
+
   void ResolveTypesPass::process(Module* mod) {
     begin(mod);
     ModuleScope scope(nullptr, mod);
@@ -65,31 +205,54 @@ namespace tempest::sema::pass {
 
   void ResolveTypesPass::begin(Module* mod) {
     _module = mod;
-    _alloc = &mod->semaAlloc();
+    _alloc = workerAlloc ? workerAlloc : &mod->semaAlloc();
   }
 
   // Definitions
 
   bool ResolveTypesPass::resolve(Defn* defn) {
-    if (defn->isResolved()) {
-      return true;
-    }
-    if (defn->isResolving()) {
-      diag.error(defn) << "Unable to deduce type signature for " << defn->name();
-      return false;
+    auto& gate = ResolutionGate::get();
+    switch (gate.claim(defn)) {
+      case ResolutionGate::RESOLVED:
+        return true;
+      case ResolutionGate::CYCLE:
+        diag.error(defn) << "Unable to deduce type signature for " << defn->name();
+        return false;
+      case ResolutionGate::CLAIMED:
+        break;
     }
+
     assert(CompilationUnit::theCU);
     ResolveTypesPass rt(*CompilationUnit::theCU);
+
+    // Reconstruct the scopes which enclose the definition.
+    SmallVector<TypeDefn*, 4> enclosingTypes;
     Module* mod = nullptr;
     for (Member* parent = defn->definedIn(); parent; parent = parent->definedIn()) {
       if (parent->kind == Member::Kind::MODULE) {
         mod = static_cast<Module*>(parent);
         break;
+      } else if (auto td = dyn_cast<TypeDefn>(parent)) {
+        enclosingTypes.push_back(td);
       }
     }
     assert(mod);
     rt.begin(mod);
-    rt.visitDefn(defn);
+
+    std::vector<std::unique_ptr<LookupScope>> scopes;
+    scopes.push_back(std::make_unique<ModuleScope>(nullptr, mod));
+    for (auto it = enclosingTypes.rbegin(); it != enclosingTypes.rend(); ++it) {
+      scopes.push_back(std::make_unique<TypeParamScope>(scopes.back().get(), *it));
+      scopes.push_back(
+          std::make_unique<TypeDefnScope>(scopes.back().get(), *it, rt._cu.spec()));
+    }
+    rt._scope = scopes.back().get();
+    if (!enclosingTypes.empty()) {
+      rt.setSubject(enclosingTypes.front());
+    }
+
+    rt.resolveDefn(defn);
+    gate.release(defn);
     return true;
   }
 
@@ -100,14 +263,21 @@ namespace tempest::sema::pass {
   }
 
   void ResolveTypesPass::visitDefn(Defn* d) {
-    if (d->isResolved()) {
-      return;
-    }
-    if (d->isResolving()) {
-      diag.error(d) << "Unable to deduce type signature for " << d->name();
-      return;
+    auto& gate = ResolutionGate::get();
+    switch (gate.claim(d)) {
+      case ResolutionGate::RESOLVED:
+        return;
+      case ResolutionGate::CYCLE:
+        diag.error(d) << "Unable to deduce type signature for " << d->name();
+        return;
+      case ResolutionGate::CLAIMED:
+        break;
     }
-    d->setResolving(true);
+    resolveDefn(d);
+    gate.release(d);
+  }
+
+  void ResolveTypesPass::resolveDefn(Defn* d) {
     switch (d->kind) {
       case Member::Kind::TYPE: {
         visitTypeDefn(static_cast<TypeDefn*>(d));
@@ -128,8 +298,6 @@ namespace tempest::sema::pass {
         assert(false && "Shouldn't get here, bad member type.");
         break;
     }
-    d->setResolving(false);
-    d->setResolved(true);
   }
 
   void ResolveTypesPass::visitTypeDefn(TypeDefn* td) {
@@ -375,6 +543,24 @@ namespace tempest::sema::pass {
         return &BooleanType::BOOL;
       }
 
+      case Expr::Kind::IS_TYPE:
+      case Expr::Kind::AS_TYPE: {
+        auto op = static_cast<TypeTestOp*>(e);
+        auto argType = assignTypes(op->arg, nullptr);
+        if (Type::isError(argType) || Type::isError(op->testType)) {
+          return &Type::ERROR;
+        }
+        if (unqualifiedAndUnspecialized(argType)->kind != Type::Kind::CLASS ||
+            op->testType->kind != Type::Kind::CLASS) {
+          diag.error(e) << "Type tests are only supported between class types.";
+          return &Type::ERROR;
+        }
+        if (e->kind == Expr::Kind::IS_TYPE) {
+          return &BooleanType::BOOL;
+        }
+        return _cu.types().createUnionType({ op->testType, &VoidType::VOID });
+      }
+
       case Expr::Kind::UNSAFE: {
         auto op = static_cast<UnaryOp*>(e);
         auto prevUnsafeContext = _unsafeContext;
@@ -646,6 +832,57 @@ namespace tempest::sema::pass {
     assert(false && "Implement");
   }
 
+  const Type* ResolveTypesPass::addDirectCall(
+      ApplyFnOp* callExpr,
+      const MemberAndStem& method,
+      const ArrayRef<Expr*>& args,
+      const ArrayRef<const Type*>& argTypes) {
+    if (method.member->kind != Member::Kind::FUNCTION) {
+      return nullptr;
+    }
+    auto function = static_cast<FunctionDefn*>(method.member);
+    if (!function->allTypeParams().empty()) {
+      return nullptr;
+    }
+    if (!function->type()) {
+      if (!resolve(function)) {
+        return &Type::ERROR;
+      }
+    }
+
+    CallCandidate cc(nullptr, 0, function, method.stem);
+    cc.params = function->params();
+    cc.paramTypes = function->type()->paramTypes;
+    cc.isVariadic = function->type()->isVariadic;
+    cc.returnType = function->isConstructor()
+        ? function->selfType() : function->type()->returnType;
+
+    ParameterAssignmentsBuilder builder(cc.paramAssignments, cc.params, cc.isVariadic);
+    for (size_t i = 0; i < args.size() && builder.error() == ParamError::NONE; i += 1) {
+      builder.addPositionalArg();
+    }
+    builder.validate();
+    if (builder.error() != ParamError::NONE) {
+      // Let the solver report the problem.
+      return nullptr;
+    }
+
+    for (size_t i = 0; i < argTypes.size(); i += 1) {
+      auto paramType = cc.paramTypes[cc.paramAssignments[i]];
+      // Warnings are errors to the solver, so it must be the one to report them.
+      if (isAssignable(paramType, argTypes[i]).rank <= ConversionRank::WARNING) {
+        return nullptr;
+      }
+    }
+
+    SolutionTransform st(*_alloc);
+    patchCallee(
+        callExpr, callExpr->location, function, function, method.stem, function->type(),
+        function->type()->returnType, function->selfType());
+    reorderCallingArgs(st, callExpr, args, &cc);
+    return cc.returnType;
+  }
+
   void ResolveTypesPass::findConstructors(
       const ArrayRef<MemberAndStem>& members,
       MemberLookupResultRef& ctors) {
@@ -653,14 +890,58 @@ namespace tempest::sema::pass {
     lookup.lookup("new", members, ctors);
   }
 
+  bool ResolveTypesPass::filterCandidates(
+      const ArrayRef<MemberAndStem>& methodList,
+      const ArrayRef<const Type*>& argTypes,
+      llvm::SmallVectorImpl<size_t>& positions) {
+    if (methodList.size() < OverloadIndex::MIN_MEMBERS) {
+      return false;
+    }
+
+    SmallVector<Member*, 16> members;
+    for (auto& method : methodList) {
+      members.push_back(method.member);
+    }
+    std::unique_ptr<OverloadIndex> temp;
+    auto index = _cu.overloadIndices().get(members, temp);
+    index->findPlausible(argTypes, positions);
+
+    // If nothing is plausible, keep the whole set so that the error message can explain
+    // why each member was rejected.
+    if (positions.empty() || positions.size() == methodList.size()) {
+      positions.clear();
+      return false;
+    }
+    return true;
+  }
+
   const Type* ResolveTypesPass::addCallSite(
       ApplyFnOp* callExpr,
       Expr* fn,
-      const ArrayRef<MemberAndStem>& methodList,
+      const ArrayRef<MemberAndStem>& allMethods,
       const ArrayRef<Expr*>& args,
       const ArrayRef<const Type*>& argTypes,
       ConstraintSolver& cs) {
-    auto site = new CallSite(callExpr->location, callExpr, args, argTypes);
+    ArrayRef<MemberAndStem> methodList = allMethods;
+    SmallVector<size_t, 8> positions;
+    SmallVector<MemberAndStem, 8> plausible;
+    bool filtered = filterCandidates(allMethods, argTypes, positions);
+    if (filtered) {
+      for (auto i : positions) {
+        plausible.push_back(allMethods[i]);
+      }
+      methodList = plausible;
+    }
+
+    // Most calls are to a single non-generic function. If nothing else in the expression is
+    // waiting on the solver, then the arguments are final and can be checked directly.
+    if (methodList.size() == 1 && cs.sites().empty()) {
+      if (auto result = addDirectCall(callExpr, methodList[0], args, argTypes)) {
+        return result;
+      }
+    }
+
+    auto site = new (cs.alloc()) CallSite(callExpr->location, callExpr, args, argTypes);
     cs.addSite(site);
 
     // Record whether the call was generated by an operator, used for tailoring error messages.
@@ -671,9 +952,18 @@ namespace tempest::sema::pass {
     // The return type will depend on which overload type gets chosen.
     SmallVector<ContingentType::Entry, 8> returnTypes;
 
-    // For each possible function that could have been called.
-    for (auto method : methodList) {
-      auto cc = site->addCandidate(method.member, method.stem);
+    // For each possible function that could have been called. Members ruled out by the
+    // overload index are still added, already rejected, so that if no member fits, the
+    // diagnostic explains every one of them.
+    size_t nextPlausible = 0;
+    for (size_t m = 0; m < allMethods.size(); m += 1) {
+      auto method = allMethods[m];
+      bool isPlausible = true;
+      if (filtered) {
+        isPlausible = nextPlausible < positions.size() && positions[nextPlausible] == m;
+        nextPlausible += isPlausible;
+      }
+      auto cc = site->addCandidate(cs.alloc(), method.member, method.stem);
 
       // Collect explicit type arguments
       std::unordered_map<TypeParameter*, const Type*> explicitTypeArgs;
@@ -704,7 +994,7 @@ namespace tempest::sema::pass {
       }
 
       // If it's a generic
-      if (function->allTypeParams().size() > 0) {
+      if (isPlausible && function->allTypeParams().size() > 0) {
         // Make an environment and map the function type through it.
         // Three kinds of type arguments
         // * explicit - type arguments that are explicitly provided by specialization.
@@ -721,7 +1011,7 @@ namespace tempest::sema::pass {
             cc->typeArgs[i] = it->second;
           } else if (!_subject || !_subject->hasTypeParam(typeParam)) {
             // Don't infer params from the enclosing scope.
-            auto inferred = new InferredType(typeParam, &cs);
+            auto inferred = new (cs.alloc()) InferredType(typeParam, &cs);
             cc->typeArgs[i] = inferred;
           } else {
             // Use the param from the enclosing scope literally.
@@ -804,6 +1094,11 @@ namespace tempest::sema::pass {
         }
         cc->rejection = builder.rejection();
         cc->rejection.argIndex = argIndex;
+      } else if (!isPlausible) {
+        // The index only rules out a member with the right arity if its first parameter
+        // can't accept the first argument.
+        cc->rejection.reason = Rejection::CONVERSION_FAILURE;
+        cc->rejection.argIndex = 0;
       }
 
       returnTypes.push_back({ cc, returnType });
@@ -1060,21 +1355,29 @@ namespace tempest::sema::pass {
       method = _cu.spec().specialize(cast<GenericDefn>(method), typeArgs);
     }
 
+    // diag.debug() << "fn: " << fnType << " rt: " << returnType << " " << method;
+
+    patchCallee(
+        callExpr, site->location, fn, method, candidate->stem, fnType, returnType, fnSelfType);
+    reorderCallingArgs(st, callExpr, site->argList, candidate);
+  }
+
+  void ResolveTypesPass::patchCallee(
+      ApplyFnOp* callExpr, const source::Location& location, FunctionDefn* fn, Member* method,
+      Expr* candidateStem, const Type* fnType, const Type* returnType, const Type* fnSelfType) {
     if (fn->isUnsafe() && !_unsafeContext) {
       diag.error(callExpr) << "Unsafe methods may only be called in unsafe contexts.";
     }
 
-    // diag.debug() << "fn: " << fnType << " rt: " << returnType << " " << method;
-
     // Patch the call expression with a new callable
     if (callExpr->function->kind == Expr::Kind::FUNCTION_REF_OVERLOAD) {
       // Create a new signular function reference.
       auto fnRef = static_cast<MemberListExpr*>(callExpr->function);
       // If the function reference had an explicit stem ('a.x()') then use it, otherwise
       // preserve the implicit stem ('self');
-      auto stem = fnRef->stem ? fnRef->stem : candidate->stem;
+      auto stem = fnRef->stem ? fnRef->stem : candidateStem;
       callExpr->function = new (*_alloc) DefnRef(
-          Expr::Kind::FUNCTION_REF, site->location, method, stem, fnType);
+          Expr::Kind::FUNCTION_REF, location, method, stem, fnType);
       callExpr->type = returnType;
       callExpr->flavor = ApplyFnOp::STATIC;
       if (stem) {
@@ -1085,7 +1388,7 @@ namespace tempest::sema::pass {
       auto allocObj = new (*_alloc) SymbolRefExpr(
           Expr::Kind::ALLOC_OBJ, callExpr->location, nullptr, fnSelfType);
       callExpr->function = new (*_alloc) DefnRef(
-          Expr::Kind::FUNCTION_REF, site->location, method, allocObj, fnSelfType);
+          Expr::Kind::FUNCTION_REF, location, method, allocObj, fnSelfType);
       callExpr->type = fnSelfType;
       callExpr->flavor = ApplyFnOp::NEW;
       if (auto udSelf = dyn_cast<UserDefinedType>(fn->selfType())) {
@@ -1097,14 +1400,12 @@ namespace tempest::sema::pass {
       // Create a new signular function reference.
       auto selfArg = new (*_alloc) SelfExpr(callExpr->location, _selfType);
       callExpr->function = new (*_alloc) DefnRef(
-          Expr::Kind::FUNCTION_REF, site->location, method, selfArg, fnType);
+          Expr::Kind::FUNCTION_REF, location, method, selfArg, fnType);
       callExpr->type = returnType;
       callExpr->flavor = ApplyFnOp::SUPER;
     } else {
       assert(false && "Implement other callable types");
     }
-
-    reorderCallingArgs(cs, st, callExpr, site, candidate);
   }
 
 // #     if leftOverVars:
@@ -1142,15 +1443,15 @@ namespace tempest::sema::pass {
 //         self.assignTypes(func.getBody(), func.getType().getReturnType())
 
   void ResolveTypesPass::reorderCallingArgs(
-      ConstraintSolver& cs, SolutionTransform& st,
-      ApplyFnOp* callExpr, CallSite* site, CallCandidate* cc) {
+      SolutionTransform& st, ApplyFnOp* callExpr, const ArrayRef<Expr*>& args,
+      CallCandidate* cc) {
     size_t argIndex = 0;
     SmallVector<Expr*, 8> argList;
     SmallVector<Expr*, 8> varArgList;
     argList.resize(cc->params.size(), nullptr);
 
     // Assign explicit arguments
-    for (auto arg : site->argList) {
+    for (auto arg : args) {
       size_t paramIndex = cc->paramAssignments[argIndex++];
       auto paramType = st.transform(cc->paramTypes[paramIndex]);
       if (cc->isVariadic && paramIndex == cc->paramTypes.size() - 1) {
@@ -1342,7 +1643,7 @@ namespace tempest::sema::pass {
       case Expr::Kind::WHILE: {
         auto st = static_cast<WhileStmt*>(e);
         st->test = coerceExpr(st->test, &BooleanType::BOOL);
-        st->body = coerceExpr(st->test, nullptr);
+        st->body = coerceExpr(st->body, nullptr);
         st->type = &VoidType::VOID;
         return st;
       }
@@ -1380,6 +1681,18 @@ namespace tempest::sema::pass {
         return addCastIfNeeded(op, dstType);
       }
 
+      case Expr::Kind::IS_TYPE:
+      case Expr::Kind::AS_TYPE: {
+        auto op = static_cast<TypeTestOp*>(e);
+        op->arg = coerceExpr(op->arg, nullptr);
+        if (e->kind == Expr::Kind::IS_TYPE) {
+          op->type = &BooleanType::BOOL;
+        } else {
+          op->type = _cu.types().createUnionType({ op->testType, &VoidType::VOID });
+        }
+        return addCastIfNeeded(op, dstType);
+      }
+
       case Expr::Kind::ASSIGN: {
         auto op = static_cast<BinaryOp*>(e);
         coerceExpr(op->args[0], nullptr);
@@ -46,9 +46,16 @@ namespace tempest::sema::pass {
   /** Helper which can do eager type resolution. */
   class ResolveTypesPass {
   public:
-    ResolveTypesPass(CompilationUnit& cu) : _cu(cu) {}
-
-    /** Eagerly resolve types for a definition. */
+    /** Construct a type resolution pass. If 'numThreads' is greater than one, function
+        bodies are inferred concurrently on that many worker threads. */
+    ResolveTypesPass(CompilationUnit& cu, unsigned numThreads = 1)
+      : _cu(cu)
+      , _numThreads(numThreads)
+    {}
+
+    /** Eagerly resolve types for a definition. Each definition is resolved exactly once;
+        if another thread is already resolving it, waits for that thread to finish. Returns
+        false if the definition depends on its own type. */
     static bool resolve(Defn* defn);
 
     void run();
@@ -89,6 +96,7 @@ namespace tempest::sema::pass {
 
   protected:
     CompilationUnit& _cu;
+    unsigned _numThreads;
     size_t _sourcesProcessed = 0;
     size_t _importSourcesProcessed = 0;
     tempest::support::BumpPtrAllocator* _alloc = nullptr;
@@ -100,6 +108,9 @@ namespace tempest::sema::pass {
     names::LookupScope* _scope = nullptr;
     bool _unsafeContext = false;
 
+    void runParallel();
+    void resolveDefn(Defn* d);
+
     const Type* visitBlock(BlockStmt* expr, ConstraintSolver& cs);
     const Type* visitLocalVar(LocalVarStmt* expr, ConstraintSolver& cs);
     const Type* visitIf(IfStmt* expr, ConstraintSolver& cs);
@@ -125,8 +136,30 @@ namespace tempest::sema::pass {
     void applySolution(ConstraintSolver& cs, SolutionTransform& st);
     void updateCallSite(ConstraintSolver& cs, CallSite* site, SolutionTransform& st);
     void reorderCallingArgs(
-        ConstraintSolver& cs, SolutionTransform& st, ApplyFnOp* callExpr,
-        CallSite* site, CallCandidate* cc);
+        SolutionTransform& st, ApplyFnOp* callExpr, const ArrayRef<Expr*>& args,
+        CallCandidate* cc);
+
+    /** For heavily overloaded names, find the positions of the members which could
+        plausibly accept these arguments. Returns false if no filtering was done, in which
+        case all members should be considered. */
+    bool filterCandidates(
+        const ArrayRef<MemberAndStem>& methodList,
+        const ArrayRef<const Type*>& argTypes,
+        llvm::SmallVectorImpl<size_t>& positions);
+
+    /** Resolve a call to a single non-generic function without using the constraint solver.
+        Returns the type of the call, or nullptr if the call needs the solver. */
+    const Type* addDirectCall(
+        ApplyFnOp* callExpr,
+        const MemberAndStem& method,
+        const ArrayRef<Expr*>& args,
+        const ArrayRef<const Type*>& argTypes);
+
+    /** Replace the callable of a call expression with a reference to the chosen method. */
+    void patchCallee(
+        ApplyFnOp* callExpr, const source::Location& location, FunctionDefn* fn, Member* method,
+        Expr* candidateStem, const Type* fnType, const Type* returnType,
+        const Type* fnSelfType);
     bool lookupADLName(MemberListExpr* m, ArrayRef<Type*> argTypes);
     Expr* resolveMemberNameRef(MemberNameRef* mref);
     Expr* addCastIfNeeded(Expr* expr, const Type* ty);
@@ -0,0 +1,460 @@
+#include "tempest/gen/outputsym.hpp"
+#include "tempest/sema/graph/defn.hpp"
+#include "tempest/sema/graph/expr_literal.hpp"
+#include "tempest/sema/graph/expr_lowered.hpp"
+#include "tempest/sema/graph/expr_op.hpp"
+#include "tempest/sema/graph/expr_stmt.hpp"
+#include "tempest/sema/transform/escapeanalysis.hpp"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Casting.h"
+
+namespace tempest::sema::transform {
+  using namespace tempest::sema::graph;
+  using llvm::SmallVector;
+  using llvm::SmallVectorImpl;
+
+  namespace {
+    /** Node standing for the 'self' argument. Other nodes are allocation expressions and the
+        definitions of local variables and parameters. */
+    const char SELF_NODE = 0;
+
+    /** Escape state for a single function body. */
+    class FunctionEscapes {
+    public:
+      FunctionEscapes(const EscapeAnalysis& analysis) : _analysis(analysis) {}
+
+      void analyze(FunctionSym* fsym) {
+        auto fn = fsym->function;
+        if (fn->isConstructor()) {
+          // Flex constructors return 'self'.
+          auto td = llvm::dyn_cast_or_null<TypeDefn>(fn->definedIn());
+          if (td && td->isFlex()) {
+            _escaping.insert(&SELF_NODE);
+          }
+        }
+        walk(fsym->body, true);
+        propagate();
+        checkLoops();
+      }
+
+      bool escapes(const void* node) const {
+        return _incomplete || _escaping.count(node) > 0;
+      }
+
+      /** Allocation expressions in the body, in the order found. */
+      llvm::ArrayRef<Expr*> allocs() const { return _allocs; }
+
+    private:
+      const EscapeAnalysis& _analysis;
+
+      /** Set if the body contains an expression the analysis doesn't understand, in which case
+          everything escapes. */
+      bool _incomplete = false;
+      llvm::DenseSet<const void*> _escaping;
+
+      /** For each local variable (and 'self'), the nodes whose values are assigned to it. */
+      llvm::DenseMap<const void*, SmallVector<const void*, 4>> _assigned;
+
+      SmallVector<Expr*, 8> _allocs;
+
+      /** Innermost loop enclosing each allocation and local variable declaration. */
+      llvm::DenseMap<const void*, Expr*> _loopOf;
+      llvm::DenseMap<Expr*, Expr*> _parentLoop;
+      Expr* _loop = nullptr;
+
+      static bool isLocalSlot(Member* m) {
+        if (m->kind == Member::Kind::FUNCTION_PARAM) {
+          return true;
+        }
+        return m->kind == Member::Kind::VAR_DEF && static_cast<ValueDefn*>(m)->isLocal();
+      }
+
+      /** Collect the nodes that the value of an expression could be. */
+      void sources(Expr* e, SmallVectorImpl<const void*>& out) {
+        if (e == nullptr) {
+          return;
+        }
+        switch (e->kind) {
+          case Expr::Kind::ALLOC_OBJ:
+          case Expr::Kind::ALLOC_FLEX:
+            out.push_back(e);
+            break;
+
+          case Expr::Kind::SELF:
+            out.push_back(&SELF_NODE);
+            break;
+
+          case Expr::Kind::VAR_REF: {
+            auto dref = static_cast<DefnRef*>(e);
+            if (!dref->stem && isLocalSlot(dref->defn)) {
+              out.push_back(dref->defn);
+            }
+            break;
+          }
+
+          case Expr::Kind::CALL: {
+            // A constructor call evaluates to the newly-allocated object.
+            auto call = static_cast<ApplyFnOp*>(e);
+            if (call->flavor == ApplyFnOp::NEW) {
+              if (auto sref = llvm::dyn_cast<SymbolRefExpr>(call->function)) {
+                sources(sref->stem, out);
+              } else if (auto dref = llvm::dyn_cast<DefnRef>(call->function)) {
+                sources(dref->stem, out);
+              }
+            }
+            break;
+          }
+
+          case Expr::Kind::BLOCK:
+            sources(static_cast<BlockStmt*>(e)->result, out);
+            break;
+
+          case Expr::Kind::IF: {
+            auto stmt = static_cast<IfStmt*>(e);
+            sources(stmt->thenBlock, out);
+            sources(stmt->elseBlock, out);
+            break;
+          }
+
+          case Expr::Kind::CAST_CREATE_UNION:
+          case Expr::Kind::CAST_CREATE_INTERFACE:
+            sources(static_cast<UnaryOp*>(e)->arg, out);
+            break;
+
+          case Expr::Kind::AS_TYPE:
+            // A downcast evaluates to its argument, or null.
+            sources(static_cast<TypeTestOp*>(e)->arg, out);
+            break;
+
+          default:
+            break;
+        }
+      }
+
+      void assign(const void* target, Expr* value) {
+        SmallVector<const void*, 4> values;
+        sources(value, values);
+        auto& list = _assigned[target];
+        list.append(values.begin(), values.end());
+      }
+
+      /** Visit an expression. If 'valueEscapes' is set, its value is used in a way that lets
+          it escape. Children that pass their value through to their parent are covered by
+          the parent's sources, so they are walked as not escaping. */
+      void walk(Expr* e, bool valueEscapes) {
+        if (e == nullptr || _incomplete) {
+          return;
+        }
+        if (valueEscapes) {
+          SmallVector<const void*, 4> values;
+          sources(e, values);
+          _escaping.insert(values.begin(), values.end());
+        }
+
+        switch (e->kind) {
+          case Expr::Kind::VOID:
+          case Expr::Kind::SELF:
+          case Expr::Kind::BOOLEAN_LITERAL:
+          case Expr::Kind::INTEGER_LITERAL:
+          case Expr::Kind::FLOAT_LITERAL:
+          case Expr::Kind::DOUBLE_LITERAL:
+          case Expr::Kind::STRING_LITERAL:
+            break;
+
+          case Expr::Kind::ALLOC_OBJ:
+            _allocs.push_back(e);
+            _loopOf[e] = _loop;
+            break;
+
+          case Expr::Kind::ALLOC_FLEX:
+            _allocs.push_back(e);
+            _loopOf[e] = _loop;
+            walk(static_cast<FlexAllocExpr*>(e)->size, false);
+            break;
+
+          case Expr::Kind::VAR_REF:
+            // Reading a field doesn't let the object escape.
+            walk(static_cast<DefnRef*>(e)->stem, false);
+            break;
+
+          case Expr::Kind::FUNCTION_REF:
+          case Expr::Kind::TYPE_REF:
+            // Not called, so it's a bound method which holds on to its stem.
+            walk(static_cast<DefnRef*>(e)->stem, true);
+            break;
+
+          case Expr::Kind::GLOBAL_REF:
+            walk(static_cast<SymbolRefExpr*>(e)->stem, true);
+            break;
+
+          case Expr::Kind::CALL:
+            walkCall(static_cast<ApplyFnOp*>(e));
+            break;
+
+          case Expr::Kind::BLOCK: {
+            auto block = static_cast<BlockStmt*>(e);
+            for (auto st : block->stmts) {
+              walk(st, false);
+            }
+            walk(block->result, false);
+            break;
+          }
+
+          case Expr::Kind::LOCAL_VAR: {
+            auto st = static_cast<LocalVarStmt*>(e);
+            _loopOf[st->defn] = _loop;
+            assign(st->defn, st->defn->init());
+            walk(st->defn->init(), false);
+            break;
+          }
+
+          case Expr::Kind::IF: {
+            auto stmt = static_cast<IfStmt*>(e);
+            walk(stmt->test, false);
+            walk(stmt->thenBlock, false);
+            walk(stmt->elseBlock, false);
+            break;
+          }
+
+          case Expr::Kind::WHILE: {
+            auto stmt = static_cast<WhileStmt*>(e);
+            _parentLoop[stmt] = _loop;
+            auto savedLoop = _loop;
+            _loop = stmt;
+            walk(stmt->test, false);
+            walk(stmt->body, false);
+            _loop = savedLoop;
+            break;
+          }
+
+          case Expr::Kind::RETURN:
+          case Expr::Kind::THROW:
+            walk(static_cast<UnaryOp*>(e)->arg, true);
+            break;
+
+          case Expr::Kind::NOT:
+          case Expr::Kind::NEGATE:
+          case Expr::Kind::COMPLEMENT:
+          case Expr::Kind::CAST_SIGN_EXTEND:
+          case Expr::Kind::CAST_ZERO_EXTEND:
+          case Expr::Kind::CAST_INT_TRUNCATE:
+          case Expr::Kind::CAST_FP_EXTEND:
+          case Expr::Kind::CAST_FP_TRUNC:
+          case Expr::Kind::CAST_CREATE_UNION:
+          case Expr::Kind::CAST_CREATE_INTERFACE:
+            walk(static_cast<UnaryOp*>(e)->arg, false);
+            break;
+
+          case Expr::Kind::IS_TYPE:
+          case Expr::Kind::AS_TYPE:
+            walk(static_cast<TypeTestOp*>(e)->arg, false);
+            break;
+
+          case Expr::Kind::ADD:
+          case Expr::Kind::SUBTRACT:
+          case Expr::Kind::MULTIPLY:
+          case Expr::Kind::DIVIDE:
+          case Expr::Kind::REMAINDER:
+          case Expr::Kind::LSHIFT:
+          case Expr::Kind::RSHIFT:
+          case Expr::Kind::BIT_AND:
+          case Expr::Kind::BIT_OR:
+          case Expr::Kind::BIT_XOR:
+          case Expr::Kind::EQ:
+          case Expr::Kind::NE:
+          case Expr::Kind::LT:
+          case Expr::Kind::LE:
+          case Expr::Kind::GT:
+          case Expr::Kind::GE:
+          case Expr::Kind::REF_EQ:
+          case Expr::Kind::REF_NE:
+          case Expr::Kind::LOGICAL_AND:
+          case Expr::Kind::LOGICAL_OR: {
+            auto op = static_cast<BinaryOp*>(e);
+            walk(op->args[0], false);
+            walk(op->args[1], false);
+            break;
+          }
+
+          case Expr::Kind::ASSIGN: {
+            auto op = static_cast<BinaryOp*>(e);
+            auto lhs = op->args[0];
+            auto rhs = op->args[1];
+            if (lhs->kind == Expr::Kind::SELF) {
+              // Flex constructors assign the allocation to 'self'.
+              assign(&SELF_NODE, rhs);
+              walk(rhs, false);
+            } else if (auto dref = llvm::dyn_cast<DefnRef>(lhs)) {
+              if (!dref->stem && isLocalSlot(dref->defn)) {
+                assign(dref->defn, rhs);
+                walk(rhs, false);
+              } else {
+                // Storing into a field or a global.
+                walk(rhs, true);
+                walk(dref->stem, false);
+              }
+            } else {
+              walk(rhs, true);
+              walk(lhs, false);
+            }
+            break;
+          }
+
+          default:
+            _incomplete = true;
+            break;
+        }
+      }
+
+      void walkCall(ApplyFnOp* call) {
+        Expr* stem = nullptr;
+        bool selfEscapes = true;
+        if (auto sref = llvm::dyn_cast<SymbolRefExpr>(call->function)) {
+          stem = sref->stem;
+          if (auto fsym = llvm::dyn_cast<FunctionSym>(sref->sym)) {
+            selfEscapes = _analysis.selfEscapes(fsym);
+          }
+        } else if (auto dref = llvm::dyn_cast<DefnRef>(call->function)) {
+          stem = dref->stem;
+          auto fn = llvm::dyn_cast<FunctionDefn>(unwrapSpecialization(dref->defn));
+          if (fn && fn->intrinsic() == IntrinsicFn::OBJECT_CTOR) {
+            selfEscapes = false;
+          }
+        } else {
+          walk(call->function, true);
+        }
+        walk(stem, selfEscapes);
+        for (auto arg : call->args) {
+          walk(arg, true);
+        }
+      }
+
+      /** Anything assigned to an escaping variable escapes too. */
+      void propagate() {
+        SmallVector<const void*, 16> worklist(_escaping.begin(), _escaping.end());
+        while (!worklist.empty()) {
+          auto node = worklist.pop_back_val();
+          auto it = _assigned.find(node);
+          if (it == _assigned.end()) {
+            continue;
+          }
+          for (auto value : it->second) {
+            if (_escaping.insert(value).second) {
+              worklist.push_back(value);
+            }
+          }
+        }
+      }
+
+      bool isWithin(Expr* loop, Expr* outer) const {
+        while (loop) {
+          if (loop == outer) {
+            return true;
+          }
+          loop = _parentLoop.lookup(loop);
+        }
+        return false;
+      }
+
+      /** A stack slot is reused on every iteration of a loop, so an allocation inside a loop
+          may only be held by variables declared inside that loop, which don't outlive the
+          iteration. */
+      void checkLoops() {
+        // Invert the assignments to find the variables each node flows into.
+        llvm::DenseMap<const void*, SmallVector<const void*, 4>> flowsTo;
+        for (auto& entry : _assigned) {
+          for (auto value : entry.second) {
+            flowsTo[value].push_back(entry.first);
+          }
+        }
+
+        for (auto alloc : _allocs) {
+          auto loop = _loopOf.lookup(alloc);
+          if (!loop || _escaping.count(alloc)) {
+            continue;
+          }
+          llvm::DenseSet<const void*> visited;
+          SmallVector<const void*, 8> worklist = { alloc };
+          while (!worklist.empty()) {
+            auto node = worklist.pop_back_val();
+            if (node != alloc && !isWithin(_loopOf.lookup(node), loop)) {
+              _escaping.insert(alloc);
+              break;
+            }
+            for (auto target : flowsTo.lookup(node)) {
+              if (visited.insert(target).second) {
+                worklist.push_back(target);
+              }
+            }
+          }
+        }
+      }
+    };
+
+    bool isSmallConstant(Expr* size) {
+      if (auto lit = llvm::dyn_cast_or_null<IntegerLiteral>(size)) {
+        auto value = lit->asAPInt();
+        return value.getActiveBits() <= 32 &&
+            value.getZExtValue() <= EscapeAnalysis::MAX_STACK_FLEX_ELEMENTS;
+      }
+      return false;
+    }
+  }
+
+  void EscapeAnalysis::run(llvm::ArrayRef<OutputSym*> symbols) {
+    _selfEscapes.clear();
+    _numStackAllocs = 0;
+    SmallVector<FunctionSym*, 32> functions;
+    for (auto sym : symbols) {
+      if (auto fsym = llvm::dyn_cast<FunctionSym>(sym)) {
+        if (fsym->body) {
+          functions.push_back(fsym);
+          _selfEscapes[fsym] = false;
+        }
+      }
+    }
+
+    // Summaries only go from not escaping to escaping, so this terminates.
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (auto fsym : functions) {
+        if (_selfEscapes[fsym]) {
+          continue;
+        }
+        FunctionEscapes escapes(*this);
+        escapes.analyze(fsym);
+        if (escapes.escapes(&SELF_NODE)) {
+          _selfEscapes[fsym] = true;
+          changed = true;
+        }
+      }
+    }
+
+    for (auto fsym : functions) {
+      FunctionEscapes escapes(*this);
+      escapes.analyze(fsym);
+      for (auto alloc : escapes.allocs()) {
+        if (escapes.escapes(alloc)) {
+          continue;
+        }
+        if (auto sref = llvm::dyn_cast<SymbolRefExpr>(alloc)) {
+          sref->noEscape = true;
+          _numStackAllocs += 1;
+        } else if (auto flex = llvm::dyn_cast<FlexAllocExpr>(alloc)) {
+          if (isSmallConstant(flex->size)) {
+            flex->noEscape = true;
+            _numStackAllocs += 1;
+          }
+        }
+      }
+    }
+  }
+
+  bool EscapeAnalysis::selfEscapes(FunctionSym* fsym) const {
+    auto it = _selfEscapes.find(fsym);
+    return it == _selfEscapes.end() || it->second;
+  }
+}
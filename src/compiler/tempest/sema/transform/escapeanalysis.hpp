@@ -0,0 +1,51 @@
+#ifndef TEMPEST_SEMA_TRANSFORM_ESCAPEANALYSIS_HPP
+#define TEMPEST_SEMA_TRANSFORM_ESCAPEANALYSIS_HPP 1
+
+#ifndef TEMPEST_SEMA_GRAPH_EXPR_HPP
+  #include "tempest/sema/graph/expr.hpp"
+#endif
+
+#include <unordered_map>
+
+namespace tempest::gen {
+  class FunctionSym;
+  class OutputSym;
+}
+
+namespace tempest::sema::transform {
+  using tempest::gen::FunctionSym;
+  using tempest::gen::OutputSym;
+
+  /** Finds object allocations whose results never outlive the function call that makes them,
+      and sets their 'noEscape' flag so that code generation can allocate them on the stack
+      instead of the garbage-collected heap.
+
+      The analysis is flow-insensitive within a function body. An object escapes if it is
+      returned or thrown, stored in a field or global, passed as an argument, or passed as
+      'self' to a method which lets 'self' escape. A local variable holds everything that is
+      ever assigned to it. Whether each method lets 'self' escape is computed over all of the
+      functions together, starting from the assumption that none do and iterating until
+      nothing changes. */
+  class EscapeAnalysis {
+  public:
+    /** Flex allocations with more elements than this stay on the heap. */
+    static constexpr uint64_t MAX_STACK_FLEX_ELEMENTS = 256;
+
+    /** Analyze the bodies of all of the function symbols, and mark the allocations in them
+        that don't escape. */
+    void run(llvm::ArrayRef<OutputSym*> symbols);
+
+    /** True if calling this method could leave its 'self' argument reachable after the call
+        returns. Always true for functions that weren't analyzed. */
+    bool selfEscapes(FunctionSym* fsym) const;
+
+    /** Number of allocations that were marked as not escaping. */
+    size_t numStackAllocs() const { return _numStackAllocs; }
+
+  private:
+    std::unordered_map<FunctionSym*, bool> _selfEscapes;
+    size_t _numStackAllocs = 0;
+  };
+}
+
+#endif
@@ -293,7 +293,7 @@ namespace tempest::sema::transform {
         changed = true;
       }
     }
-    return changed ? _specs.alloc().copyOf(result) : in;
+    return changed ? _specs.copyOf(result) : in;
   }
 
   Expr* ExprTransform::transform(Expr* expr) {
@@ -423,6 +423,7 @@ namespace tempest::sema::transform {
 
       case Expr::Kind::RETURN:
       case Expr::Kind::THROW:
+      case Expr::Kind::NOT:
       case Expr::Kind::CAST_SIGN_EXTEND:
       case Expr::Kind::CAST_ZERO_EXTEND:
       case Expr::Kind::CAST_INT_TRUNCATE:
@@ -469,6 +470,32 @@ namespace tempest::sema::transform {
         return op;
       }
 
+      case Expr::Kind::CAST_CREATE_INTERFACE: {
+        auto op = static_cast<InterfaceCastOp*>(expr);
+        auto arg = transform(op->arg);
+        auto type = transformType(op->type);
+        if (arg != op->arg || type != op->type) {
+          auto result = new (_alloc) InterfaceCastOp(op->location, arg, type);
+          result->trans = op->trans;
+          return result;
+        }
+        return op;
+      }
+
+      case Expr::Kind::IS_TYPE:
+      case Expr::Kind::AS_TYPE: {
+        auto op = static_cast<TypeTestOp*>(expr);
+        auto arg = transform(op->arg);
+        auto testType = transformType(op->testType);
+        auto type = transformType(op->type);
+        if (arg != op->arg || testType != op->testType || type != op->type) {
+          auto result = new (_alloc) TypeTestOp(op->kind, op->location, arg, testType, type);
+          result->cls = op->cls;
+          return result;
+        }
+        return op;
+      }
+
       case Expr::Kind::ALLOC_OBJ: {
         auto sref = static_cast<SymbolRefExpr*>(expr);
         auto type = transformType(expr->type);
@@ -0,0 +1,213 @@
+#include "tempest/sema/graph/defn.hpp"
+#include "tempest/sema/graph/expr.hpp"
+#include "tempest/sema/graph/expr_op.hpp"
+#include "tempest/sema/graph/expr_stmt.hpp"
+#include "tempest/sema/transform/typedependence.hpp"
+#include "llvm/Support/Casting.h"
+
+namespace tempest::sema::transform {
+  using namespace tempest::sema::graph;
+
+  bool isTypeDependent(const Type* type) {
+    if (type == nullptr) {
+      return false;
+    }
+
+    switch (type->kind) {
+      case Type::Kind::NOT_EXPR:
+      case Type::Kind::INVALID:
+      case Type::Kind::NEVER:
+      case Type::Kind::IGNORED:
+      case Type::Kind::VOID:
+      case Type::Kind::BOOLEAN:
+      case Type::Kind::INTEGER:
+      case Type::Kind::FLOAT:
+      case Type::Kind::SINGLETON:
+      case Type::Kind::EXTENSION:
+      case Type::Kind::ENUM:
+      case Type::Kind::ALIAS:
+        return false;
+
+      case Type::Kind::CLASS:
+      case Type::Kind::STRUCT:
+      case Type::Kind::INTERFACE:
+      case Type::Kind::TRAIT: {
+        // A generic type referred to by its own name is specialized with the type arguments.
+        auto udt = static_cast<const UserDefinedType*>(type);
+        return udt->defn()->allTypeParams().size() > 0;
+      }
+
+      case Type::Kind::MODIFIED:
+        return isTypeDependent(static_cast<const ModifiedType*>(type)->base);
+
+      case Type::Kind::UNION:
+        return isTypeDependent(static_cast<const UnionType*>(type)->members);
+
+      case Type::Kind::TUPLE:
+        return isTypeDependent(static_cast<const TupleType*>(type)->members);
+
+      case Type::Kind::SPECIALIZED:
+        return isTypeDependent(static_cast<const SpecializedType*>(type)->spec->typeArgs());
+
+      case Type::Kind::FUNCTION: {
+        auto ft = static_cast<const FunctionType*>(type);
+        return isTypeDependent(ft->returnType) || isTypeDependent(ft->paramTypes);
+      }
+
+      default:
+        // Type variables, and anything left over from inference.
+        return true;
+    }
+  }
+
+  bool isTypeDependent(llvm::ArrayRef<const Type*> types) {
+    for (auto type : types) {
+      if (isTypeDependent(type)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  namespace {
+    /** Mark each element of a list; all of them are visited even if an early one is
+        dependent, so that every subexpression gets marked. */
+    bool markList(llvm::ArrayRef<Expr*> exprs) {
+      bool dependent = false;
+      for (auto e : exprs) {
+        dependent |= markTypeDependence(e);
+      }
+      return dependent;
+    }
+
+    bool isDependentRef(DefnRef* dref) {
+      if (auto sp = dyn_cast<SpecializedDefn>(dref->defn)) {
+        return isTypeDependent(sp->typeArgs());
+      }
+      return false;
+    }
+
+    bool isFlexAlloc(Expr* function) {
+      if (auto dref = dyn_cast_or_null<DefnRef>(function)) {
+        auto fn = dyn_cast<FunctionDefn>(unwrapSpecialization(dref->defn));
+        return fn && fn->intrinsic() == IntrinsicFn::FLEX_ALLOC;
+      }
+      return false;
+    }
+  }
+
+  bool markTypeDependence(Expr* expr) {
+    if (expr == nullptr) {
+      return false;
+    }
+
+    bool dependent = isTypeDependent(expr->type);
+    switch (expr->kind) {
+      case Expr::Kind::VOID:
+      case Expr::Kind::BOOLEAN_LITERAL:
+      case Expr::Kind::INTEGER_LITERAL:
+      case Expr::Kind::FLOAT_LITERAL:
+        // Literals are never copied, whatever their type.
+        dependent = false;
+        break;
+
+      case Expr::Kind::SELF:
+        break;
+
+      case Expr::Kind::CALL: {
+        auto call = static_cast<ApplyFnOp*>(expr);
+        dependent |= markTypeDependence(call->function);
+        dependent |= markList(call->args);
+        // Flex allocations name the class through the environment.
+        dependent |= isFlexAlloc(call->function);
+        break;
+      }
+
+      case Expr::Kind::FUNCTION_REF:
+      case Expr::Kind::TYPE_REF:
+      case Expr::Kind::VAR_REF: {
+        auto dref = static_cast<DefnRef*>(expr);
+        dependent |= markTypeDependence(dref->stem);
+        dependent |= isDependentRef(dref);
+        break;
+      }
+
+      case Expr::Kind::MEMBER_NAME_REF: {
+        auto mref = static_cast<MemberNameRef*>(expr);
+        dependent |= markTypeDependence(mref->stem);
+        dependent |= markTypeDependence(mref->refs);
+        break;
+      }
+
+      case Expr::Kind::BLOCK: {
+        auto block = static_cast<BlockStmt*>(expr);
+        dependent |= markList(block->stmts);
+        dependent |= markTypeDependence(block->result);
+        break;
+      }
+
+      case Expr::Kind::LOCAL_VAR: {
+        auto st = static_cast<LocalVarStmt*>(expr);
+        dependent |= isTypeDependent(st->defn->type());
+        dependent |= markTypeDependence(st->defn->init());
+        break;
+      }
+
+      case Expr::Kind::IF: {
+        auto stmt = static_cast<IfStmt*>(expr);
+        dependent |= markTypeDependence(stmt->test);
+        dependent |= markTypeDependence(stmt->thenBlock);
+        dependent |= markTypeDependence(stmt->elseBlock);
+        break;
+      }
+
+      case Expr::Kind::WHILE: {
+        auto stmt = static_cast<WhileStmt*>(expr);
+        dependent |= markTypeDependence(stmt->test);
+        dependent |= markTypeDependence(stmt->body);
+        break;
+      }
+
+      case Expr::Kind::RETURN:
+      case Expr::Kind::THROW:
+      case Expr::Kind::NOT:
+      case Expr::Kind::CAST_SIGN_EXTEND:
+      case Expr::Kind::CAST_ZERO_EXTEND:
+      case Expr::Kind::CAST_INT_TRUNCATE:
+      case Expr::Kind::CAST_FP_EXTEND:
+      case Expr::Kind::CAST_FP_TRUNC:
+      case Expr::Kind::CAST_CREATE_UNION:
+        dependent |= markTypeDependence(static_cast<UnaryOp*>(expr)->arg);
+        break;
+
+      case Expr::Kind::ADD:
+      case Expr::Kind::SUBTRACT:
+      case Expr::Kind::MULTIPLY:
+      case Expr::Kind::DIVIDE:
+      case Expr::Kind::REMAINDER:
+      case Expr::Kind::LSHIFT:
+      case Expr::Kind::RSHIFT:
+      case Expr::Kind::BIT_AND:
+      case Expr::Kind::BIT_OR:
+      case Expr::Kind::BIT_XOR:
+      case Expr::Kind::EQ:
+      case Expr::Kind::LE:
+      case Expr::Kind::LT:
+      case Expr::Kind::ASSIGN: {
+        auto op = static_cast<BinaryOp*>(expr);
+        dependent |= markTypeDependence(op->args[0]);
+        dependent |= markTypeDependence(op->args[1]);
+        break;
+      }
+
+      default:
+        // Includes object allocations, which name the class through the environment.
+        dependent = true;
+        break;
+    }
+
+    expr->typeDependence =
+        dependent ? Expr::TypeDependence::DEPENDENT : Expr::TypeDependence::INVARIANT;
+    return dependent;
+  }
+}
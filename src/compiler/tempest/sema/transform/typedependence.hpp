@@ -0,0 +1,29 @@
+#ifndef TEMPEST_SEMA_TRANSFORM_TYPEDEPENDENCE_HPP
+#define TEMPEST_SEMA_TRANSFORM_TYPEDEPENDENCE_HPP 1
+
+#ifndef TEMPEST_SEMA_GRAPH_EXPR_HPP
+  #include "tempest/sema/graph/expr.hpp"
+#endif
+
+#ifndef TEMPEST_SEMA_GRAPH_TYPE_HPP
+  #include "tempest/sema/graph/type.hpp"
+#endif
+
+namespace tempest::sema::transform {
+  using tempest::sema::graph::Expr;
+  using tempest::sema::graph::Type;
+
+  /** True if mapping this type through an environment could change it: that is, if it
+      contains a type variable, or names a generic type without its type arguments. */
+  bool isTypeDependent(const Type* type);
+
+  /** True if any of the types is type-dependent. */
+  bool isTypeDependent(llvm::ArrayRef<const Type*> types);
+
+  /** Fill in the 'typeDependence' field of an expression and all of its subexpressions.
+      Expressions of kinds that aren't known to be safe to share are marked as dependent.
+      Returns true if the expression is dependent. */
+  bool markTypeDependence(Expr* expr);
+}
+
+#endif
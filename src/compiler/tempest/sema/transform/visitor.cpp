@@ -110,6 +110,7 @@ namespace tempest::sema::transform {
         return op;
       }
 
+      case Expr::Kind::NOT:
       case Expr::Kind::NEGATE:
       case Expr::Kind::COMPLEMENT:
       case Expr::Kind::CAST_SIGN_EXTEND:
@@ -117,12 +118,20 @@ namespace tempest::sema::transform {
       case Expr::Kind::CAST_INT_TRUNCATE:
       case Expr::Kind::CAST_FP_EXTEND:
       case Expr::Kind::CAST_FP_TRUNC:
+      case Expr::Kind::CAST_CREATE_INTERFACE:
       case Expr::Kind::UNSAFE: {
         auto op = static_cast<UnaryOp*>(expr);
         op->arg = visit(op->arg);
         return op;
       }
 
+      case Expr::Kind::IS_TYPE:
+      case Expr::Kind::AS_TYPE: {
+        auto op = static_cast<TypeTestOp*>(expr);
+        op->arg = visit(op->arg);
+        return op;
+      }
+
       case Expr::Kind::MEMBER_NAME_REF: {
         auto mref = static_cast<MemberNameRef*>(expr);
         mref->stem = visit(mref->stem);
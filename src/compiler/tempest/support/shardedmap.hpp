@@ -0,0 +1,82 @@
+#ifndef TEMPEST_SUPPORT_SHARDEDMAP_HPP
+#define TEMPEST_SUPPORT_SHARDEDMAP_HPP 1
+
+#ifndef TEMPEST_SUPPORT_ALLOCATOR_HPP
+  #include "tempest/support/allocator.hpp"
+#endif
+
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+namespace tempest::support {
+  /** A hash map which is divided into independently locked shards, used for hash-consing
+      from multiple threads. Lookups of existing entries take only a shared lock on a single
+      shard; insertions lock just the shard that the key hashes to. Each shard has its own
+      arena, so that allocation of new entries doesn't contend on a global allocator. */
+  template<
+      class Key,
+      class Value,
+      class Hash = std::hash<Key>,
+      class Equal = std::equal_to<Key>,
+      size_t NumShards = 16>
+  class ShardedMap {
+  public:
+    /** Return the value stored for 'key'. If there is none, call 'create' with the shard's
+        allocator to construct the entry; it must return a (key, value) pair where the key
+        refers only to memory that will outlive the map. 'create' is called at most once
+        per distinct key, so all callers observe the same value. */
+    template<class CreateFn>
+    Value getOrCreate(const Key& key, CreateFn create) {
+      auto hash = Hash()(key);
+      auto& shard = _shards[hash % NumShards];
+      {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it != shard.entries.end()) {
+          return it->second;
+        }
+      }
+
+      std::unique_lock<std::shared_mutex> lock(shard.mutex);
+      // Another thread may have inserted the entry while we were waiting for the lock.
+      auto it = shard.entries.find(key);
+      if (it != shard.entries.end()) {
+        return it->second;
+      }
+      auto entry = create(shard.alloc);
+      shard.entries.emplace(entry.first, entry.second);
+      return entry.second;
+    }
+
+    /** Total number of entries in all shards. */
+    size_t size() const {
+      size_t result = 0;
+      for (auto& shard : _shards) {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        result += shard.entries.size();
+      }
+      return result;
+    }
+
+    /** Remove all entries and release the memory held by the shard arenas. */
+    void clear() {
+      for (auto& shard : _shards) {
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        shard.entries.clear();
+        shard.alloc.Reset();
+      }
+    }
+
+  private:
+    struct Shard {
+      mutable std::shared_mutex mutex;
+      std::unordered_map<Key, Value, Hash, Equal> entries;
+      BumpPtrAllocator alloc;
+    };
+
+    Shard _shards[NumShards];
+  };
+}
+
+#endif
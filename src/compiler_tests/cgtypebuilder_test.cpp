@@ -2,6 +2,8 @@
 #include "tempest/gen/cgtypebuilder.hpp"
 #include "tempest/sema/graph/primitivetype.hpp"
 #include "tempest/sema/graph/typestore.hpp"
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/Support/Allocator.h>
 
@@ -47,4 +49,89 @@ TEST_CASE("CGTypeBuilder", "[gen]") {
     REQUIRE(t->isStructTy());
     // REQUIRE(t->getStructNumElements() == 2);
   }
+
+  SECTION("Interface reference") {
+    llvm::StructType* t = types.getInterfaceRefType();
+    REQUIRE(t->getNumElements() == 2);
+    REQUIRE(t->getElementType(INTERFACE_REF_OBJECT)->isPointerTy());
+    REQUIRE(t->getElementType(INTERFACE_REF_OBJECT)->getPointerAddressSpace() == 1);
+    REQUIRE(t->getElementType(INTERFACE_REF_METHODS)->isPointerTy());
+    REQUIRE(t == types.getInterfaceRefType());
+  }
+
+  SECTION("Allocation context") {
+    llvm::StructType* t = types.getAllocContextType();
+    REQUIRE(t->getNumElements() == 2);
+    REQUIRE(t->getElementType(ALLOC_CONTEXT_CURSOR)->getPointerAddressSpace() == 1);
+    REQUIRE(t->getElementType(ALLOC_CONTEXT_LIMIT) == t->getElementType(ALLOC_CONTEXT_CURSOR));
+    REQUIRE(t == types.getAllocContextType());
+  }
+}
+
+TEST_CASE("CGTypeBuilder.union", "[gen]") {
+  llvm::LLVMContext context;
+  llvm::DataLayout dataLayout("e-m:e-i64:64-f80:128-n8:16:32:64-S128");
+  CGTypeBuilder types(context, &dataLayout);
+  TypeStore store;
+
+  SECTION("Scalar members share an integer payload") {
+    auto ut = store.createUnionType({ &IntegerType::I32, &FloatType::F64 });
+    auto cgu = types.createUnion(ut);
+    REQUIRE(cgu->layout == CGUnionType::TAGGED);
+    REQUIRE(cgu->registerPayload);
+    REQUIRE(cgu->valueType->isIntegerTy(64));
+    REQUIRE(cgu->ssaType->isStructTy());
+  }
+
+  SECTION("Small scalar members") {
+    auto ut = store.createUnionType({ &BooleanType::BOOL, &IntegerType::I16, &VoidType::VOID });
+    auto cgu = types.createUnion(ut);
+    REQUIRE(cgu->registerPayload);
+    REQUIRE(cgu->hasVoidType);
+    REQUIRE(cgu->valueType->isIntegerTy(16));
+  }
+}
+
+TEST_CASE("CGTypeBuilder.referenceMap", "[gen]") {
+  llvm::LLVMContext context;
+  llvm::DataLayout dataLayout("e-m:e-i64:64-f80:128-n8:16:32:64-S128");
+  CGTypeBuilder types(context, &dataLayout);
+  auto i32Type = llvm::Type::getInt32Ty(context);
+  auto refType = llvm::Type::getInt8Ty(context)->getPointerTo(1);
+  auto rawType = llvm::Type::getInt8Ty(context)->getPointerTo();
+
+  SECTION("Only pointers into the heap are references") {
+    llvm::SmallVector<uint64_t, 4> bitmap;
+    auto st = llvm::StructType::create({ rawType, rawType, i32Type, refType, refType });
+    types.addReferenceMap(st, 0, bitmap);
+    REQUIRE(bitmap.size() == 1);
+    REQUIRE(bitmap[0] == 0x18);
+  }
+
+  SECTION("Nested structs and arrays") {
+    llvm::SmallVector<uint64_t, 4> bitmap;
+    auto inner = llvm::StructType::create({ i32Type, refType });
+    auto st = llvm::StructType::create({ inner, llvm::ArrayType::get(refType, 2) });
+    types.addReferenceMap(st, 0, bitmap);
+    REQUIRE(bitmap.size() == 1);
+    REQUIRE(bitmap[0] == 0xe);
+  }
+
+  SECTION("Large objects") {
+    llvm::SmallVector<uint64_t, 4> bitmap;
+    auto st = llvm::StructType::create({ llvm::ArrayType::get(i32Type, 140), refType });
+    types.addReferenceMap(st, 0, bitmap);
+    REQUIRE(bitmap.size() == 2);
+    REQUIRE(bitmap[0] == 0);
+    REQUIRE(bitmap[1] == uint64_t(1) << (70 - 64));
+  }
+
+  SECTION("Tagged union payloads are skipped") {
+    llvm::SmallVector<uint64_t, 4> bitmap;
+    auto ut = llvm::StructType::create({ llvm::Type::getInt8Ty(context), refType }, "u", true);
+    auto st = llvm::StructType::create({ refType, ut });
+    types.addReferenceMap(st, 0, bitmap);
+    REQUIRE(bitmap.size() == 1);
+    REQUIRE(bitmap[0] == 1);
+  }
 }
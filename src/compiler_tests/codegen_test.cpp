@@ -15,10 +15,13 @@
 #include "tempest/sema/pass/buildgraph.hpp"
 #include "tempest/sema/pass/dataflow.hpp"
 #include "tempest/sema/pass/expandspecialization.hpp"
+#include "tempest/sema/pass/findoverrides.hpp"
 #include "tempest/sema/pass/nameresolution.hpp"
 #include "tempest/sema/pass/resolvetypes.hpp"
 #include "tempest/opt/basicopts.hpp"
+#include "tempest/opt/gcroots.hpp"
 
+#include "llvm/IR/Instructions.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/IR/IRPrintingPasses.h"
 #include "llvm/IR/PassManager.h"
@@ -44,7 +47,8 @@ public:
 
 namespace {
   /** Parse a module definition and apply buildgraph & nameresolution pass. */
-  CGModule* compile(CompilationUnit &cu, CodeGen& gen, const char* srcText) {
+  CGModule* compile(
+      CompilationUnit &cu, CodeGen& gen, const char* srcText, bool writeBarriers = false) {
     diag.reset();
     auto mod = std::make_unique<Module>(std::make_unique<TestSource>(srcText), "test.mod");
     Parser parser(mod->source(), mod->astAlloc());
@@ -57,6 +61,10 @@ namespace {
     nrPass.process(mod.get());
     ResolveTypesPass rtPass(cu);
     rtPass.process(mod.get());
+    if (diag.errorCount() == 0) {
+      FindOverridesPass foPass(cu);
+      foPass.process(mod.get());
+    }
     if (diag.errorCount() == 0) {
       DataFlowPass dfPass(cu);
       dfPass.process(mod.get());
@@ -70,6 +78,7 @@ namespace {
     REQUIRE(diag.errorCount() == 0);
 
     auto cgMod = gen.createModule("TestMod");
+    cgMod->setWriteBarriers(writeBarriers);
     cgMod->diInit("testmod.te", "");
     gen.genSymbols(cu.symbols());
     cgMod->diFinalize();
@@ -251,6 +260,353 @@ TEST_CASE("CodeGen", "[gen]") {
     REQUIRE_FALSE(verifyModule(*cgMod->irModule(), &(llvm::errs())));
   }
 
+  SECTION("heap allocation") {
+    CompilationUnit cu;
+    CodeGen gen(context, target);
+    auto cgMod = compile(cu, gen,
+      "class P {\n"
+      "  x: i32 = 0;\n"
+      "}\n"
+      "class Q {\n"
+      "  a: P = P();\n"
+      "  b: P = P();\n"
+      "}\n"
+      "final class F extends FlexAlloc[u8] {\n"
+      "  size: i32 = 0;\n"
+      "  new() { self = __alloc(5); size = 5; }\n"
+      "}\n"
+    );
+
+    // cgMod->irModule()->print(llvm::errs(), nullptr);
+    REQUIRE_FALSE(verifyModule(*cgMod->irModule(), &(llvm::errs())));
+
+    auto callsTo = [](llvm::BasicBlock& bb, llvm::StringRef name) {
+      size_t count = 0;
+      for (auto& inst : bb) {
+        if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+          if (call->getCalledFunction() && call->getCalledFunction()->getName() == name) {
+            count += 1;
+          }
+        }
+      }
+      return count;
+    };
+
+    // Each allocation bumps the cursor inline, and only calls the runtime when the buffer
+    // is full. The allocation context is looked up once, in the entry block.
+    auto ctorQ = cgMod->irModule()->getFunction("test.mod.Q.new");
+    REQUIRE(ctorQ != nullptr);
+    size_t fastBlocks = 0;
+    size_t slowBlocks = 0;
+    size_t contextCalls = 0;
+    for (auto& bb : *ctorQ) {
+      contextCalls += callsTo(bb, "gc_alloc_context");
+      if (bb.getName().startswith("alloc.fast")) {
+        fastBlocks += 1;
+        REQUIRE(callsTo(bb, "gc_alloc") == 0);
+      } else if (bb.getName().startswith("alloc.slow")) {
+        slowBlocks += 1;
+        REQUIRE(callsTo(bb, "gc_alloc") == 1);
+      } else {
+        REQUIRE(callsTo(bb, "gc_alloc") == 0);
+      }
+    }
+    REQUIRE(fastBlocks == 2);
+    REQUIRE(slowBlocks == 2);
+    REQUIRE(contextCalls == 1);
+    REQUIRE(callsTo(ctorQ->getEntryBlock(), "gc_alloc_context") == 1);
+
+    // The fast path is weighted as the likely one.
+    auto br = cast<llvm::BranchInst>(ctorQ->getEntryBlock().getTerminator());
+    REQUIRE(br->isConditional());
+    REQUIRE(br->getSuccessor(0)->getName().startswith("alloc.fast"));
+    REQUIRE(br->getMetadata(llvm::LLVMContext::MD_prof) != nullptr);
+
+    // Sizes are rounded up to keep the cursor pointer-aligned: the 5 elements of a flex
+    // object end at byte 25.
+    auto ctorF = cgMod->irModule()->getFunction("test.mod.F.new");
+    REQUIRE(ctorF != nullptr);
+    auto& layout = cgMod->irModule()->getDataLayout();
+    auto flexType = llvm::StructType::getTypeByName(context, "test.mod.F");
+    auto unrounded = layout.getStructLayout(flexType)->getElementOffset(2) + 5;
+    auto rounded = llvm::alignTo(unrounded, layout.getPointerABIAlignment(0).value());
+    REQUIRE(rounded != unrounded);
+    bool checkedSize = false;
+    for (auto& bb : *ctorF) {
+      for (auto& inst : bb) {
+        if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+          if (call->getCalledFunction() && call->getCalledFunction()->getName() == "gc_alloc") {
+            auto size = cast<llvm::ConstantInt>(call->getArgOperand(0));
+            REQUIRE(size->getZExtValue() == rounded);
+            checkedSize = true;
+          }
+        } else if (inst.getName() == "tlab.next") {
+          auto gep = cast<llvm::GetElementPtrInst>(&inst);
+          auto offset = cast<llvm::ConstantInt>(gep->getOperand(1));
+          REQUIRE(offset->getZExtValue() == rounded);
+        }
+      }
+    }
+    REQUIRE(checkedSize);
+  }
+
+  SECTION("stack allocation") {
+    CompilationUnit cu;
+    CodeGen gen(context, target);
+    auto cgMod = compile(cu, gen,
+      "class P {\n"
+      "  x: i32 = 0;\n"
+      "  value() -> i32 => x;\n"
+      "}\n"
+      "final class F extends FlexAlloc[u8] {\n"
+      "  size: i32 = 0;\n"
+      "  new() { self = __alloc(5); size = 5; }\n"
+      "  static scratch() -> i32 {\n"
+      "    let f: F = __alloc(3);\n"
+      "    return f.size;\n"
+      "  }\n"
+      "}\n"
+      "fn local() -> i32 {\n"
+      "  let p = P();\n"
+      "  return p.value();\n"
+      "}\n"
+    );
+
+    // cgMod->irModule()->print(llvm::errs(), nullptr);
+    REQUIRE_FALSE(verifyModule(*cgMod->irModule(), &(llvm::errs())));
+
+    // The object's slot is in the entry block, and its header is written in place of the
+    // heap allocation.
+    auto findSlot = [](llvm::Function* fn) -> llvm::AllocaInst* {
+      for (auto& inst : fn->getEntryBlock()) {
+        if (inst.getName().startswith("obj")) {
+          return llvm::dyn_cast<llvm::AllocaInst>(&inst);
+        }
+      }
+      return nullptr;
+    };
+    auto checkStackAlloc = [&](llvm::StringRef fnName, llvm::StringRef clsName) {
+      auto fn = cgMod->irModule()->getFunction(fnName);
+      REQUIRE(fn != nullptr);
+      auto slot = findSlot(fn);
+      REQUIRE(slot != nullptr);
+      REQUIRE(slot->getAlign().value() == 16);
+      bool storesHeader = false;
+      for (auto& bb : *fn) {
+        for (auto& inst : bb) {
+          if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+            auto callee = call->getCalledFunction();
+            REQUIRE((callee == nullptr || !callee->getName().startswith("gc_alloc")));
+          } else if (auto store = llvm::dyn_cast<llvm::StoreInst>(&inst)) {
+            if (store->getPointerOperand()->getName() == "cls.addr") {
+              REQUIRE(store->getValueOperand()->stripPointerCasts()->getName() == clsName);
+              storesHeader = true;
+            }
+          }
+        }
+      }
+      REQUIRE(storesHeader);
+      return fn;
+    };
+
+    checkStackAlloc("test.mod.local->i32", "test.mod.P::cldesc");
+
+    // A flex object's slot is sized for its elements, and its element count is stored too.
+    auto scratch = checkStackAlloc("test.mod.F.scratch->i32", "test.mod.F::cldesc");
+    auto slot = findSlot(scratch);
+    auto& layout = cgMod->irModule()->getDataLayout();
+    auto flexType = llvm::StructType::getTypeByName(context, "test.mod.F");
+    REQUIRE(flexType != nullptr);
+    REQUIRE(layout.getTypeAllocSize(slot->getAllocatedType()) ==
+        layout.getStructLayout(flexType)->getElementOffset(2) + 3);
+    bool storesCount = false;
+    for (auto& inst : scratch->getEntryBlock()) {
+      if (auto store = llvm::dyn_cast<llvm::StoreInst>(&inst)) {
+        storesCount |= store->getPointerOperand()->getName() == "gc.addr";
+      }
+    }
+    REQUIRE(storesCount);
+  }
+
+  SECTION("write barriers") {
+    CompilationUnit cu;
+    CodeGen gen(context, target);
+    auto cgMod = compile(cu, gen,
+      "class P {\n"
+      "  x: i32 = 0;\n"
+      "  value() -> i32 => x;\n"
+      "}\n"
+      "final class F extends FlexAlloc[u8] {\n"
+      "  last: P | void;\n"
+      "  size: i32 = 0;\n"
+      "  new(p: P) { self = __alloc(5); last = p; }\n"
+      "  set!(p: P) { last = p; }\n"
+      "  resize!() { size = 3; }\n"
+      "  static scratch(p: P) -> i32 {\n"
+      "    let f: F = __alloc(3);\n"
+      "    f.last = p;\n"
+      "    return f.size;\n"
+      "  }\n"
+      "}\n"
+      "final class G extends FlexAlloc[u8] {\n"
+      "  last: P | void;\n"
+      "  new(p: P) { self = __alloc(5); p.value(); last = p; }\n"
+      "}\n",
+      true
+    );
+
+    cgMod->irModule()->print(llvm::errs(), nullptr);
+    REQUIRE_FALSE(verifyModule(*cgMod->irModule(), &(llvm::errs())));
+  }
+
+  SECTION("type tests") {
+    CompilationUnit cu;
+    CodeGen gen(context, target);
+    auto cgMod = compile(cu, gen,
+      "class A {\n"
+      "  last: C | void;\n"
+      "  isB() -> bool => self is B;\n"
+      "  isNotC() -> bool => self is not C;\n"
+      "  asC!() { last = self as C; }\n"
+      "}\n"
+      "class B extends A {}\n"
+      "class C extends B {}\n"
+      "fn test { return A(); }\n"
+    );
+
+    // cgMod->irModule()->print(llvm::errs(), nullptr);
+    REQUIRE_FALSE(verifyModule(*cgMod->irModule(), &(llvm::errs())));
+
+    auto countInstrs = [](llvm::Function* fn, unsigned opcode) {
+      size_t count = 0;
+      for (auto& bb : *fn) {
+        for (auto& inst : bb) {
+          if (inst.getOpcode() == opcode) {
+            count += 1;
+          }
+        }
+      }
+      return count;
+    };
+
+    // B has a subclass, so it's tested with a range check.
+    auto isB = cgMod->irModule()->getFunction("test.mod.A.isB->bool");
+    REQUIRE(isB != nullptr);
+    REQUIRE(countInstrs(isB, llvm::Instruction::Sub) == 1);
+    REQUIRE(countInstrs(isB, llvm::Instruction::ICmp) == 1);
+
+    // C is a leaf, so its test is a single comparison.
+    auto isNotC = cgMod->irModule()->getFunction("test.mod.A.isNotC->bool");
+    REQUIRE(isNotC != nullptr);
+    REQUIRE(countInstrs(isNotC, llvm::Instruction::Sub) == 0);
+    REQUIRE(countInstrs(isNotC, llvm::Instruction::ICmp) == 1);
+
+    // A downcast selects between the object and null.
+    auto asC = cgMod->irModule()->getFunction("test.mod.A.asC");
+    REQUIRE(asC != nullptr);
+    REQUIRE(countInstrs(asC, llvm::Instruction::Select) == 1);
+  }
+
+  SECTION("union values") {
+    CompilationUnit cu;
+    CodeGen gen(context, target);
+    auto cgMod = compile(cu, gen,
+      "class A {\n"
+      "  last: A | void;\n"
+      "  num: i32 | f64 = 0;\n"
+      "  size: i32 = 7;\n"
+      "  link!() { last = self; }\n"
+      "  count!() { num = size; }\n"
+      "}\n"
+      "fn test { return A(); }\n"
+    );
+
+    // cgMod->irModule()->print(llvm::errs(), nullptr);
+    REQUIRE_FALSE(verifyModule(*cgMod->irModule(), &(llvm::errs())));
+
+    auto countInstrs = [](llvm::Function* fn, unsigned opcode) {
+      size_t count = 0;
+      for (auto& bb : *fn) {
+        for (auto& inst : bb) {
+          if (inst.getOpcode() == opcode) {
+            count += 1;
+          }
+        }
+      }
+      return count;
+    };
+
+    // A reference union is a single pointer: no tag, no temporary.
+    auto link = cgMod->irModule()->getFunction("test.mod.A.link");
+    REQUIRE(link != nullptr);
+    REQUIRE(countInstrs(link, llvm::Instruction::Alloca) == 0);
+    REQUIRE(countInstrs(link, llvm::Instruction::InsertValue) == 0);
+    REQUIRE(countInstrs(link, llvm::Instruction::Store) == 1);
+
+    // A scalar tagged union widens the value in registers, then stores the tag and the
+    // payload separately.
+    auto count = cgMod->irModule()->getFunction("test.mod.A.count");
+    REQUIRE(count != nullptr);
+    REQUIRE(countInstrs(count, llvm::Instruction::Alloca) == 0);
+    REQUIRE(countInstrs(count, llvm::Instruction::ZExt) == 1);
+    REQUIRE(countInstrs(count, llvm::Instruction::InsertValue) == 1);
+    REQUIRE(countInstrs(count, llvm::Instruction::ExtractValue) == 2);
+    REQUIRE(countInstrs(count, llvm::Instruction::Store) == 2);
+  }
+
+  SECTION("interface method call") {
+    CompilationUnit cu;
+    CodeGen gen(context, target);
+    auto cgMod = compile(cu, gen,
+      "interface Shape {\n"
+      "  area() -> i32;\n"
+      "}\n"
+      "class Square implements Shape {\n"
+      "  area() -> i32 => 4;\n"
+      "}\n"
+      "fn describe(s: Shape) -> i32 => 0;\n"
+      "fn measure() -> i32 {\n"
+      "  let s: Shape = Square();\n"
+      "  return s.area() + describe(Square());\n"
+      "}\n"
+    );
+
+    // cgMod->irModule()->print(llvm::errs(), nullptr);
+    REQUIRE_FALSE(verifyModule(*cgMod->irModule(), &(llvm::errs())));
+
+    // The itable holds the class's implementation of each interface method.
+    auto itable = cgMod->irModule()->getGlobalVariable("test.mod.Square::test.mod.Shape::itable");
+    REQUIRE(itable != nullptr);
+    REQUIRE(itable->hasInitializer());
+    auto methods = cast<llvm::ConstantArray>(itable->getInitializer());
+    REQUIRE(methods->getNumOperands() == 1);
+    REQUIRE(methods->getOperand(0)->stripPointerCasts()->getName() == "test.mod.Square.area->i32");
+
+    // Interface parameters are mangled by the interface name.
+    auto describe = cgMod->irModule()->getFunction("test.mod.describe(test.mod.Shape)->i32");
+    REQUIRE(describe != nullptr);
+
+    // The call loads the method from the itable carried by the reference, and calls it
+    // indirectly.
+    auto measure = cgMod->irModule()->getFunction("test.mod.measure->i32");
+    REQUIRE(measure != nullptr);
+    size_t indirectCalls = 0;
+    bool loadsMethod = false;
+    for (auto& bb : *measure) {
+      for (auto& inst : bb) {
+        if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+          if (call->isIndirectCall()) {
+            indirectCalls += 1;
+          }
+        } else if (inst.getName().startswith("imethod.raw")) {
+          loadsMethod = true;
+        }
+      }
+    }
+    REQUIRE(loadsMethod);
+    REQUIRE(indirectCalls == 1);
+  }
+
   SECTION("union member field") {
     CompilationUnit cu;
     CodeGen gen(context, target);
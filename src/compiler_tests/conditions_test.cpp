@@ -144,4 +144,35 @@ TEST_CASE("Conditions", "[infer]") {
     REQUIRE(c2.isSubset(c));
     REQUIRE_FALSE(c.isSubset(c2));
   }
+
+  SECTION("large overload sets") {
+    c.add(1, 3);
+    c.add(1, 70);
+    c.add(1, 130);
+    REQUIRE(c.begin()->size() == 3);
+    REQUIRE(c.begin()->contains(70));
+    REQUIRE_FALSE(c.begin()->contains(71));
+    REQUIRE(c.begin()->begin()[0] == 3);
+    REQUIRE(c.begin()->begin()[1] == 70);
+    REQUIRE(c.begin()->begin()[2] == 130);
+
+    Conditions c2;
+    c2.add(1, 70);
+    REQUIRE(c2.isSubset(c));
+    REQUIRE_FALSE(c.isSubset(c2));
+
+    // Intersecting drops the high choices, and the result compares equal to a set that
+    // never had them.
+    c &= c2;
+    REQUIRE(c == c2);
+    REQUIRE(c.begin()->size() == 1);
+  }
+
+  SECTION("disjoint conjunction") {
+    c.add(1, 2);
+    c &= Conditions(1, 3);
+    REQUIRE(c.numConjuncts() == 1);
+    REQUIRE(c.begin()->empty());
+    REQUIRE(c.begin()->begin() == c.begin()->end());
+  }
 }
@@ -6,11 +6,13 @@
 #include "tempest/sema/convert/predicate.hpp"
 #include "tempest/sema/graph/module.hpp"
 #include "tempest/sema/graph/primitivetype.hpp"
+#include "tempest/sema/infer/types.hpp"
 #include "tempest/sema/pass/buildgraph.hpp"
 #include "tempest/sema/pass/nameresolution.hpp"
 #include "llvm/ADT/APInt.h"
 #include "llvm/Support/Casting.h"
 #include <iostream>
+#include <thread>
 
 using namespace tempest::compiler;
 using namespace tempest::sema::convert;
@@ -302,3 +304,99 @@ TEST_CASE("Convert.Assignable", "[sema]") {
     REQUIRE(isAssignable(intI, alC1) == ConversionResult(ConversionRank::EXACT));
   }
 }
+
+TEST_CASE("Convert.RelationCache", "[sema]") {
+  CompilationUnit cu;
+  CompilationUnit::theCU = &cu;
+  auto mod = compile(cu,
+    "class A {}\n"
+    "class B {}\n"
+    "class C extends A {}\n"
+  );
+  auto clsA = cast<TypeDefn>(mod->members()[0])->type();
+  auto clsB = cast<TypeDefn>(mod->members()[1])->type();
+  auto clsC = cast<TypeDefn>(mod->members()[2])->type();
+  auto& cache = cu.relations();
+
+  SECTION("Repeated queries hit the cache") {
+    size_t misses = cache.misses();
+    REQUIRE(isAssignable(clsA, clsC) == ConversionResult(ConversionRank::EXACT));
+    REQUIRE(cache.misses() > misses);
+    size_t hits = cache.hits();
+    misses = cache.misses();
+    REQUIRE(isAssignable(clsA, clsC) == ConversionResult(ConversionRank::EXACT));
+    REQUIRE(cache.hits() == hits + 1);
+    REQUIRE(cache.misses() == misses);
+    REQUIRE(isAssignable(clsA, clsB)
+        == ConversionResult(ConversionRank::ERROR, ConversionError::INCOMPATIBLE));
+    REQUIRE(isAssignable(clsA, clsB)
+        == ConversionResult(ConversionRank::ERROR, ConversionError::INCOMPATIBLE));
+    REQUIRE(isEqual(clsA, clsA));
+    REQUIRE(isEqual(clsA, clsA));
+    REQUIRE_FALSE(isEqual(clsA, clsC));
+    REQUIRE(isEqualOrNarrower(clsC, clsA));
+    REQUIRE(isEqualOrNarrower(clsC, clsA));
+    REQUIRE_FALSE(isEqualOrNarrower(clsA, clsC));
+  }
+
+  SECTION("Relations are cached separately") {
+    REQUIRE(isAssignable(clsA, clsC) == ConversionResult(ConversionRank::EXACT));
+    REQUIRE_FALSE(isEqual(clsA, clsC));
+    REQUIRE(isEqualOrNarrower(clsC, clsA));
+    REQUIRE(isAssignable(clsA, clsC) == ConversionResult(ConversionRank::EXACT));
+    REQUIRE_FALSE(isEqual(clsA, clsC));
+    REQUIRE(isEqualOrNarrower(clsC, clsA));
+  }
+
+  SECTION("Structural conformance is computed once") {
+    auto mod2 = compile(cu,
+      "class D { x() -> i32 { 0 } }\n"
+      "interface I { x() -> i32; }\n"
+    );
+    auto clsD = cast<TypeDefn>(mod2->members()[0]);
+    auto intI = cast<TypeDefn>(mod2->members()[1]);
+    REQUIRE(isAssignable(intI->type(), clsD->type()) == ConversionResult(ConversionRank::EXACT));
+    auto conf = cu.conformance().find(clsD, {}, intI, {});
+    REQUIRE(conf);
+    REQUIRE(conf->conforms);
+    REQUIRE(conf->witnesses.size() == 1);
+    REQUIRE(conf->witnesses[0].method->name() == "x");
+    Env env;
+    size_t hits = cu.conformance().hits();
+    REQUIRE(implementsMembers(clsD, env, intI, env));
+    REQUIRE(cu.conformance().hits() == hits + 1);
+  }
+
+  SECTION("Types containing inference variables are not cacheable") {
+    REQUIRE(RelationCache::isCacheable(clsA));
+    REQUIRE(RelationCache::isCacheable(cu.types().createUnionType({ clsA, clsB })));
+    TypeParameter tp(Location(), "T");
+    tempest::sema::infer::InferredType inferred(&tp, nullptr);
+    REQUIRE_FALSE(RelationCache::isCacheable(&inferred));
+    REQUIRE_FALSE(RelationCache::isCacheable(cu.types().createUnionType({ clsA, &inferred })));
+  }
+
+  SECTION("Types not interned by the type store are not cacheable") {
+    tempest::support::BumpPtrAllocator alloc;
+    const Type* members[] = { clsA, clsB };
+    auto temp = new (alloc) UnionType(alloc.copyOf(TypeArray(members)));
+    REQUIRE_FALSE(RelationCache::isCacheable(temp));
+    REQUIRE_FALSE(RelationCache::isCacheable(cu.types().createTupleType({ clsA, temp })));
+    REQUIRE(RelationCache::isCacheable(cu.types().createUnionType({ clsA, clsB })));
+  }
+
+  SECTION("Each thread sees the cache of its own compilation unit") {
+    CompilationUnit other;
+    RelationCache* seen = nullptr;
+    std::thread th([&]() {
+      CompilationUnit::theCU = &other;
+      seen = RelationCache::current();
+      CompilationUnit::theCU = nullptr;
+    });
+    th.join();
+    REQUIRE(seen == &other.relations());
+    REQUIRE(RelationCache::current() == &cache);
+  }
+
+  CompilationUnit::theCU = nullptr;
+}
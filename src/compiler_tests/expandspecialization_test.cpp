@@ -6,6 +6,7 @@
 #include "tempest/parse/lexer.hpp"
 #include "tempest/parse/parser.hpp"
 #include "tempest/sema/graph/expr_stmt.hpp"
+#include "tempest/sema/graph/expr_lowered.hpp"
 #include "tempest/sema/graph/expr_op.hpp"
 #include "tempest/sema/graph/module.hpp"
 #include "tempest/sema/graph/primitivetype.hpp"
@@ -16,6 +17,7 @@
 #include "tempest/sema/pass/resolvetypes.hpp"
 #include "llvm/Support/Casting.h"
 #include <iostream>
+#include <sstream>
 
 using namespace tempest::compiler;
 using namespace tempest::sema::graph;
@@ -35,7 +37,8 @@ public:
 
 namespace {
   /** Parse a module definition and apply buildgraph & nameresolution pass. */
-  std::unique_ptr<Module> compile(CompilationUnit &cu, const char* srcText) {
+  std::unique_ptr<Module> compile(
+      CompilationUnit &cu, const char* srcText, unsigned numThreads = 1) {
     diag.reset();
     auto mod = std::make_unique<Module>(std::make_unique<TestSource>(srcText), "test.mod");
     Parser parser(mod->source(), mod->astAlloc());
@@ -50,12 +53,79 @@ namespace {
     rtPass.process(mod.get());
     FindOverridesPass foPass(cu);
     foPass.process(mod.get());
-    ExpandSpecializationPass esPass(cu);
+    ExpandSpecializationPass esPass(cu, numThreads);
     esPass.process(mod.get());
     esPass.run();
     CompilationUnit::theCU = nullptr;
     return mod;
   }
+
+  /** Collect the object allocations in a lowered function body, in evaluation order. */
+  void findAllocs(Expr* e, std::vector<SymbolRefExpr*>& out) {
+    if (e == nullptr) {
+      return;
+    }
+    switch (e->kind) {
+      case Expr::Kind::ALLOC_OBJ:
+        out.push_back(static_cast<SymbolRefExpr*>(e));
+        break;
+      case Expr::Kind::GLOBAL_REF:
+        findAllocs(static_cast<SymbolRefExpr*>(e)->stem, out);
+        break;
+      case Expr::Kind::VAR_REF:
+      case Expr::Kind::FUNCTION_REF:
+        findAllocs(static_cast<DefnRef*>(e)->stem, out);
+        break;
+      case Expr::Kind::CALL: {
+        auto call = static_cast<ApplyFnOp*>(e);
+        findAllocs(call->function, out);
+        for (auto arg : call->args) {
+          findAllocs(arg, out);
+        }
+        break;
+      }
+      case Expr::Kind::BLOCK: {
+        auto block = static_cast<BlockStmt*>(e);
+        for (auto st : block->stmts) {
+          findAllocs(st, out);
+        }
+        findAllocs(block->result, out);
+        break;
+      }
+      case Expr::Kind::LOCAL_VAR:
+        findAllocs(static_cast<LocalVarStmt*>(e)->defn->init(), out);
+        break;
+      case Expr::Kind::WHILE:
+        findAllocs(static_cast<WhileStmt*>(e)->test, out);
+        findAllocs(static_cast<WhileStmt*>(e)->body, out);
+        break;
+      case Expr::Kind::ASSIGN:
+        findAllocs(static_cast<BinaryOp*>(e)->args[0], out);
+        findAllocs(static_cast<BinaryOp*>(e)->args[1], out);
+        break;
+      default:
+        break;
+    }
+  }
+
+  /** Describe an output symbol well enough to compare symbol lists between compilations. */
+  std::string describe(OutputSym* sym) {
+    std::stringstream strm;
+    strm << int(sym->kind) << " ";
+    if (auto fsym = dyn_cast<FunctionSym>(sym)) {
+      strm << fsym->function->name();
+    } else if (auto csym = dyn_cast<ClassDescriptorSym>(sym)) {
+      strm << csym->typeDefn->name();
+    } else if (auto isym = dyn_cast<InterfaceDescriptorSym>(sym)) {
+      strm << isym->typeDefn->name();
+    } else if (auto tsym = dyn_cast<ClassInterfaceTranslationSym>(sym)) {
+      strm << tsym->cls->typeDefn->name() << "/" << tsym->iface->typeDefn->name();
+    } else if (auto gsym = dyn_cast<GlobalVarSym>(sym)) {
+      strm << gsym->varDefn->name();
+    }
+    strm << sym->typeArgs;
+    return strm.str();
+  }
 }
 
 TEST_CASE("ExpandSpecialization", "[sema]") {
@@ -94,6 +164,150 @@ TEST_CASE("ExpandSpecialization", "[sema]") {
     // REQUIRE_THAT(cu.spec().concreteSpecs()[2], MemberEQ("fn y[i64]\n"));
   }
 
+  SECTION("Type-invariant statements are shared between specializations") {
+    auto mod = compile(cu,
+        "fn x(a0: f32, a1: f64) {\n"
+        "  let r0 = y(a0);\n"
+        "  let r1 = y(a1);\n"
+        "}\n"
+        "fn y[T](a: T) -> T {\n"
+        "  let b = z(3);\n"
+        "  a\n"
+        "}\n"
+        "fn z(a: i32) => a;\n"
+    );
+    REQUIRE(cu.symbols().list().size() == 4);
+    auto y0 = cast<FunctionSym>(cu.symbols().list()[2]);
+    auto y1 = cast<FunctionSym>(cu.symbols().list()[3]);
+    REQUIRE(y0->function->name() == "y");
+    REQUIRE(y1->function->name() == "y");
+    auto body0 = cast<BlockStmt>(y0->body);
+    auto body1 = cast<BlockStmt>(y1->body);
+    REQUIRE(body0 != body1);
+    REQUIRE(body0->stmts[0] == body1->stmts[0]);
+    REQUIRE(body0->stmts[0] != cast<BlockStmt>(y0->function->body())->stmts[0]);
+    REQUIRE(body0->result != body1->result);
+  }
+
+  SECTION("Devirtualize method calls with a single target") {
+    auto mod = compile(cu,
+      "class A {\n"
+      "  f() -> i32 { return 1; }\n"
+      "  g() -> i32 { return 2; }\n"
+      "}\n"
+      "class B extends A {\n"
+      "  override f() -> i32 { return 3; }\n"
+      "}\n"
+      "fn callA(a: A) -> i32 => a.f();\n"
+      "fn callB(b: B) -> i32 => b.f();\n"
+      "fn callG(a: A) -> i32 => a.g();\n"
+    );
+    auto callee = [&](StringRef name) -> OutputSym* {
+      auto fsym = cu.symbols().findFunction(name);
+      auto call = cast<ApplyFnOp>(fsym->body);
+      if (auto sref = dyn_cast<SymbolRefExpr>(call->function)) {
+        return sref->sym;
+      }
+      return nullptr;
+    };
+
+    // A.f could be either A.f or B.f, so it stays virtual.
+    REQUIRE(callee("callA") == nullptr);
+
+    // B has no subclasses.
+    auto target = dyn_cast_or_null<FunctionSym>(callee("callB"));
+    REQUIRE(target);
+    REQUIRE(target->function->name() == "f");
+    REQUIRE(cast<TypeDefn>(target->function->definedIn())->name() == "B");
+
+    // g is never overridden.
+    target = dyn_cast_or_null<FunctionSym>(callee("callG"));
+    REQUIRE(target);
+    REQUIRE(target->function->name() == "g");
+  }
+
+  SECTION("Class IDs form a range for each subtree") {
+    auto mod = compile(cu,
+      "class A {}\n"
+      "class B extends A {}\n"
+      "class C extends B {}\n"
+      "class D extends A {}\n"
+      "class E {}\n"
+    );
+    auto obj = cu.symbols().findClass("Object");
+    auto a = cu.symbols().findClass("A");
+    auto b = cu.symbols().findClass("B");
+    auto c = cu.symbols().findClass("C");
+    auto d = cu.symbols().findClass("D");
+    auto e = cu.symbols().findClass("E");
+    auto isa = [](ClassDescriptorSym* sub, ClassDescriptorSym* cls) {
+      return sub->classId >= cls->classId && sub->classId < cls->classIdEnd;
+    };
+    REQUIRE(obj->classId == 0);
+    REQUIRE(obj->classIdEnd == 6);
+    for (auto cls : { a, b, c, d, e }) {
+      REQUIRE(isa(cls, obj));
+      REQUIRE(isa(cls, cls));
+      REQUIRE(!isa(obj, cls));
+    }
+    REQUIRE(isa(c, a));
+    REQUIRE(isa(c, b));
+    REQUIRE(isa(d, a));
+    REQUIRE(!isa(d, b));
+    REQUIRE(!isa(b, d));
+    REQUIRE(!isa(e, a));
+    REQUIRE(c->classIdEnd == c->classId + 1);
+  }
+
+  SECTION("Allocations that don't escape go on the stack") {
+    auto mod = compile(cu,
+      "class P {\n"
+      "  x: i32 = 0;\n"
+      "  new(v: i32) { x = v; }\n"
+      "  value() -> i32 => x;\n"
+      "}\n"
+      "fn take(p: P) -> i32 => 0;\n"
+      "fn local() -> i32 {\n"
+      "  let p = P(1);\n"
+      "  p.value()\n"
+      "}\n"
+      "fn returned() -> P => P(2);\n"
+      "fn passed() -> i32 => take(P(3));\n"
+      "fn repeat() -> i32 {\n"
+      "  let last = P(4);\n"
+      "  loop {\n"
+      "    let next = P(5);\n"
+      "    last = P(6);\n"
+      "  }\n"
+      "  last.value()\n"
+      "}\n"
+    );
+    auto allocs = [&](StringRef name) {
+      std::vector<SymbolRefExpr*> result;
+      findAllocs(cu.symbols().findFunction(name)->body, result);
+      return result;
+    };
+
+    auto a = allocs("local");
+    REQUIRE(a.size() == 1);
+    REQUIRE(a[0]->noEscape);
+
+    a = allocs("returned");
+    REQUIRE(a.size() == 1);
+    REQUIRE_FALSE(a[0]->noEscape);
+
+    a = allocs("passed");
+    REQUIRE(a.size() == 1);
+    REQUIRE_FALSE(a[0]->noEscape);
+
+    // An object made in a loop can't outlive the iteration, since its slot is reused.
+    a = allocs("repeat");
+    REQUIRE(a.size() == 3);
+    REQUIRE(a[0]->noEscape);
+    REQUIRE(a[1]->noEscape);
+    REQUIRE_FALSE(a[2]->noEscape);
+  }
+
   SECTION("Resolve addition operator") {
     auto mod = compile(cu, "fn x(arg: i32) => arg + 1;\n");
     REQUIRE(cu.symbols().list().size() == 1);
@@ -252,3 +466,46 @@ TEST_CASE("ExpandSpecialization", "[sema]") {
     REQUIRE(fd3->function->name() == "g");
   }
 }
+
+TEST_CASE("ExpandSpecialization.parallel", "[sema]") {
+  const char* srcText =
+      "interface X[T] {\n"
+      "  f(a0: T, a1: bool) -> i32;\n"
+      "}\n"
+      "class A implements X[f32] {\n"
+      "  f(a0: f32, a1: bool) -> i32 { return 7; }\n"
+      "}\n"
+      "fn x(a0: f32, a1: f64, a2: i32) {\n"
+      "  let r0 = y(a0, a1);\n"
+      "  let r1 = y(a2, a2);\n"
+      "  let r2 = z(a0);\n"
+      "  let r3 = w(a2, a0);\n"
+      "}\n"
+      "fn y[T](a: T, b: T) => z(a);\n"
+      "fn z[T](a: T) => a;\n"
+      "fn w[T, U](a: T, b: U) => y(b, b);\n";
+
+  CompilationUnit serialCU;
+  auto serialMod = compile(serialCU, srcText);
+  std::vector<std::string> expected;
+  for (auto sym : serialCU.symbols().list()) {
+    expected.push_back(describe(sym));
+  }
+  REQUIRE(expected.size() > 8);
+
+  // The same symbols, in the same order, regardless of how the work is divided.
+  for (unsigned numThreads : { 2, 4, 8 }) {
+    CompilationUnit cu;
+    auto mod = compile(cu, srcText, numThreads);
+    std::vector<std::string> actual;
+    for (auto sym : cu.symbols().list()) {
+      actual.push_back(describe(sym));
+    }
+    REQUIRE(actual == expected);
+
+    auto cls = cu.symbols().findClass("A");
+    REQUIRE(cls->methodTable.size() == 1);
+    REQUIRE(cls->interfaceTable.size() == 1);
+    REQUIRE(cls->interfaceTable[0]->methodTable.size() == 1);
+  }
+}
@@ -362,6 +362,20 @@ TEST_CASE("FindOverrides", "[sema][override]") {
     REQUIRE(td->interfaceMethods().size() == 2);
     REQUIRE(td->interfaceMethods()[0].size() == 1);
     REQUIRE(td->interfaceMethods()[1].size() == 1);
+
+    // Interface tables are recorded in the conformance cache.
+    auto ifA = cast<TypeDefn>(mod->members()[0]);
+    auto ifB = cast<TypeDefn>(mod->members()[1]);
+    auto confA = cu.conformance().find(td, {}, ifA, {});
+    REQUIRE(confA);
+    REQUIRE(confA->conforms);
+    REQUIRE(confA->requirements.size() == 1);
+    REQUIRE(confA->requirements[0]->name() == "f");
+    REQUIRE(confA->witnesses.size() == 1);
+    REQUIRE(confA->witnesses[0].method == td->interfaceMethods()[0][0].method);
+    auto confB = cu.conformance().find(td, {}, ifB, {});
+    REQUIRE(confB);
+    REQUIRE(confB->witnesses[0].method == td->interfaceMethods()[1][0].method);
   }
 
   SECTION("Missing interface definition") {
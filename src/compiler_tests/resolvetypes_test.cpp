@@ -10,11 +10,13 @@
 #include "tempest/sema/graph/expr_stmt.hpp"
 #include "tempest/sema/graph/module.hpp"
 #include "tempest/sema/graph/primitivetype.hpp"
+#include "tempest/sema/infer/constraintsolver.hpp"
 #include "tempest/sema/pass/buildgraph.hpp"
 #include "tempest/sema/pass/nameresolution.hpp"
 #include "tempest/sema/pass/resolvetypes.hpp"
 #include "llvm/Support/Casting.h"
 #include <iostream>
+#include <sstream>
 
 using namespace tempest::compiler;
 using namespace tempest::sema::graph;
@@ -22,6 +24,7 @@ using namespace tempest::sema::pass;
 using namespace std;
 using namespace llvm;
 using tempest::parse::Parser;
+using tempest::sema::infer::ConstraintSolver;
 using tempest::source::Location;
 
 class TestSource : public tempest::source::StringSource {
@@ -209,6 +212,26 @@ TEST_CASE("ResolveTypes.Types", "[sema][resolve][types]") {
     REQUIRE_THAT(fd->type()->returnType, TypeEQ("i32"));
   }
 
+  SECTION("Resolve nested non-overloaded calls") {
+    auto mod = compile(cu,
+        "fn x() {\n"
+        "  let result = y(z(1));\n"
+        "  result\n"
+        "}\n"
+        "fn y(i: i64) => i;\n"
+        "fn z(i: i32) => i;\n"
+    );
+    auto fd = cast<FunctionDefn>(mod->members().front());
+    auto body = cast<BlockStmt>(fd->body());
+    auto letSt = cast<LocalVarStmt>(body->stmts[0]);
+    REQUIRE_THAT(letSt->defn->type(), TypeEQ("i64"));
+    auto call = cast<ApplyFnOp>(letSt->defn->init());
+    REQUIRE(call->function->kind == Expr::Kind::FUNCTION_REF);
+    REQUIRE(call->flavor == ApplyFnOp::STATIC);
+    REQUIRE(call->args.size() == 1);
+    REQUIRE_THAT(call->args[0]->type, TypeEQ("i64"));
+  }
+
   SECTION("Resolve function with parameter type error") {
     REQUIRE_THAT(
       compileError(cu,
@@ -258,6 +281,37 @@ TEST_CASE("ResolveTypes.Types", "[sema][resolve][types]") {
     REQUIRE_THAT(fd->type()->returnType, TypeEQ("i32"));
   }
 
+  SECTION("Resolve heavily overloaded function") {
+    auto mod = compile(cu,
+        "fn x() => y(true, 1);\n"
+        "fn y(i: i32) => i;\n"
+        "fn y(i: bool) => i;\n"
+        "fn y(i: i32, j: i32) => i;\n"
+        "fn y(i: bool, j: i32) => i;\n"
+        "fn y(i: f32, j: i32) => i;\n"
+        "fn y(i: bool, j: i32, k: i32, l: i32 = 0) => j;\n"
+    );
+    auto fd = cast<FunctionDefn>(mod->members().front());
+    REQUIRE_THAT(fd->type()->returnType, TypeEQ("bool"));
+    REQUIRE(cu.overloadIndices().size() == 1);
+  }
+
+  SECTION("Heavily overloaded function with no match lists every member") {
+    auto error = compileError(cu,
+        "fn x() => y(true, 1.0);\n"
+        "fn y(i: i32) => i;\n"
+        "fn y(i: bool, j: bool) => i;\n"
+        "fn y(i: i32, j: f64) => j;\n"
+        "fn y(i: bool, j: i32) => i;\n"
+    );
+    REQUIRE_THAT(error, Catch::Contains("No suitable method found for call"));
+    // The first and third members are ruled out by the overload index.
+    REQUIRE_THAT(error, Catch::Contains("expects no more than 1 arguments, 2 were supplied"));
+    REQUIRE_THAT(error, Catch::Contains("cannot convert argument 1 from bool to i32"));
+    REQUIRE_THAT(error, Catch::Contains("cannot convert argument 2 from f64 to bool"));
+    REQUIRE_THAT(error, Catch::Contains("cannot convert argument 2 from f64 to i32"));
+  }
+
   SECTION("Resolve overloaded function with type alias parameter") {
     auto mod = compile(cu,
         "fn x() {\n"
@@ -298,6 +352,71 @@ TEST_CASE("ResolveTypes.Types", "[sema][resolve][types]") {
     REQUIRE_THAT(fd->type()->returnType, TypeEQ("i32"));
   }
 
+  SECTION("Overloads exceeding the search budget") {
+    struct RestoreBudget {
+      size_t budget = ConstraintSolver::defaultSearchBudget;
+      ~RestoreBudget() { ConstraintSolver::defaultSearchBudget = budget; }
+    } restore;
+    ConstraintSolver::defaultSearchBudget = 2;
+    REQUIRE_THAT(
+      compileError(cu,
+          "fn x() {\n"
+          "  let result = y(1, 1);\n"
+          "  result\n"
+          "}\n"
+          "fn y(a: i64, b: i32) => a;\n"
+          "fn y(a: i32, b: i64) => a;\n"
+      ),
+      Catch::Contains("overload resolution gave up after 2 steps"));
+  }
+
+  SECTION("Solver profiling") {
+    tempest::sema::infer::SolverProfile profile(1);
+    struct RestoreProfile {
+      ~RestoreProfile() { ConstraintSolver::profile = nullptr; }
+    } restore;
+    ConstraintSolver::profile = &profile;
+    compile(cu,
+        "fn x() {\n"
+        "  let result = y(y(1));\n"
+        "  result\n"
+        "}\n"
+        "fn y(i: i32) => i;\n"
+        "fn y(i: f32) => i;\n"
+        "fn y(i: bool) => i;\n"
+    );
+    REQUIRE(profile.runs() >= 1);
+    auto slowest = profile.slowest();
+    REQUIRE(slowest.size() == 1);
+    REQUIRE(slowest[0].numSites == 2);
+    REQUIRE(slowest[0].numCandidates == 6);
+    REQUIRE(slowest[0].maxCandidates == 3);
+    REQUIRE(slowest[0].rejectionPasses >= 1);
+    REQUIRE_FALSE(slowest[0].cached);
+  }
+
+  SECTION("Each argument is checked for rejections once") {
+    tempest::sema::infer::SolverProfile profile(1);
+    struct RestoreProfile {
+      ~RestoreProfile() { ConstraintSolver::profile = nullptr; }
+    } restore;
+    ConstraintSolver::profile = &profile;
+    compile(cu,
+        "fn x() {\n"
+        "  let result = y(1, true, 1);\n"
+        "  result\n"
+        "}\n"
+        "fn y(a: bool, b: i32, c: i32) => b;\n"
+        "fn y(a: i32, b: bool, c: i32) => b;\n"
+        "fn y(a: i32, b: i32, c: bool) => b;\n"
+    );
+    // Every argument rejects a candidate, but the parameter types don't depend on any
+    // other site, so no check needs to be repeated.
+    auto slowest = profile.slowest();
+    REQUIRE(slowest.size() == 1);
+    REQUIRE(slowest[0].rejectionChecks == 3);
+  }
+
   SECTION("Nested overloads") {
     auto mod = compile(cu,
         "fn x() {\n"
@@ -651,6 +770,114 @@ TEST_CASE("ResolveTypes.Types", "[sema][resolve][types]") {
   }
 }
 
+namespace {
+  /** Write the signature of the chosen callee of every call in an expression. */
+  void formatCallees(std::ostream& out, const Expr* e) {
+    if (auto call = dyn_cast<ApplyFnOp>(e)) {
+      format(out, call->function->type);
+      out << "(";
+      for (auto arg : call->args) {
+        formatCallees(out, arg);
+        out << "; ";
+      }
+      out << ")";
+    } else {
+      format(out, e->type);
+    }
+  }
+
+  /** Resolve the initializer of the first local in the first function, and describe it. */
+  std::string chosenCallees(const char* srcText, size_t& searchSteps) {
+    CompilationUnit cu;
+    tempest::sema::infer::SolverProfile profile(1);
+    ConstraintSolver::profile = &profile;
+    auto mod = compile(cu, srcText);
+    ConstraintSolver::profile = nullptr;
+    searchSteps = profile.slowest().front().searchSteps;
+    auto fd = cast<FunctionDefn>(mod->members().front());
+    auto letSt = cast<LocalVarStmt>(cast<BlockStmt>(fd->body())->stmts[0]);
+    std::stringstream strm;
+    formatCallees(strm, letSt->defn->init());
+    return strm.str();
+  }
+}
+
+TEST_CASE("ResolveTypes.BoundPruning", "[sema][resolve][types]") {
+  struct RestorePruning {
+    ~RestorePruning() {
+      ConstraintSolver::boundPruning = true;
+      ConstraintSolver::profile = nullptr;
+    }
+  } restore;
+
+  // Pruning by bound must pick the same overloads as ranking every permutation.
+  const char* sources[] = {
+    "fn x() {\n"
+    "  let result = y(z(1), z(true));\n"
+    "  result\n"
+    "}\n"
+    "fn y(a: i32, b: i32) => a;\n"
+    "fn y(a: i64, b: bool) => a;\n"
+    "fn y(a: f32, b: bool) => a;\n"
+    "fn z(i: i32) => i;\n"
+    "fn z(i: f32) => i;\n"
+    "fn z(i: bool) => i;\n",
+
+    "fn x() {\n"
+    "  let result = y(y(y(y(1))));\n"
+    "  result\n"
+    "}\n"
+    "fn y(i: i32) => i;\n"
+    "fn y(i: f32) => i;\n"
+    "fn y(i: bool) => i;\n",
+
+    "fn x() {\n"
+    "  let result = y(z(1), z(1));\n"
+    "  result\n"
+    "}\n"
+    "fn y(a: i32, b: i32) => a;\n"
+    "fn y(a: i64, b: i64) => a;\n"
+    "fn y(a: f32, b: f32) => a;\n"
+    "fn z(i: i32) => i;\n"
+    "fn z(i: i16) => i;\n",
+
+  };
+
+  size_t prunedSteps = 0;
+  size_t exhaustiveSteps = 0;
+  for (auto src : sources) {
+    size_t steps = 0;
+    ConstraintSolver::boundPruning = true;
+    auto pruned = chosenCallees(src, steps);
+    prunedSteps += steps;
+    ConstraintSolver::boundPruning = false;
+    auto exhaustive = chosenCallees(src, steps);
+    exhaustiveSteps += steps;
+    REQUIRE(pruned == exhaustive);
+  }
+  REQUIRE(prunedSteps < exhaustiveSteps);
+}
+
+TEST_CASE("ConstraintSolver.ArenaPool", "[sema][infer]") {
+  const Location L;
+  tempest::support::BumpPtrAllocator* first = nullptr;
+  {
+    ConstraintSolver solver(L);
+    first = &solver.alloc();
+    solver.alloc().Allocate(64, 8);
+    REQUIRE(solver.alloc().getBytesAllocated() == 64);
+  }
+
+  // A released arena is reset and handed to the next solver on this thread.
+  ConstraintSolver solver(L);
+  REQUIRE(&solver.alloc() == first);
+  REQUIRE(solver.alloc().getBytesAllocated() == 0);
+
+  // Nested solvers each get their own.
+  ConstraintSolver nested(L);
+  REQUIRE(&nested.alloc() != first);
+}
+
 TEST_CASE("ResolveTypes.Operators", "[sema][resolve][operators]") {
   const Location L;
   CompilationUnit cu;
@@ -661,6 +888,20 @@ TEST_CASE("ResolveTypes.Operators", "[sema][resolve][operators]") {
     REQUIRE_THAT(fd->type()->returnType, TypeEQ("i32"));
   }
 
+  SECTION("Repeated operator resolution is cached") {
+    auto mod = compile(cu,
+        "fn x(a: i32, b: i32) => a + b;\n"
+        "fn y(a: i32, b: i32) => a + b;\n"
+        "fn z(a: i64, b: i64) => a + b;\n"
+    );
+    auto members = mod->members();
+    REQUIRE_THAT(cast<FunctionDefn>(members[0])->type()->returnType, TypeEQ("i32"));
+    REQUIRE_THAT(cast<FunctionDefn>(members[1])->type()->returnType, TypeEQ("i32"));
+    REQUIRE_THAT(cast<FunctionDefn>(members[2])->type()->returnType, TypeEQ("i64"));
+    REQUIRE(cu.overloads().size() == 2);
+    REQUIRE(cu.overloads().hits() == 1);
+  }
+
   SECTION("Resolve addition operator (large int") {
     auto mod = compile(cu, "fn x(arg: i32) => arg + 0x100000000;\n");
     auto fd = cast<FunctionDefn>(mod->members().front());
@@ -890,6 +1131,24 @@ TEST_CASE("ResolveTypes.Statements", "[sema][resolve][stmt]") {
     REQUIRE_THAT(fd->type()->returnType, TypeEQ("void"));
   }
 
+  SECTION("While statement keeps its body") {
+    auto mod = compile(cu,
+        "fn x(a: bool) {\n"
+        "  while a {\n"
+        "    let b = 1;\n"
+        "  }\n"
+        "}\n"
+    );
+    auto fd = cast<FunctionDefn>(mod->members().back());
+    auto body = cast<BlockStmt>(fd->body());
+    auto st = cast<WhileStmt>(body->result);
+    REQUIRE(st->test->kind == Expr::Kind::VAR_REF);
+    REQUIRE(st->body->kind == Expr::Kind::BLOCK);
+    auto loopBody = cast<BlockStmt>(st->body);
+    REQUIRE(loopBody->stmts.size() == 1);
+    REQUIRE(loopBody->stmts[0]->kind == Expr::Kind::LOCAL_VAR);
+  }
+
   SECTION("constructor call") {
     auto mod = compile(cu,
       "class A {}\n"
@@ -957,3 +1216,47 @@ TEST_CASE("ResolveTypes.Statements", "[sema][resolve][stmt]") {
     (void)mod;
   }
 }
+
+TEST_CASE("ResolveTypes.Parallel", "[sema][resolve][parallel]") {
+  CompilationUnit cu;
+
+  SECTION("Infer function bodies on multiple threads") {
+    // A chain of functions whose return types all depend on the previous function, so that
+    // workers have to wait on (or resolve) each other's results.
+    std::string srcText = "fn f0() => 1;\n";
+    for (int i = 1; i < 32; i += 1) {
+      srcText += "fn f" + std::to_string(i) + "() => f" + std::to_string(i - 1) + "();\n";
+    }
+    srcText +=
+        "class A {\n"
+        "  g() => f31();\n"
+        "}\n"
+        "let x = A();\n"
+        "let y = x.g();\n";
+
+    diag.reset();
+    auto mod = std::make_unique<Module>(
+        std::make_unique<TestSource>(srcText.c_str()), "test.mod");
+    Parser parser(mod->source(), mod->astAlloc());
+    CompilationUnit::theCU = &cu;
+    mod->setAst(parser.module());
+    cu.sourceModules().push_back(mod.get());
+    BuildGraphPass bgPass(cu);
+    bgPass.process(mod.get());
+    NameResolutionPass nrPass(cu);
+    nrPass.process(mod.get());
+    ResolveTypesPass rtPass(cu, 4);
+    rtPass.run();
+    CompilationUnit::theCU = nullptr;
+    REQUIRE(diag.errorCount() == 0);
+
+    for (auto defn : mod->members()) {
+      REQUIRE(defn->isResolved());
+      if (auto fd = dyn_cast<FunctionDefn>(defn)) {
+        REQUIRE_THAT(fd->type()->returnType, TypeEQ("i32"));
+      }
+    }
+    auto vd = cast<ValueDefn>(mod->members().back());
+    REQUIRE_THAT(vd->type(), TypeEQ("i32"));
+  }
+}
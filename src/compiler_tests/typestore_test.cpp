@@ -2,6 +2,7 @@
 #include "tempest/sema/graph/primitivetype.hpp"
 #include "tempest/sema/graph/typestore.hpp"
 #include "tempest/sema/graph/specstore.hpp"
+#include <thread>
 
 using namespace tempest::sema::graph;
 using tempest::source::Location;
@@ -45,3 +46,39 @@ TEST_CASE("TypeStore", "[type]") {
     REQUIRE(sd1 != sd3);
   }
 }
+
+TEST_CASE("TypeStore.Concurrent", "[type]") {
+  TypeStore ts;
+  SpecializationStore ss(ts.alloc());
+  TypeDefn clsDefnA(Location(), "A");
+  const size_t NUM_THREADS = 8;
+  const Type* unions[NUM_THREADS];
+  const Type* tuples[NUM_THREADS];
+  const Type* functions[NUM_THREADS];
+  const SpecializedDefn* specs[NUM_THREADS];
+
+  // Every thread creates the same types; all should receive the same instances.
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < NUM_THREADS; i += 1) {
+    threads.emplace_back([&, i]() {
+      for (int j = 0; j < 100; j += 1) {
+        ts.createTupleType({ &IntegerType::I8, ts.createUnionType({ &IntegerType::I64 }) });
+      }
+      unions[i] = ts.createUnionType({ &IntegerType::I16, &IntegerType::I32 });
+      tuples[i] = ts.createTupleType({ &IntegerType::I16, unions[i] });
+      functions[i] = ts.createFunctionType(&IntegerType::I32, { tuples[i] });
+      specs[i] = ss.specialize(&clsDefnA, { &IntegerType::I16, tuples[i] });
+    });
+  }
+  for (auto& th : threads) {
+    th.join();
+  }
+
+  for (size_t i = 1; i < NUM_THREADS; i += 1) {
+    REQUIRE(unions[i] == unions[0]);
+    REQUIRE(tuples[i] == tuples[0]);
+    REQUIRE(functions[i] == functions[0]);
+    REQUIRE(specs[i] == specs[0]);
+  }
+  REQUIRE(ss.size() == 1);
+}
@@ -67,6 +67,55 @@ TEST_CASE("Unification.primitive", "[sema]") {
   }
 }
 
+TEST_CASE("Unification.memoized", "[sema]") {
+  CompilationUnit cu;
+  std::vector<UnificationResult> result;
+  Conditions conditions;
+  tempest::support::BumpPtrAllocator alloc;
+  CompilationUnit::theCU = &cu;
+
+  SECTION("Unify non-inferred types via the relation cache") {
+    auto& cache = cu.relations();
+    REQUIRE(unify(result, &IntegerType::I32, &IntegerType::I16, conditions,
+        TypeRelation::ASSIGNABLE_FROM, alloc));
+    REQUIRE_FALSE(unify(result, &IntegerType::I16, &IntegerType::I32, conditions,
+        TypeRelation::ASSIGNABLE_FROM, alloc));
+    auto hits = cache.hits();
+    REQUIRE(unify(result, &IntegerType::I32, &IntegerType::I16, conditions,
+        TypeRelation::ASSIGNABLE_FROM, alloc));
+    REQUIRE_FALSE(unify(result, &IntegerType::I16, &IntegerType::I32, conditions,
+        TypeRelation::ASSIGNABLE_FROM, alloc));
+    REQUIRE(cache.hits() == hits + 2);
+    // Different predicates are cached separately.
+    REQUIRE_FALSE(unify(result, &IntegerType::I32, &IntegerType::I16, conditions,
+        TypeRelation::EQUAL, alloc));
+    REQUIRE(result.empty());
+  }
+
+  SECTION("Leftover union members bind to an interned union") {
+    auto mod = compile(cu,
+      "fn A[T](arg: i32 | T) -> void {}\n"
+      "fn D(arg: i32 | void | bool) -> void {}\n"
+    );
+    auto fnA = cast<FunctionDefn>(mod->members()[0]);
+    auto fnD = cast<FunctionDefn>(mod->members()[1]);
+    Env envA;
+    envA.params = fnA->typeParams();
+    InferredType a(envA.params[0], nullptr);
+    envA.args = { &a };
+    Env envD;
+
+    REQUIRE(unify(result, fnA->type()->paramTypes[0], envA, fnD->type()->paramTypes[0], envD,
+        conditions, TypeRelation::EQUAL, alloc));
+    REQUIRE(result.size() == 1);
+    REQUIRE(result[0].param == &a);
+    REQUIRE(result[0].value->interned);
+    REQUIRE(result[0].value == cu.types().createUnionType({ &VoidType::VOID, &BooleanType::BOOL }));
+  }
+
+  CompilationUnit::theCU = nullptr;
+}
+
 TEST_CASE("Unification.composite", "[sema]") {
   CompilationUnit cu;
   std::vector<UnificationResult> result;
@@ -313,6 +362,32 @@ TEST_CASE("Unification.derived", "[sema]") {
         unify(result, argA, env, argB, empty, conditions, TypeRelation::SUPERTYPE, alloc));
   }
 
+  SECTION("Failed tuple unification keeps earlier results") {
+    auto mod = compile(cu,
+      "fn A[T](arg: (T, i32)) -> void {}\n"
+      "fn B(arg: (bool, bool)) -> void {}\n"
+      "fn C(arg: (bool, i32)) -> void {}\n"
+    );
+    auto fnA = cast<FunctionDefn>(mod->members()[0]);
+    auto argA = fnA->type()->paramTypes[0];
+    auto argB = cast<FunctionDefn>(mod->members()[1])->type()->paramTypes[0];
+    auto argC = cast<FunctionDefn>(mod->members()[2])->type()->paramTypes[0];
+
+    Env env;
+    env.params = fnA->typeParams();
+    InferredType a(env.params[0], nullptr);
+    const Type* args[] = { &a };
+    env.args = args;
+
+    REQUIRE(unify(result, argA, env, argC, empty, conditions, TypeRelation::EQUAL, alloc));
+    REQUIRE(result.size() == 1);
+    // The first member binds T before the second member fails; that binding must be undone.
+    REQUIRE_FALSE(
+        unify(result, argA, env, argB, empty, conditions, TypeRelation::EQUAL, alloc));
+    REQUIRE(result.size() == 1);
+    REQUIRE_THAT(result[0].value, TypeEQ("bool"));
+  }
+
   SECTION("Unify union with union") {
     auto mod = compile(cu,
       "fn A[T](arg: i32 | void | T) -> void {}\n"
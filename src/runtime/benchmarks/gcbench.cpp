@@ -0,0 +1,180 @@
+/** Allocation-heavy benchmarks for the collector, driving the runtime directly. Objects are
+    laid out the way the compiler would lay them out, reference stores mark cards the way
+    generated code does with -gc-write-barriers, and references held by the benchmark itself
+    are registered as roots.
+
+    Usage: gcbench [depth] [-no-barriers] */
+#include "tempest/gc/object.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+using namespace tempest::gc;
+
+extern "C" {
+  extern uint8_t* gc_card_table;
+  void gc_init(int32_t writeBarriers);
+  AllocContext* gc_alloc_context();
+  ObjectHeader* gc_alloc(int64_t size, const ClassDescriptor* cls);
+  void gc_add_root(ObjectHeader** slot);
+  void gc_remove_root(ObjectHeader** slot);
+  void gc_print_stats();
+}
+
+namespace {
+  /** class Node { left: Node | void; right: Node | void; value: i64; } */
+  struct Node {
+    ObjectHeader header;
+    Node* left;
+    Node* right;
+    int64_t value;
+  };
+  const uint64_t nodeTrace[] = { 0xc };
+  const ClassDescriptor nodeClass = {
+    nullptr, nullptr, nullptr, 1, 2, sizeof(Node), 0, nodeTrace
+  };
+
+  /** class NodeArray extends FlexAlloc[Node | void] {} */
+  struct NodeArray {
+    ObjectHeader header;
+    Node* elements[];
+  };
+  const uint64_t nodeArrayTrace[] = { 0, 0x1 };
+  const ClassDescriptor nodeArrayClass = {
+    nullptr, nullptr, nullptr, 2, 3, sizeof(NodeArray), sizeof(Node*), nodeArrayTrace
+  };
+
+  /** Allocate the same way as generated code: bump the cursor if the object fits in the
+      thread's buffer, otherwise call into the runtime. */
+  ObjectHeader* allocate(AllocContext* ctx, size_t size, const ClassDescriptor* cls) {
+    size = alignSize(size);
+    if (size_t(ctx->limit - ctx->cursor) >= size && ctx->cursor) {
+      auto obj = reinterpret_cast<ObjectHeader*>(ctx->cursor);
+      ctx->cursor += size;
+      obj->cls = reinterpret_cast<uintptr_t>(cls);
+      return obj;
+    }
+    return gc_alloc(int64_t(size), cls);
+  }
+
+  Node* newNode(AllocContext* ctx) {
+    return reinterpret_cast<Node*>(allocate(ctx, sizeof(Node), &nodeClass));
+  }
+
+  NodeArray* newNodeArray(AllocContext* ctx, size_t length) {
+    auto array = reinterpret_cast<NodeArray*>(
+        allocate(ctx, sizeof(NodeArray) + length * sizeof(Node*), &nodeArrayClass));
+    array->header.gc = length;
+    return array;
+  }
+
+  /** Record a reference store into an object. */
+  void writeBarrier(const void* obj) {
+    gc_card_table[cardIndex(obj)] = CARD_DIRTY;
+  }
+
+  /** A reference held by native code, which the collector may update. */
+  template<class T> class Local {
+  public:
+    Local(T* ptr = nullptr) : _ptr(ptr) { gc_add_root(slot()); }
+    ~Local() { gc_remove_root(slot()); }
+    Local(const Local&) = delete;
+    Local& operator=(const Local&) = delete;
+    Local& operator=(T* ptr) { _ptr = ptr; return *this; }
+    T* operator->() const { return _ptr; }
+    T* get() const { return _ptr; }
+
+  private:
+    T* _ptr;
+    ObjectHeader** slot() { return reinterpret_cast<ObjectHeader**>(&_ptr); }
+  };
+
+  Node* bottomUpTree(AllocContext* ctx, int depth) {
+    Local<Node> node(newNode(ctx));
+    node->value = depth;
+    if (depth > 0) {
+      auto left = bottomUpTree(ctx, depth - 1);
+      node->left = left;
+      writeBarrier(node.get());
+      auto right = bottomUpTree(ctx, depth - 1);
+      node->right = right;
+      writeBarrier(node.get());
+    }
+    return node.get();
+  }
+
+  int64_t check(const Node* node) {
+    if (!node) {
+      return 0;
+    }
+    return 1 + check(node->left) + check(node->right);
+  }
+
+  /** The classic binary trees benchmark: many short-lived trees, and one long-lived one. */
+  int64_t binaryTrees(AllocContext* ctx, int maxDepth) {
+    int64_t result = 0;
+    Local<Node> longLived(bottomUpTree(ctx, maxDepth));
+    for (int depth = 4; depth <= maxDepth; depth += 2) {
+      int iterations = 1 << (maxDepth - depth + 4);
+      for (int i = 0; i < iterations; i += 1) {
+        result += check(bottomUpTree(ctx, depth));
+      }
+    }
+    return result + check(longLived.get());
+  }
+
+  /** Keep replacing random elements of a large, long-lived array with new nodes, so that old
+      objects keep getting references to young ones. */
+  int64_t churn(AllocContext* ctx, size_t length, size_t rounds) {
+    Local<NodeArray> array(newNodeArray(ctx, length));
+    std::mt19937_64 random(42);
+    for (size_t i = 0; i < length * rounds; i += 1) {
+      auto index = random() % length;
+      auto node = newNode(ctx);
+      node->value = int64_t(index);
+      array->elements[index] = node;
+      writeBarrier(array.get());
+    }
+    int64_t result = 0;
+    for (size_t i = 0; i < length; i += 1) {
+      if (auto node = array->elements[i]) {
+        if (node->value != int64_t(i)) {
+          std::fprintf(stderr, "churn: element %zu is corrupt.\n", i);
+          std::exit(1);
+        }
+        result += 1;
+      }
+    }
+    return result;
+  }
+
+  template<class Fn> void run(const char* name, Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    auto result = fn();
+    auto seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    std::printf("%-12s %12lld %8.3f s\n", name, static_cast<long long>(result), seconds);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  int depth = 18;
+  bool barriers = true;
+  for (int i = 1; i < argc; i += 1) {
+    if (std::strcmp(argv[i], "-no-barriers") == 0) {
+      barriers = false;
+    } else {
+      depth = std::atoi(argv[i]);
+    }
+  }
+  // Barriers are still executed without card marking; the collector just ignores them.
+  gc_init(barriers);
+  auto ctx = gc_alloc_context();
+  run("binarytrees", [&] { return binaryTrees(ctx, depth); });
+  run("churn", [&] { return churn(ctx, size_t(1) << (depth - 2), 16); });
+  gc_print_stats();
+  return 0;
+}
@@ -0,0 +1,66 @@
+#include "tempest/gc/heap.hpp"
+
+#include <cstdio>
+
+using tempest::gc::AllocContext;
+using tempest::gc::ClassDescriptor;
+using tempest::gc::Heap;
+using tempest::gc::ObjectHeader;
+using tempest::gc::StackTop;
+
+/** Entry points called by generated code. The runtime is built with frame pointers, so the
+    frame of an entry point tells where the generated code that called it left off. */
+#define CALLER_STACK_TOP(top) \
+  auto frame_ = static_cast<uintptr_t*>(__builtin_frame_address(0)); \
+  StackTop top = { frame_[1], reinterpret_cast<uintptr_t>(frame_ + 2) };
+
+extern "C" {
+  /** The card table that write barriers in generated code mark; set by gc_init. */
+  uint8_t* gc_card_table = nullptr;
+
+  /** Set up the heap. Called by the program's entry point before any generated code runs.
+      If the program was compiled with write barriers, minor collections can rely on the
+      card table. */
+  void gc_init(int32_t writeBarriers) {
+    auto& heap = Heap::get();
+    if (writeBarriers) {
+      heap.enableCardMarking();
+    }
+    gc_card_table = heap.cardTable();
+  }
+
+  AllocContext* gc_alloc_context() {
+    return Heap::get().allocContext();
+  }
+
+  __attribute__((noinline)) ObjectHeader* gc_alloc(int64_t size, const ClassDescriptor* cls) {
+    CALLER_STACK_TOP(top)
+    return Heap::get().allocSlow(size_t(size), cls, top);
+  }
+
+  /** Run a full collection. */
+  __attribute__((noinline)) void gc_collect() {
+    CALLER_STACK_TOP(top)
+    Heap::get().collect(top, true);
+  }
+
+  /** Register a slot outside of the heap, such as a global variable, that holds a
+      reference. */
+  void gc_add_root(ObjectHeader** slot) {
+    Heap::get().addRoot(slot);
+  }
+
+  void gc_remove_root(ObjectHeader** slot) {
+    Heap::get().removeRoot(slot);
+  }
+
+  void gc_print_stats() {
+    auto& stats = Heap::get().stats();
+    std::fprintf(stderr,
+        "gc: %zu MB allocated, %zu MB promoted, %zu KB old generation\n"
+        "gc: %zu minor collections (%.3f s), %zu major collections (%.3f s)\n",
+        stats.bytesAllocated >> 20, stats.bytesPromoted >> 20, stats.oldGenSize >> 10,
+        stats.minorCollections, stats.minorSeconds,
+        stats.majorCollections, stats.majorSeconds);
+  }
+}
@@ -0,0 +1,465 @@
+#include "tempest/gc/heap.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_set>
+#include <sys/mman.h>
+
+namespace tempest::gc {
+  namespace {
+    uint8_t* reserve(size_t size) {
+      void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (mem == MAP_FAILED) {
+        std::fprintf(stderr, "gc: unable to reserve %zu bytes.\n", size);
+        std::abort();
+      }
+      return static_cast<uint8_t*>(mem);
+    }
+
+    double secondsSince(std::chrono::steady_clock::time_point start) {
+      return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    inline ObjectHeader* objectAt(uint8_t* p) {
+      return reinterpret_cast<ObjectHeader*>(p);
+    }
+
+    constexpr uint16_t NO_OBJECT = 0xffff;
+  }
+
+  /** A thread's allocation buffer, and the heap that it's from. A thread allocates from one
+      heap at a time. */
+  struct Heap::ThreadContext {
+    AllocContext ctx = { nullptr, nullptr };
+    Heap* heap = nullptr;
+
+    ~ThreadContext() {
+      if (heap) {
+        heap->removeContext(this);
+      }
+    }
+  };
+
+  namespace {
+    RootTable loadedStackMaps() {
+      RootTable table;
+      if (!table.addLoadedModules()) {
+        std::abort();
+      }
+      return table;
+    }
+  }
+
+  Heap::Heap(const Options& options) : Heap(options, loadedStackMaps()) {}
+
+  Heap::Heap(const Options& options, RootTable stackMaps)
+    : _options(options)
+    , _stackMaps(std::move(stackMaps))
+    , _oldThreshold(options.oldThreshold)
+    , _cardMarking(options.cardMarking)
+  {
+    // The nursery and the old generation share one reservation, so that they map to
+    // distinct cards.
+    _nurseryStart = _nurseryTop = reserve(HEAP_RESERVE);
+    _nurseryEnd = _nurseryStart + _options.nurserySize;
+    _oldStart = _oldTop = _nurseryEnd;
+    _oldEnd = _nurseryStart + HEAP_RESERVE;
+    _cards = reserve(HEAP_RESERVE >> CARD_SHIFT);
+    _stackMaps.finish();
+  }
+
+  Heap::~Heap() {
+    for (auto thread : _contexts) {
+      thread->ctx = { nullptr, nullptr };
+      thread->heap = nullptr;
+    }
+    munmap(_nurseryStart, HEAP_RESERVE);
+    munmap(_cards, HEAP_RESERVE >> CARD_SHIFT);
+  }
+
+  Heap& Heap::get() {
+    // Never destroyed, since threads may still be running when static destructors are.
+    static Heap* heap = [] {
+      Options options;
+      if (auto nurseryKb = std::getenv("TEMPEST_NURSERY_KB")) {
+        options.nurserySize = std::max<size_t>(std::strtoull(nurseryKb, nullptr, 10), 64) << 10;
+      }
+      return new Heap(options);
+    }();
+    return *heap;
+  }
+
+  void Heap::enableCardMarking() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_cardMarking) {
+      // Stores into objects that are already in the old generation weren't recorded.
+      for (auto p = _oldStart; p < _oldTop; p += CARD_SIZE) {
+        _cards[cardIndex(p)] = CARD_DIRTY;
+      }
+      _cardMarking = true;
+    }
+  }
+
+  AllocContext* Heap::allocContext() {
+    static thread_local ThreadContext thread;
+    if (thread.heap != this) {
+      if (thread.heap) {
+        thread.heap->removeContext(&thread);
+        thread.ctx = { nullptr, nullptr };
+      }
+      std::lock_guard<std::mutex> lock(_mutex);
+      _contexts.push_back(&thread);
+      thread.heap = this;
+    }
+    return &thread.ctx;
+  }
+
+  void Heap::removeContext(ThreadContext* thread) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _contexts.erase(std::remove(_contexts.begin(), _contexts.end(), thread), _contexts.end());
+  }
+
+  ObjectHeader* Heap::allocSlow(size_t size, const ClassDescriptor* cls, const StackTop& top) {
+    size = alignSize(size);
+    auto ctx = allocContext();
+    std::lock_guard<std::mutex> lock(_mutex);
+    ObjectHeader* obj;
+    if (size > _options.bufferSize / 2) {
+      // Large objects go straight to the old generation, so they're never copied.
+      if (size_t(_oldTop - _oldStart) + size > _oldThreshold) {
+        collectLocked(top, true);
+      }
+      obj = allocOld(size);
+      std::memset(static_cast<void*>(obj), 0, size);
+      _stats.bytesAllocated += size;
+      if (_cardMarking) {
+        // Generated code doesn't mark cards for stores into an object it has just allocated,
+        // which assumes that the object is young.
+        dirtyCard(obj);
+      }
+    } else {
+      if (!refill(ctx)) {
+        collectLocked(top, false);
+        refill(ctx);
+      }
+      obj = objectAt(ctx->cursor);
+      ctx->cursor += size;
+    }
+    obj->cls = reinterpret_cast<uintptr_t>(cls);
+    return obj;
+  }
+
+  bool Heap::refill(AllocContext* ctx) {
+    if (size_t(_nurseryEnd - _nurseryTop) < _options.bufferSize) {
+      return false;
+    }
+    ctx->cursor = _nurseryTop;
+    ctx->limit = _nurseryTop + _options.bufferSize;
+    _nurseryTop = ctx->limit;
+    // Generated code only writes the header, so the buffer has to be cleared here.
+    std::memset(ctx->cursor, 0, _options.bufferSize);
+    return true;
+  }
+
+  ObjectHeader* Heap::allocOld(size_t size) {
+    if (size_t(_oldEnd - _oldTop) < size) {
+      std::fprintf(stderr, "gc: out of memory.\n");
+      std::abort();
+    }
+    auto obj = objectAt(_oldTop);
+    addObjectStart(_oldTop);
+    _oldTop += size;
+    return obj;
+  }
+
+  void Heap::addObjectStart(const uint8_t* p) {
+    // Objects are added in address order, so the first one to start in a card is the first
+    // one added to it.
+    size_t offset = p - _oldStart;
+    size_t card = offset >> CARD_SHIFT;
+    if (card >= _firstObject.size()) {
+      _firstObject.resize(card + 1, NO_OBJECT);
+      _firstObject[card] = uint16_t(offset & (CARD_SIZE - 1));
+    }
+  }
+
+  void Heap::collect(const StackTop& top, bool major) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    collectLocked(top, major);
+  }
+
+  void Heap::collectLocked(const StackTop& top, bool major) {
+    minorCollection(top);
+    if (major || size_t(_oldTop - _oldStart) > _oldThreshold) {
+      majorCollection(top);
+    }
+    _stats.oldGenSize = _oldTop - _oldStart;
+  }
+
+  void Heap::addRoot(ObjectHeader** slot) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _roots.push_back(slot);
+  }
+
+  void Heap::removeRoot(ObjectHeader** slot) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    // Roots are usually removed in the reverse order that they were added.
+    auto it = std::find(_roots.rbegin(), _roots.rend(), slot);
+    if (it != _roots.rend()) {
+      _roots.erase(std::next(it).base());
+    }
+  }
+
+  template<class Fn> void Heap::forEachStackRoot(const StackTop& top, Fn&& fn) {
+    auto returnAddress = top.returnAddress;
+    auto sp = reinterpret_cast<uint8_t*>(top.sp);
+    // Stop at the first frame that isn't from generated code.
+    while (auto safePoint = _stackMaps.find(returnAddress)) {
+      auto roots = _stackMaps.roots(safePoint);
+      for (uint32_t i = 0; i < safePoint->numRoots; i += 1) {
+        fn(roots[i], sp);
+      }
+      // The caller's return address is just above this frame.
+      sp += safePoint->frameSize;
+      std::memcpy(&returnAddress, sp, sizeof(returnAddress));
+      sp += sizeof(returnAddress);
+    }
+  }
+
+  template<class Fn> void Heap::relocateRoots(const StackTop& top, Fn&& relocate) {
+    // A stack object can be referred to from several frames (e.g. as 'self' in a callee),
+    // but relocating its fields twice would move them twice.
+    std::unordered_set<ObjectHeader*> traced;
+    std::vector<ObjectHeader*> stackObjects;
+    auto addStackObject = [&](ObjectHeader* obj) {
+      if (traced.insert(obj).second) {
+        stackObjects.push_back(obj);
+      }
+    };
+    auto update = [&](ObjectHeader** slot) {
+      if (!*slot) {
+        return;
+      }
+      if (inHeap(*slot)) {
+        *slot = relocate(*slot);
+      } else {
+        addStackObject(*slot);
+      }
+    };
+
+    // Derived pointers first, while the slots of their base objects still hold the old
+    // addresses.
+    forEachStackRoot(top, [&](const StackRoot& root, uint8_t* sp) {
+      if (root.kind == StackRoot::DERIVED) {
+        auto base = *reinterpret_cast<uint8_t**>(sp + root.base);
+        auto derived = reinterpret_cast<uint8_t**>(sp + root.offset);
+        if (base && inHeap(base)) {
+          auto moved = reinterpret_cast<uint8_t*>(relocate(objectAt(base)));
+          *derived = moved + (*derived - base);
+        }
+      }
+    });
+    forEachStackRoot(top, [&](const StackRoot& root, uint8_t* sp) {
+      if (root.kind == StackRoot::REFERENCE) {
+        update(reinterpret_cast<ObjectHeader**>(sp + root.offset));
+      } else if (root.kind == StackRoot::STACK_OBJECT) {
+        addStackObject(objectAt(sp + root.offset));
+      }
+    });
+    for (auto slot : _roots) {
+      update(slot);
+    }
+    while (!stackObjects.empty()) {
+      auto obj = stackObjects.back();
+      stackObjects.pop_back();
+      forEachReference(obj, obj->classDesc(), update);
+    }
+  }
+
+  ObjectHeader* Heap::evacuate(ObjectHeader* obj) {
+    // Old objects and stack objects stay where they are.
+    if (!inNursery(obj)) {
+      return obj;
+    }
+    if (obj->isForwarded()) {
+      return obj->forwardedTo();
+    }
+    auto size = objectSize(obj);
+    auto copy = allocOld(size);
+    std::memcpy(static_cast<void*>(copy), obj, size);
+    obj->forward(copy);
+    _stats.bytesPromoted += size;
+    return copy;
+  }
+
+  template<class Fn> void Heap::scanDirtyCards(uint8_t* end, Fn&& fn) {
+    // A write barrier marks the card of the object's header, so only the objects that start
+    // in a dirty card need scanning, though they may extend past it.
+    size_t numCards = (end - _oldStart + CARD_SIZE - 1) >> CARD_SHIFT;
+    for (size_t card = 0; card < numCards; card += 1) {
+      auto cardStart = _oldStart + (card << CARD_SHIFT);
+      auto& mark = _cards[cardIndex(cardStart)];
+      if (!mark) {
+        continue;
+      }
+      mark = 0;
+      if (_firstObject[card] == NO_OBJECT) {
+        continue;
+      }
+      auto cardEnd = std::min(cardStart + CARD_SIZE, end);
+      for (auto p = cardStart + _firstObject[card]; p < cardEnd; ) {
+        auto obj = objectAt(p);
+        auto cls = obj->classDesc();
+        forEachReference(obj, cls, fn);
+        p += objectSize(obj, cls);
+      }
+    }
+  }
+
+  void Heap::minorCollection(const StackTop& top) {
+    auto start = std::chrono::steady_clock::now();
+    _stats.bytesAllocated += _nurseryTop - _nurseryStart;
+    auto update = [this](ObjectHeader** slot) {
+      if (*slot) {
+        *slot = evacuate(*slot);
+      }
+    };
+
+    // Survivors are appended to the old generation, and then scanned in turn.
+    auto scan = _oldTop;
+    relocateRoots(top, [this](ObjectHeader* obj) { return evacuate(obj); });
+
+    if (_cardMarking) {
+      // Only old objects that have been stored into since the last collection can refer to
+      // young ones.
+      scanDirtyCards(scan, update);
+    } else {
+      // Without write barriers, any old object may refer to a young one.
+      for (auto p = _oldStart; p < scan; ) {
+        auto obj = objectAt(p);
+        auto cls = obj->classDesc();
+        forEachReference(obj, cls, update);
+        p += objectSize(obj, cls);
+      }
+    }
+
+    while (scan < _oldTop) {
+      auto obj = objectAt(scan);
+      auto cls = obj->classDesc();
+      forEachReference(obj, cls, update);
+      scan += objectSize(obj, cls);
+    }
+
+    // Everything left in the nursery is garbage. Allocation buffers handed out before the
+    // collection are no longer valid.
+    _nurseryTop = _nurseryStart;
+    for (auto thread : _contexts) {
+      thread->ctx.cursor = thread->ctx.limit = nullptr;
+    }
+    _stats.minorCollections += 1;
+    _stats.minorSeconds += secondsSince(start);
+  }
+
+  bool Heap::isMarked(const ObjectHeader* obj) const {
+    size_t word = (reinterpret_cast<const uint8_t*>(obj) - _oldStart) / sizeof(void*);
+    return (_markBits[word / 64] >> (word % 64)) & 1;
+  }
+
+  void Heap::mark(const ObjectHeader* obj, size_t size) {
+    size_t word = (reinterpret_cast<const uint8_t*>(obj) - _oldStart) / sizeof(void*);
+    size_t end = word + size / sizeof(void*);
+    while (word < end) {
+      size_t bit = word % 64;
+      size_t count = std::min<size_t>(64 - bit, end - word);
+      uint64_t bits = count == 64 ? ~uint64_t(0) : ((uint64_t(1) << count) - 1) << bit;
+      _markBits[word / 64] |= bits;
+      word += count;
+    }
+  }
+
+  ObjectHeader* Heap::newAddress(const ObjectHeader* obj) const {
+    // Live objects slide down in address order, so an object's new offset is the number of
+    // live words below it.
+    size_t word = (reinterpret_cast<const uint8_t*>(obj) - _oldStart) / sizeof(void*);
+    uint64_t below = _markBits[word / 64] & ((uint64_t(1) << (word % 64)) - 1);
+    size_t live = _liveBefore[word / 64] + __builtin_popcountll(below);
+    return objectAt(_oldStart + live * sizeof(void*));
+  }
+
+  void Heap::majorCollection(const StackTop& top) {
+    // The nursery must be empty, so every reachable object is in the old generation.
+    auto start = std::chrono::steady_clock::now();
+    size_t words = (_oldTop - _oldStart) / sizeof(void*);
+    _markBits.assign((words + 63) / 64, 0);
+
+    // Mark
+    std::vector<ObjectHeader*> pending;
+    auto markObject = [&](ObjectHeader* obj) {
+      if (inOldGen(obj) && !isMarked(obj)) {
+        mark(obj, objectSize(obj));
+        pending.push_back(obj);
+      }
+      return obj;
+    };
+    relocateRoots(top, markObject);
+    while (!pending.empty()) {
+      auto obj = pending.back();
+      pending.pop_back();
+      forEachReference(obj, obj->classDesc(), [&](ObjectHeader** slot) {
+        if (*slot) {
+          markObject(*slot);
+        }
+      });
+    }
+
+    // Compute new addresses
+    _liveBefore.resize(_markBits.size());
+    size_t live = 0;
+    for (size_t i = 0; i < _markBits.size(); i += 1) {
+      _liveBefore[i] = live;
+      live += __builtin_popcountll(_markBits[i]);
+    }
+
+    // Update references
+    auto relocate = [this](ObjectHeader* obj) {
+      return inOldGen(obj) ? newAddress(obj) : obj;
+    };
+    relocateRoots(top, relocate);
+    for (auto p = _oldStart; p < _oldTop; ) {
+      auto obj = objectAt(p);
+      auto cls = obj->classDesc();
+      if (isMarked(obj)) {
+        forEachReference(obj, cls, [&](ObjectHeader** slot) {
+          if (*slot) {
+            *slot = relocate(*slot);
+          }
+        });
+      }
+      p += objectSize(obj, cls);
+    }
+
+    // Slide live objects down. An object never moves past the start of the next one, so the
+    // headers of the objects not yet visited are still intact. The nursery is empty, so no
+    // object refers to a young one and the card table stays clean.
+    _firstObject.clear();
+    for (auto p = _oldStart; p < _oldTop; ) {
+      auto obj = objectAt(p);
+      auto size = objectSize(obj);
+      if (isMarked(obj)) {
+        auto to = newAddress(obj);
+        std::memmove(static_cast<void*>(to), obj, size);
+        addObjectStart(reinterpret_cast<uint8_t*>(to));
+      }
+      p += size;
+    }
+
+    _oldTop = _oldStart + live * sizeof(void*);
+    _oldThreshold = std::max(_options.oldThreshold, 2 * size_t(_oldTop - _oldStart));
+    _stats.majorCollections += 1;
+    _stats.majorSeconds += secondsSince(start);
+  }
+}
@@ -0,0 +1,160 @@
+#ifndef TEMPEST_GC_HEAP_HPP
+#define TEMPEST_GC_HEAP_HPP 1
+
+#ifndef TEMPEST_GC_OBJECT_HPP
+  #include "tempest/gc/object.hpp"
+#endif
+
+#ifndef TEMPEST_GC_ROOTTABLE_HPP
+  #include "tempest/gc/roottable.hpp"
+#endif
+
+#include <mutex>
+#include <vector>
+
+namespace tempest::gc {
+  /** The innermost frame of generated code, at the point where it called into the runtime.
+      Roots are found by walking the stack from here. */
+  struct StackTop {
+    uintptr_t returnAddress;
+    uintptr_t sp;
+  };
+
+  /** Collector statistics. */
+  struct HeapStats {
+    size_t minorCollections = 0;
+    size_t majorCollections = 0;
+    size_t bytesAllocated = 0;
+    size_t bytesPromoted = 0;
+    size_t oldGenSize = 0;
+    double minorSeconds = 0;
+    double majorSeconds = 0;
+  };
+
+  /** A generational, precise heap.
+
+      New objects are bump-allocated in thread-local buffers carved out of the nursery. When
+      the nursery fills up, a minor collection copies the objects in it that are still
+      reachable into the old generation, after which the whole nursery is free again. When
+      the old generation grows past a threshold, a major collection compacts it in place:
+      live objects are marked in a side bitmap with one bit per word, which is also enough to
+      compute each object's new address, so no forwarding pointers need to be stored in the
+      objects themselves.
+
+      If the generated code was compiled with write barriers, minor collections find the old
+      objects that may refer to young ones through the card table; otherwise they have to scan
+      the whole old generation.
+
+      Roots are the references in stack frames of generated code, found through the stack
+      maps, plus any slots registered with addRoot(). Collections assume that the calling
+      thread is the only one running generated code. */
+  class Heap {
+  public:
+    struct Options {
+      size_t nurserySize = 8 << 20;
+      size_t bufferSize = 32 << 10;
+      /** Minimum size of the old generation before a major collection is considered. */
+      size_t oldThreshold = 32 << 20;
+      /** Whether stores into heap objects mark cards (see CARD_SHIFT). */
+      bool cardMarking = false;
+    };
+
+    Heap(const Options& options);
+
+    /** Create a heap that finds the frames of generated code with the given stack maps,
+        rather than those of the loaded modules. */
+    Heap(const Options& options, RootTable stackMaps);
+
+    ~Heap();
+
+    /** The process-wide heap, created on first use. */
+    static Heap& get();
+
+    /** The calling thread's allocation buffer. */
+    AllocContext* allocContext();
+
+    /** Allocate a zero-filled object when the caller's allocation buffer can't hold it. */
+    ObjectHeader* allocSlow(size_t size, const ClassDescriptor* cls, const StackTop& top);
+
+    /** Run a collection now. */
+    void collect(const StackTop& top, bool major);
+
+    /** Register a slot outside of the heap and the stack that holds a reference. */
+    void addRoot(ObjectHeader** slot);
+    void removeRoot(ObjectHeader** slot);
+
+    const HeapStats& stats() const { return _stats; }
+
+    /** The card table that write barriers mark. */
+    uint8_t* cardTable() const { return _cards; }
+
+    /** Start relying on write barriers to find references from old objects to young ones. */
+    void enableCardMarking();
+
+    bool inNursery(const void* p) const { return p >= _nurseryStart && p < _nurseryEnd; }
+    bool inOldGen(const void* p) const { return p >= _oldStart && p < _oldTop; }
+
+    /** True if an address is in the heap's reservation. References to anything else are to
+        objects allocated on the stack. */
+    bool inHeap(const void* p) const { return p >= _nurseryStart && p < _oldEnd; }
+
+  private:
+    struct ThreadContext;
+
+    Options _options;
+    std::mutex _mutex;
+    RootTable _stackMaps;
+    std::vector<ObjectHeader**> _roots;
+    std::vector<ThreadContext*> _contexts;
+    HeapStats _stats;
+
+    uint8_t* _nurseryStart;
+    uint8_t* _nurseryEnd;
+    uint8_t* _nurseryTop;
+
+    uint8_t* _oldStart;
+    uint8_t* _oldTop;
+    uint8_t* _oldEnd;
+    size_t _oldThreshold;
+
+    uint8_t* _cards;
+    bool _cardMarking;
+    /** For each card of the old generation, the offset of the first object that starts in
+        it, or NO_OBJECT. */
+    std::vector<uint16_t> _firstObject;
+
+    /** One bit per word of the old generation, set for every word of a live object. */
+    std::vector<uint64_t> _markBits;
+    /** Number of live words before each word of the mark bitmap. */
+    std::vector<uint64_t> _liveBefore;
+
+    void removeContext(ThreadContext* thread);
+    bool refill(AllocContext* ctx);
+    ObjectHeader* allocOld(size_t size);
+    void addObjectStart(const uint8_t* p);
+    void dirtyCard(const ObjectHeader* obj) { _cards[cardIndex(obj)] = CARD_DIRTY; }
+
+    void collectLocked(const StackTop& top, bool major);
+    void minorCollection(const StackTop& top);
+    void majorCollection(const StackTop& top);
+    ObjectHeader* evacuate(ObjectHeader* obj);
+
+    /** Call 'fn' for each reference field of the objects in [_oldStart, end) whose card is
+        dirty, and clean the cards. */
+    template<class Fn> void scanDirtyCards(uint8_t* end, Fn&& fn);
+
+    bool isMarked(const ObjectHeader* obj) const;
+    void mark(const ObjectHeader* obj, size_t size);
+    ObjectHeader* newAddress(const ObjectHeader* obj) const;
+
+    /** Call 'fn' for each root in the stack frames of generated code. */
+    template<class Fn> void forEachStackRoot(const StackTop& top, Fn&& fn);
+
+    /** Replace every root that refers to a heap object with 'relocate(root)'. Objects on the
+        stack don't move, so the roots that refer to them are left alone, and their fields are
+        relocated instead: once each, however many roots refer to them. */
+    template<class Fn> void relocateRoots(const StackTop& top, Fn&& relocate);
+  };
+}
+
+#endif
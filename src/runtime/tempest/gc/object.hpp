@@ -0,0 +1,127 @@
+#ifndef TEMPEST_GC_OBJECT_HPP
+#define TEMPEST_GC_OBJECT_HPP 1
+
+#include <cstddef>
+#include <cstdint>
+
+namespace tempest::gc {
+  /** Alignment and rounding of heap objects; the compiler rounds allocation sizes the same
+      way (CGFunctionBuilder::genHeapAlloc). */
+  constexpr size_t OBJECT_ALIGN = sizeof(void*);
+
+  /** Address space reserved for the heap: the nursery, followed by the old generation. */
+  constexpr size_t HEAP_RESERVE = size_t(64) << 30;
+
+  /** Card marking. After storing a reference into an object, generated code sets the byte
+      of the card table that covers the object's header (CGFunctionBuilder::genWriteBarrier).
+      The card index wraps around at the size of the table, which covers exactly one heap
+      reservation, so a store into an object on the stack dirties some unrelated card instead
+      of writing outside of the table. */
+  constexpr unsigned CARD_SHIFT = 9;
+  constexpr size_t CARD_SIZE = size_t(1) << CARD_SHIFT;
+  constexpr uintptr_t CARD_INDEX_MASK = (HEAP_RESERVE >> CARD_SHIFT) - 1;
+  constexpr uint8_t CARD_DIRTY = 1;
+
+  inline size_t cardIndex(const void* p) {
+    return (reinterpret_cast<uintptr_t>(p) >> CARD_SHIFT) & CARD_INDEX_MASK;
+  }
+
+  /** Class descriptor, as laid out by CGTypeBuilder::getClassDescType. */
+  struct ClassDescriptor {
+    const ClassDescriptor* base;
+    const void* interfaces;
+    void* const* methods;
+    uint32_t classId;
+    uint32_t classIdEnd;
+    /** Size of an instance, not including any flex-allocated elements. */
+    uint32_t instanceSize;
+    /** Size of a flex-allocated element, or 0. */
+    uint32_t elementSize;
+    /** Bitmap of the words of an instance that hold references, followed by the bitmap of an
+        element; or nullptr if neither holds any. */
+    const uint64_t* trace;
+  };
+
+  /** Header at the start of every object (the fields of the intrinsic Object class). */
+  struct ObjectHeader {
+    /** Class descriptor. While a nursery object is being evacuated, this is instead its new
+        address with the low bit set. */
+    uintptr_t cls;
+    /** Number of elements, for flex-allocated objects. */
+    uintptr_t gc;
+
+    const ClassDescriptor* classDesc() const {
+      return reinterpret_cast<const ClassDescriptor*>(cls);
+    }
+
+    bool isForwarded() const { return cls & 1; }
+
+    ObjectHeader* forwardedTo() const { return reinterpret_cast<ObjectHeader*>(cls & ~1); }
+
+    void forward(ObjectHeader* to) { cls = reinterpret_cast<uintptr_t>(to) | 1; }
+  };
+
+  /** Per-thread allocation buffer, as laid out by CGTypeBuilder::getAllocContextType.
+      Generated code bumps the cursor directly; memory in [cursor, limit) is zero-filled. */
+  struct AllocContext {
+    uint8_t* cursor;
+    uint8_t* limit;
+  };
+
+  inline size_t alignSize(size_t size) {
+    return (size + OBJECT_ALIGN - 1) & ~(OBJECT_ALIGN - 1);
+  }
+
+  /** Size of an object in the heap, including padding. */
+  inline size_t objectSize(const ObjectHeader* obj, const ClassDescriptor* cls) {
+    size_t size = cls->instanceSize;
+    if (cls->elementSize) {
+      size += obj->gc * cls->elementSize;
+    }
+    return alignSize(size);
+  }
+
+  inline size_t objectSize(const ObjectHeader* obj) {
+    return objectSize(obj, obj->classDesc());
+  }
+
+  /** Call 'fn' with the address of every reference field of an object. */
+  template<class Fn>
+  inline void forEachReference(ObjectHeader* obj, const ClassDescriptor* cls, Fn&& fn) {
+    if (!cls->trace) {
+      return;
+    }
+    constexpr size_t wordBits = 64;
+    auto base = reinterpret_cast<ObjectHeader**>(obj);
+    auto map = cls->trace;
+    size_t mapWords = (cls->instanceSize / sizeof(void*) + wordBits - 1) / wordBits;
+    for (size_t w = 0; w < mapWords; w += 1) {
+      for (auto bits = map[w]; bits; bits &= bits - 1) {
+        fn(base + w * wordBits + __builtin_ctzll(bits));
+      }
+    }
+
+    if (cls->elementSize) {
+      auto elementMap = map + mapWords;
+      size_t elementMapWords = (cls->elementSize / sizeof(void*) + wordBits - 1) / wordBits;
+      bool hasReferences = false;
+      for (size_t w = 0; w < elementMapWords; w += 1) {
+        hasReferences |= elementMap[w] != 0;
+      }
+      if (!hasReferences) {
+        return;
+      }
+      auto element = reinterpret_cast<uint8_t*>(obj) + cls->instanceSize;
+      for (size_t i = 0; i < obj->gc; i += 1, element += cls->elementSize) {
+        auto elementBase = reinterpret_cast<ObjectHeader**>(element);
+        for (size_t w = 0; w < elementMapWords; w += 1) {
+          for (auto bits = elementMap[w]; bits; bits &= bits - 1) {
+            fn(elementBase + w * wordBits + __builtin_ctzll(bits));
+          }
+        }
+      }
+    }
+  }
+}
+
+#endif
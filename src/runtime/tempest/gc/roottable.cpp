@@ -0,0 +1,282 @@
+#include "tempest/gc/roottable.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__linux__)
+  #include <elf.h>
+  #include <link.h>
+#endif
+
+namespace tempest::gc {
+  namespace {
+    /** Stack map version produced by LLVM. */
+    constexpr uint8_t STACK_MAP_VERSION = 3;
+
+    /** Stack map location types. */
+    enum LocationType : uint8_t {
+      REGISTER = 1,
+      DIRECT = 2,
+      INDIRECT = 3,
+      CONSTANT = 4,
+      CONSTANT_INDEX = 5,
+    };
+
+    /** DWARF register number of the stack pointer (x86-64). */
+    constexpr uint16_t DWARF_SP = 7;
+
+    /** A statepoint record starts with constants for the calling convention, the flags and
+        the number of deopt locations. The references follow the deopt locations. */
+    constexpr uint16_t STATEPOINT_HEADER = 3;
+
+    struct Location {
+      LocationType type;
+      uint16_t size;
+      uint16_t reg;
+      int32_t offset;
+    };
+
+    /** Reads little-endian fields from the stack map; the fields aren't always aligned. */
+    class Reader {
+    public:
+      Reader(const uint8_t* pos, const uint8_t* end) : _pos(pos), _end(end) {}
+
+      template<class T> T read() {
+        T value = 0;
+        if (_pos + sizeof(T) > _end) {
+          _ok = false;
+        } else {
+          std::memcpy(&value, _pos, sizeof(T));
+          _pos += sizeof(T);
+        }
+        return value;
+      }
+
+      Location readLocation() {
+        Location loc;
+        loc.type = LocationType(read<uint8_t>());
+        read<uint8_t>();
+        loc.size = read<uint16_t>();
+        loc.reg = read<uint16_t>();
+        read<uint16_t>();
+        loc.offset = read<int32_t>();
+        return loc;
+      }
+
+      void skip(size_t n) {
+        if (_pos + n > _end) {
+          _ok = false;
+        } else {
+          _pos += n;
+        }
+      }
+
+      void align(const uint8_t* start, size_t alignment) {
+        skip((alignment - size_t(_pos - start) % alignment) % alignment);
+      }
+
+      const uint8_t* pos() const { return _pos; }
+      bool ok() const { return _ok; }
+
+    private:
+      const uint8_t* _pos;
+      const uint8_t* _end;
+      bool _ok = true;
+    };
+  }
+
+  bool RootTable::add(const uint8_t* data, size_t size) {
+    auto end = data + size;
+    while (data && data < end) {
+      // Stack maps from different object files are concatenated, each one padded out to
+      // a multiple of 8 bytes.
+      data = addStackMap(data, end);
+    }
+    return data != nullptr;
+  }
+
+  const uint8_t* RootTable::addStackMap(const uint8_t* data, const uint8_t* end) {
+    Reader in(data, end);
+    if (in.read<uint8_t>() != STACK_MAP_VERSION) {
+      std::fprintf(stderr, "gc: unsupported stack map version.\n");
+      return nullptr;
+    }
+    in.skip(3);
+    auto numFunctions = in.read<uint32_t>();
+    auto numConstants = in.read<uint32_t>();
+    in.read<uint32_t>();  // Number of records, which the function entries also add up to.
+
+    struct FunctionInfo {
+      uint64_t address;
+      uint64_t stackSize;
+      uint64_t numRecords;
+    };
+    std::vector<FunctionInfo> functions(numFunctions);
+    for (auto& fn : functions) {
+      fn.address = in.read<uint64_t>();
+      fn.stackSize = in.read<uint64_t>();
+      fn.numRecords = in.read<uint64_t>();
+    }
+    in.skip(numConstants * sizeof(uint64_t));
+
+    for (auto& fn : functions) {
+      for (uint64_t r = 0; r < fn.numRecords && in.ok(); r += 1) {
+        in.read<uint64_t>();  // Statepoint ID
+        auto callOffset = in.read<uint32_t>();
+        in.read<uint16_t>();
+        auto numLocations = in.read<uint16_t>();
+
+        SafePoint sp;
+        sp.returnAddress = uintptr_t(fn.address + callOffset);
+        sp.frameSize = uint32_t(fn.stackSize);
+        sp.firstRoot = uint32_t(_roots.size());
+        sp.numRoots = 0;
+
+        std::vector<Location> locations(numLocations);
+        for (auto& loc : locations) {
+          loc = in.readLocation();
+        }
+        in.align(data, 8);
+        in.read<uint16_t>();
+        auto numLiveOuts = in.read<uint16_t>();
+        in.skip(numLiveOuts * 4);
+        in.align(data, 8);
+
+        if (numLocations < STATEPOINT_HEADER || locations[2].type != CONSTANT) {
+          std::fprintf(stderr, "gc: stack map record is not a statepoint.\n");
+          return nullptr;
+        }
+
+        // References come in (base, derived) pairs.
+        size_t first = STATEPOINT_HEADER + size_t(locations[2].offset);
+        for (size_t i = first; i + 1 < locations.size(); i += 2) {
+          auto& base = locations[i];
+          auto& derived = locations[i + 1];
+          if (derived.type == CONSTANT || derived.type == CONSTANT_INDEX) {
+            // Null; nothing to trace.
+            continue;
+          }
+          if (derived.reg != DWARF_SP || base.reg != DWARF_SP
+              || derived.type == REGISTER || base.type == REGISTER) {
+            std::fprintf(stderr, "gc: unsupported stack root location.\n");
+            return nullptr;
+          }
+          if (base.type == DIRECT) {
+            // The base is the address of a slot in the frame, so it's an object allocated
+            // there. Pointers into it don't need updating, but it does need to be traced.
+            addRoot(sp.firstRoot, { StackRoot::STACK_OBJECT, base.offset, base.offset });
+          } else if (derived.type == DIRECT) {
+            // A pointer derived from a spilled reference can't be the address of the frame.
+            std::fprintf(stderr, "gc: stack root derived from a different object.\n");
+            return nullptr;
+          } else if (base.offset != derived.offset) {
+            // The base slot is relocated along with its derived pointers, whether or not it
+            // was also listed on its own.
+            addRoot(sp.firstRoot, { StackRoot::DERIVED, derived.offset, base.offset });
+            addRoot(sp.firstRoot, { StackRoot::REFERENCE, base.offset, base.offset });
+          } else {
+            // Stack objects usually get here too: generated code hides their address behind
+            // an inttoptr (see CGFunctionBuilder::genStackAlloc), so it's spilled like any
+            // other reference. Only the value tells them apart, so the heap has to check
+            // whether a reference points into it before moving the object.
+            addRoot(sp.firstRoot, { StackRoot::REFERENCE, derived.offset, derived.offset });
+          }
+        }
+        sp.numRoots = uint32_t(_roots.size()) - sp.firstRoot;
+        _safePoints.push_back(sp);
+      }
+    }
+
+    if (!in.ok()) {
+      std::fprintf(stderr, "gc: truncated stack map.\n");
+      return nullptr;
+    }
+    return in.pos();
+  }
+
+  void RootTable::addRoot(uint32_t firstRoot, const StackRoot& root) {
+    // The same slot is often listed more than once, e.g. as the base of several derived
+    // pointers. Only trace it once.
+    for (auto it = _roots.begin() + firstRoot; it != _roots.end(); ++it) {
+      if (it->offset == root.offset) {
+        return;
+      }
+    }
+    _roots.push_back(root);
+  }
+
+  void RootTable::finish() {
+    std::sort(_safePoints.begin(), _safePoints.end(),
+        [](const SafePoint& l, const SafePoint& r) { return l.returnAddress < r.returnAddress; });
+  }
+
+  const SafePoint* RootTable::find(uintptr_t returnAddress) const {
+    auto it = std::lower_bound(_safePoints.begin(), _safePoints.end(), returnAddress,
+        [](const SafePoint& sp, uintptr_t addr) { return sp.returnAddress < addr; });
+    if (it == _safePoints.end() || it->returnAddress != returnAddress) {
+      return nullptr;
+    }
+    return &*it;
+  }
+
+#if defined(__linux__)
+  namespace {
+    /** Find the stack map section of a loaded ELF module. The section is allocated, so its
+        contents (with relocations applied) are already in memory, but only the section
+        headers in the file say where. */
+    int findStackMapSection(struct dl_phdr_info* info, size_t, void* data) {
+      auto table = static_cast<RootTable*>(data);
+      const char* path = info->dlpi_name && info->dlpi_name[0]
+          ? info->dlpi_name : "/proc/self/exe";
+      auto file = std::fopen(path, "rb");
+      if (!file) {
+        return 0;
+      }
+
+      ElfW(Ehdr) header;
+      std::vector<ElfW(Shdr)> sections;
+      std::vector<char> names;
+      if (std::fread(&header, sizeof(header), 1, file) == 1
+          && std::memcmp(header.e_ident, ELFMAG, SELFMAG) == 0
+          && header.e_shentsize == sizeof(ElfW(Shdr))
+          && header.e_shstrndx < header.e_shnum) {
+        sections.resize(header.e_shnum);
+        if (std::fseek(file, long(header.e_shoff), SEEK_SET) != 0
+            || std::fread(sections.data(), sizeof(ElfW(Shdr)), sections.size(), file)
+                != sections.size()) {
+          sections.clear();
+        } else {
+          auto& strtab = sections[header.e_shstrndx];
+          names.resize(strtab.sh_size + 1);
+          if (std::fseek(file, long(strtab.sh_offset), SEEK_SET) != 0
+              || std::fread(names.data(), 1, strtab.sh_size, file) != strtab.sh_size) {
+            sections.clear();
+          }
+        }
+      }
+      std::fclose(file);
+
+      for (auto& section : sections) {
+        if (section.sh_name < names.size()
+            && std::strcmp(&names[section.sh_name], ".llvm_stackmaps") == 0) {
+          auto contents = reinterpret_cast<const uint8_t*>(info->dlpi_addr + section.sh_addr);
+          if (!table->add(contents, section.sh_size)) {
+            return 1;
+          }
+        }
+      }
+      return 0;
+    }
+  }
+
+  bool RootTable::addLoadedModules() {
+    return dl_iterate_phdr(findStackMapSection, this) == 0;
+  }
+#else
+  bool RootTable::addLoadedModules() {
+    std::fprintf(stderr, "gc: finding stack maps is not supported on this platform.\n");
+    return false;
+  }
+#endif
+}
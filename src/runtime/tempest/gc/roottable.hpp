@@ -0,0 +1,76 @@
+#ifndef TEMPEST_GC_ROOTTABLE_HPP
+#define TEMPEST_GC_ROOTTABLE_HPP 1
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace tempest::gc {
+  /** A location in a stack frame that holds a reference. Offsets are relative to the
+      stack pointer of the frame, as it is during the call. */
+  struct StackRoot {
+    enum Kind : uint8_t {
+      /** A spill slot holding a reference to the start of an object. This is usually a
+          heap object, but it can also be an object allocated in some frame, which the stack
+          map can't distinguish. */
+      REFERENCE,
+      /** A spill slot holding a pointer into the middle of an object. `base` is the slot
+          holding the start of that object; after the object moves, the derived pointer
+          has to be moved by the same amount. */
+      DERIVED,
+      /** An object that was allocated in the frame itself, starting at `offset`. It doesn't
+          move, but its fields have to be traced. */
+      STACK_OBJECT,
+    };
+
+    Kind kind;
+    int32_t offset;
+    int32_t base;
+  };
+
+  /** The roots that are live across one call site. */
+  struct SafePoint {
+    /** Address of the instruction following the call. */
+    uintptr_t returnAddress;
+    /** Size of the calling function's frame, not including the return address. */
+    uint32_t frameSize;
+    uint32_t firstRoot;
+    uint32_t numRoots;
+  };
+
+  /** Lookup table from return address to the stack roots at that call, built from the stack
+      maps that LLVM emits for statepoints. The stack map format is meant to be easy to
+      generate rather than easy to search, so it's converted once at startup into a single
+      sorted array of call sites, each pointing to a contiguous run of roots. */
+  class RootTable {
+  public:
+    /** Add the safepoints from a `.llvm_stackmaps` section. The section may contain several
+        stack maps, one per linked object file. Returns false if the data is malformed or
+        uses locations the collector doesn't support. */
+    bool add(const uint8_t* data, size_t size);
+
+    /** Add the stack maps from every module loaded in the process. */
+    bool addLoadedModules();
+
+    /** Sort the table. Must be called after the last `add()` and before `find()`. */
+    void finish();
+
+    /** Return the safepoint for a given return address, or nullptr if that address isn't
+        a call from generated code. */
+    const SafePoint* find(uintptr_t returnAddress) const;
+
+    /** The roots of a safepoint. */
+    const StackRoot* roots(const SafePoint* sp) const { return &_roots[sp->firstRoot]; }
+
+    size_t size() const { return _safePoints.size(); }
+
+  private:
+    std::vector<SafePoint> _safePoints;
+    std::vector<StackRoot> _roots;
+
+    const uint8_t* addStackMap(const uint8_t* data, const uint8_t* end);
+    void addRoot(uint32_t firstRoot, const StackRoot& root);
+  };
+}
+
+#endif
@@ -0,0 +1,239 @@
+#include "catch.hpp"
+#include "stackmapwriter.hpp"
+#include "tempest/gc/heap.hpp"
+#include <vector>
+
+using namespace tempest::gc;
+using namespace stackmap;
+
+namespace {
+  /** class Node { left: Node | void; right: Node | void; value: i64; } */
+  struct Node {
+    ObjectHeader header;
+    Node* left;
+    Node* right;
+    int64_t value;
+  };
+  const uint64_t nodeTrace[] = { 0xc };
+  const ClassDescriptor nodeClass = {
+    nullptr, nullptr, nullptr, 1, 2, sizeof(Node), 0, nodeTrace
+  };
+
+  /** class Bytes extends FlexAlloc[u8] {} */
+  const ClassDescriptor bytesClass = {
+    nullptr, nullptr, nullptr, 2, 3, sizeof(ObjectHeader), 1, nullptr
+  };
+
+  /** No frames of generated code. */
+  const StackTop noFrames = { 0, 0 };
+
+  Heap::Options testOptions() {
+    Heap::Options options;
+    options.nurserySize = 256 << 10;
+    options.bufferSize = 4 << 10;
+    return options;
+  }
+
+  RootTable rootTable(const std::vector<Function>& functions) {
+    RootTable table;
+    auto data = stackMap(functions);
+    REQUIRE(table.add(data.data(), data.size()));
+    return table;
+  }
+
+  /** Allocate the same way as generated code. */
+  Node* newNode(Heap& heap, int64_t value, const StackTop& top = noFrames) {
+    auto ctx = heap.allocContext();
+    ObjectHeader* obj;
+    if (ctx->cursor && size_t(ctx->limit - ctx->cursor) >= sizeof(Node)) {
+      obj = reinterpret_cast<ObjectHeader*>(ctx->cursor);
+      ctx->cursor += sizeof(Node);
+      obj->cls = reinterpret_cast<uintptr_t>(&nodeClass);
+    } else {
+      obj = heap.allocSlow(sizeof(Node), &nodeClass, top);
+    }
+    auto node = reinterpret_cast<Node*>(obj);
+    node->value = value;
+    return node;
+  }
+
+  ObjectHeader** slot(Node*& node) {
+    return reinterpret_cast<ObjectHeader**>(&node);
+  }
+
+  Node* offsetBy(Node* node, ptrdiff_t nodes) {
+    return reinterpret_cast<Node*>(reinterpret_cast<uint8_t*>(node) + nodes * sizeof(Node));
+  }
+}
+
+TEST_CASE("Heap", "[gc]") {
+  SECTION("Minor collection copies reachable objects") {
+    Heap heap(testOptions(), RootTable());
+    Node* root = newNode(heap, 1);
+    root->left = newNode(heap, 2);
+    newNode(heap, 3);
+    REQUIRE(heap.inNursery(root));
+    heap.addRoot(slot(root));
+    heap.collect(noFrames, false);
+
+    REQUIRE(heap.inOldGen(root));
+    REQUIRE(heap.inOldGen(root->left));
+    REQUIRE(root->value == 1);
+    REQUIRE(root->left->value == 2);
+    REQUIRE(root->left->left == nullptr);
+    REQUIRE(root->right == nullptr);
+    REQUIRE(heap.stats().minorCollections == 1);
+    REQUIRE(heap.stats().bytesPromoted == 2 * sizeof(Node));
+    REQUIRE(heap.stats().oldGenSize == 2 * sizeof(Node));
+
+    // The nursery is empty again.
+    REQUIRE(heap.inNursery(newNode(heap, 4)));
+    heap.removeRoot(slot(root));
+  }
+
+  SECTION("Major collection compacts the old generation") {
+    Heap heap(testOptions(), RootTable());
+    // Enough objects that the mark bitmap spans many words.
+    const size_t count = 300;
+    std::vector<Node*> nodes(count);
+    for (size_t i = 0; i < count; i += 1) {
+      nodes[i] = newNode(heap, int64_t(i));
+      heap.addRoot(slot(nodes[i]));
+    }
+    heap.collect(noFrames, false);
+    REQUIRE(heap.stats().oldGenSize == count * sizeof(Node));
+    auto first = nodes[0];
+
+    // Keep every third object, chained together from a single root.
+    Node* root = nodes[1];
+    for (size_t i = 1; i + 3 < count; i += 3) {
+      nodes[i]->left = nodes[i + 3];
+    }
+    heap.addRoot(slot(root));
+    for (size_t i = 0; i < count; i += 1) {
+      heap.removeRoot(slot(nodes[i]));
+    }
+    heap.collect(noFrames, true);
+
+    size_t live = count / 3;
+    REQUIRE(heap.stats().majorCollections == 1);
+    REQUIRE(heap.stats().oldGenSize == live * sizeof(Node));
+    // Survivors slide down in order, with no gaps.
+    REQUIRE(root == first);
+    auto node = root;
+    for (size_t k = 0; k < live; k += 1) {
+      REQUIRE(node == offsetBy(first, ptrdiff_t(k)));
+      REQUIRE(node->value == int64_t(3 * k + 1));
+      REQUIRE(node->header.classDesc() == &nodeClass);
+      node = node->left;
+    }
+    REQUIRE(node == nullptr);
+    heap.removeRoot(slot(root));
+  }
+
+  SECTION("Derived pointers are relocated with their base") {
+    // One frame, with a reference in its first slot and a pointer to the reference's
+    // 'value' field in the second.
+    Heap heap(testOptions(), rootTable({
+      { 0x1000, 16, { statepoint(0x10, { indirect(0), indirect(8) }) } },
+    }));
+    Node* garbage = newNode(heap, 0);
+    heap.addRoot(slot(garbage));
+    heap.collect(noFrames, false);
+
+    uintptr_t stack[3] = {};
+    auto obj = newNode(heap, 5);
+    stack[0] = reinterpret_cast<uintptr_t>(obj);
+    stack[1] = reinterpret_cast<uintptr_t>(&obj->value);
+    StackTop top = { 0x1010, reinterpret_cast<uintptr_t>(stack) };
+    heap.collect(top, false);
+
+    auto moved = reinterpret_cast<Node*>(stack[0]);
+    REQUIRE(heap.inOldGen(moved));
+    REQUIRE(moved == offsetBy(garbage, 1));
+    REQUIRE(stack[1] == reinterpret_cast<uintptr_t>(&moved->value));
+    REQUIRE(moved->value == 5);
+
+    // Moved again by compaction.
+    heap.removeRoot(slot(garbage));
+    heap.collect(top, true);
+    moved = reinterpret_cast<Node*>(stack[0]);
+    REQUIRE(moved == garbage);
+    REQUIRE(stack[1] == reinterpret_cast<uintptr_t>(&moved->value));
+    REQUIRE(moved->value == 5);
+  }
+
+  SECTION("Large objects are allocated in the old generation") {
+    auto options = testOptions();
+    Heap heap(options, RootTable());
+    size_t size = options.bufferSize;
+    auto obj = heap.allocSlow(size, &bytesClass, noFrames);
+    obj->gc = size - sizeof(ObjectHeader);
+    REQUIRE(heap.inOldGen(obj));
+    REQUIRE(obj->classDesc() == &bytesClass);
+    auto bytes = reinterpret_cast<uint8_t*>(obj + 1);
+    bool zero = true;
+    for (size_t i = 0; i < obj->gc; i += 1) {
+      zero &= bytes[i] == 0;
+    }
+    REQUIRE(zero);
+    REQUIRE(heap.stats().oldGenSize == 0);
+
+    // Never copied.
+    auto root = obj;
+    heap.addRoot(&root);
+    heap.collect(noFrames, false);
+    REQUIRE(root == obj);
+    REQUIRE(heap.stats().bytesPromoted == 0);
+    REQUIRE(heap.stats().oldGenSize == size);
+
+    // Small objects still go to the nursery.
+    REQUIRE(heap.inNursery(newNode(heap, 1)));
+    heap.removeRoot(&root);
+  }
+
+  SECTION("Stack objects are traced, not moved") {
+    // A method that allocates, called on an object on the caller's stack. The callee's frame
+    // holds 'self'. The caller's frame holds the object itself, at offset 16, and a
+    // reference to it.
+    Heap heap(testOptions(), rootTable({
+      { 0x1000, 16, { statepoint(0x10, { indirect(0), indirect(0) }) } },
+      { 0x2000, 64, { statepoint(0x20, { indirect(0), indirect(0), direct(16), direct(16) }) } },
+    }));
+    uintptr_t stack[12] = {};
+    auto self = reinterpret_cast<Node*>(&stack[5]);
+    self->header.cls = reinterpret_cast<uintptr_t>(&nodeClass);
+    stack[0] = reinterpret_cast<uintptr_t>(self);
+    stack[2] = 0x2020;
+    stack[3] = reinterpret_cast<uintptr_t>(self);
+    StackTop top = { 0x1010, reinterpret_cast<uintptr_t>(stack) };
+
+    // Old objects laid out as: live, garbage, live, garbage, garbage.
+    std::vector<Node*> old(5);
+    for (size_t i = 0; i < old.size(); i += 1) {
+      old[i] = newNode(heap, int64_t(i));
+      heap.addRoot(slot(old[i]));
+    }
+    heap.collect(noFrames, false);
+
+    self->left = newNode(heap, 7);
+    heap.collect(top, false);
+    REQUIRE(stack[0] == reinterpret_cast<uintptr_t>(self));
+    REQUIRE(stack[3] == reinterpret_cast<uintptr_t>(self));
+    REQUIRE(heap.inOldGen(self->left));
+    REQUIRE(self->left == offsetBy(old[0], 5));
+    REQUIRE(self->left->value == 7);
+
+    // The object is reachable three ways, but its field must only be relocated once.
+    for (size_t i : { 1, 3, 4 }) {
+      heap.removeRoot(slot(old[i]));
+    }
+    heap.collect(top, true);
+    REQUIRE(stack[0] == reinterpret_cast<uintptr_t>(self));
+    REQUIRE(old[2] == offsetBy(old[0], 1));
+    REQUIRE(self->left == offsetBy(old[0], 2));
+    REQUIRE(self->left->value == 7);
+    heap.removeRoot(slot(old[0]));
+    heap.removeRoot(slot(old[2]));
+  }
+}
@@ -0,0 +1,153 @@
+#include "catch.hpp"
+#include "stackmapwriter.hpp"
+#include "tempest/gc/roottable.hpp"
+#include <vector>
+
+using namespace tempest::gc;
+using namespace stackmap;
+
+namespace {
+  std::vector<StackRoot> rootsAt(const RootTable& table, uintptr_t returnAddress) {
+    auto sp = table.find(returnAddress);
+    REQUIRE(sp != nullptr);
+    auto roots = table.roots(sp);
+    return std::vector<StackRoot>(roots, roots + sp->numRoots);
+  }
+}
+
+TEST_CASE("RootTable", "[gc]") {
+  RootTable table;
+
+  SECTION("Reference") {
+    auto data = stackMap({ { 0x1000, 48, { statepoint(0x10, { indirect(8), indirect(8) }) } } });
+    REQUIRE(table.add(data.data(), data.size()));
+    table.finish();
+    REQUIRE(table.size() == 1);
+    auto sp = table.find(0x1010);
+    REQUIRE(sp != nullptr);
+    REQUIRE(sp->frameSize == 48);
+    auto roots = rootsAt(table, 0x1010);
+    REQUIRE(roots.size() == 1);
+    REQUIRE(roots[0].kind == StackRoot::REFERENCE);
+    REQUIRE(roots[0].offset == 8);
+  }
+
+  SECTION("Derived pointer") {
+    auto data = stackMap({ { 0x1000, 48, { statepoint(0x10, { indirect(8), indirect(16) }) } } });
+    REQUIRE(table.add(data.data(), data.size()));
+    table.finish();
+    auto roots = rootsAt(table, 0x1010);
+    // The base slot is relocated too, even though it isn't listed on its own.
+    REQUIRE(roots.size() == 2);
+    REQUIRE(roots[0].kind == StackRoot::DERIVED);
+    REQUIRE(roots[0].offset == 16);
+    REQUIRE(roots[0].base == 8);
+    REQUIRE(roots[1].kind == StackRoot::REFERENCE);
+    REQUIRE(roots[1].offset == 8);
+  }
+
+  SECTION("Stack object") {
+    auto data = stackMap({ { 0x1000, 96, {
+      statepoint(0x10, { direct(32), direct(32), direct(32), indirect(8) }),
+    } } });
+    REQUIRE(table.add(data.data(), data.size()));
+    table.finish();
+    // A spilled pointer into the object doesn't need updating.
+    auto roots = rootsAt(table, 0x1010);
+    REQUIRE(roots.size() == 1);
+    REQUIRE(roots[0].kind == StackRoot::STACK_OBJECT);
+    REQUIRE(roots[0].offset == 32);
+  }
+
+  SECTION("Null constants") {
+    auto data = stackMap({ { 0x1000, 16, {
+      statepoint(0x10, { constant(0), constant(0), indirect(0), indirect(0) }),
+    } } });
+    REQUIRE(table.add(data.data(), data.size()));
+    table.finish();
+    auto roots = rootsAt(table, 0x1010);
+    REQUIRE(roots.size() == 1);
+    REQUIRE(roots[0].offset == 0);
+  }
+
+  SECTION("Deopt locations are skipped") {
+    auto data = stackMap({ { 0x1000, 16, {
+      statepoint(0x10, { indirect(8), indirect(8) }, { constant(5), indirect(0) }),
+    } } });
+    REQUIRE(table.add(data.data(), data.size()));
+    table.finish();
+    auto roots = rootsAt(table, 0x1010);
+    REQUIRE(roots.size() == 1);
+    REQUIRE(roots[0].offset == 8);
+  }
+
+  SECTION("Duplicate slots") {
+    auto data = stackMap({ { 0x1000, 48, {
+      statepoint(0x10, {
+        indirect(8), indirect(8),
+        indirect(8), indirect(16),
+        indirect(8), indirect(8),
+        indirect(8), indirect(16),
+      }),
+    } } });
+    REQUIRE(table.add(data.data(), data.size()));
+    table.finish();
+    auto roots = rootsAt(table, 0x1010);
+    REQUIRE(roots.size() == 2);
+    REQUIRE(roots[0].kind == StackRoot::REFERENCE);
+    REQUIRE(roots[0].offset == 8);
+    REQUIRE(roots[1].kind == StackRoot::DERIVED);
+    REQUIRE(roots[1].offset == 16);
+  }
+
+  SECTION("Several functions and stack maps") {
+    Record withLiveOuts = statepoint(0x8, { indirect(0), indirect(0) });
+    withLiveOuts.numLiveOuts = 3;
+    std::vector<uint8_t> data;
+    StackMapWriter(data).write({
+      { 0x3000, 16, { withLiveOuts, statepoint(0x20, {}) } },
+      { 0x1000, 32, { statepoint(0x4, { indirect(24), indirect(24) }) } },
+    });
+    StackMapWriter(data).write({
+      { 0x2000, 64, { statepoint(0xc, { indirect(40), indirect(40) }) } },
+    });
+    REQUIRE(table.add(data.data(), data.size()));
+    table.finish();
+    REQUIRE(table.size() == 4);
+    REQUIRE(table.find(0x3008)->frameSize == 16);
+    REQUIRE(rootsAt(table, 0x3008)[0].offset == 0);
+    REQUIRE(rootsAt(table, 0x3020).empty());
+    REQUIRE(rootsAt(table, 0x1004)[0].offset == 24);
+    REQUIRE(table.find(0x200c)->frameSize == 64);
+    REQUIRE(rootsAt(table, 0x200c)[0].offset == 40);
+    REQUIRE(table.find(0x1000) == nullptr);
+    REQUIRE(table.find(0x3009) == nullptr);
+    REQUIRE(table.find(0x4000) == nullptr);
+  }
+
+  SECTION("Unsupported version") {
+    std::vector<uint8_t> data;
+    StackMapWriter(data).write({ { 0x1000, 16, { statepoint(0x10, {}) } } }, 2);
+    REQUIRE_FALSE(table.add(data.data(), data.size()));
+  }
+
+  SECTION("Truncated") {
+    auto data = stackMap({ { 0x1000, 16, { statepoint(0x10, { indirect(8), indirect(8) }) } } });
+    REQUIRE_FALSE(table.add(data.data(), data.size() - 12));
+  }
+
+  SECTION("Not a statepoint") {
+    auto data = stackMap({ { 0x1000, 16, { { 0x10, { indirect(8) } } } } });
+    REQUIRE_FALSE(table.add(data.data(), data.size()));
+  }
+
+  SECTION("Reference in a register") {
+    auto data = stackMap({ { 0x1000, 16, { statepoint(0x10, { reg(3), reg(3) }) } } });
+    REQUIRE_FALSE(table.add(data.data(), data.size()));
+  }
+
+  SECTION("Frame address derived from a spilled reference") {
+    auto data = stackMap({ { 0x1000, 16, { statepoint(0x10, { indirect(8), direct(0) }) } } });
+    REQUIRE_FALSE(table.add(data.data(), data.size()));
+  }
+}
@@ -0,0 +1,119 @@
+#ifndef TEMPEST_RUNTIME_TESTS_STACKMAPWRITER_HPP
+#define TEMPEST_RUNTIME_TESTS_STACKMAPWRITER_HPP 1
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/** Builds stack maps by hand, in the format that LLVM emits for statepoints. */
+namespace stackmap {
+  /** A location in a stack map record. */
+  struct Loc {
+    uint8_t type;
+    uint16_t reg;
+    int32_t offset;
+  };
+
+  constexpr uint16_t SP = 7;
+
+  inline Loc reg(uint16_t r) { return { 1, r, 0 }; }
+  inline Loc direct(int32_t offset) { return { 2, SP, offset }; }
+  inline Loc indirect(int32_t offset) { return { 3, SP, offset }; }
+  inline Loc constant(int32_t value) { return { 4, 0, value }; }
+
+  struct Record {
+    uint32_t callOffset;
+    std::vector<Loc> locations;
+    uint16_t numLiveOuts = 0;
+  };
+
+  /** A statepoint record: the calling convention, flags and deopt count, then the deopt
+      locations, then the (base, derived) pairs. */
+  inline Record statepoint(
+      uint32_t callOffset, std::vector<Loc> pairs, std::vector<Loc> deopt = {}) {
+    Record r { callOffset, { constant(0), constant(0), constant(int32_t(deopt.size())) } };
+    r.locations.insert(r.locations.end(), deopt.begin(), deopt.end());
+    r.locations.insert(r.locations.end(), pairs.begin(), pairs.end());
+    return r;
+  }
+
+  struct Function {
+    uint64_t address;
+    uint64_t stackSize;
+    std::vector<Record> records;
+  };
+
+  /** Writes a stack map in the format that LLVM emits (version 3). */
+  class StackMapWriter {
+  public:
+    explicit StackMapWriter(std::vector<uint8_t>& out) : _out(out), _start(out.size()) {}
+
+    void write(const std::vector<Function>& functions, uint8_t version = 3) {
+      uint32_t numRecords = 0;
+      for (auto& fn : functions) {
+        numRecords += uint32_t(fn.records.size());
+      }
+      put<uint8_t>(version);
+      put<uint8_t>(0);
+      put<uint16_t>(0);
+      put<uint32_t>(uint32_t(functions.size()));
+      put<uint32_t>(1);
+      put<uint32_t>(numRecords);
+      for (auto& fn : functions) {
+        put<uint64_t>(fn.address);
+        put<uint64_t>(fn.stackSize);
+        put<uint64_t>(fn.records.size());
+      }
+      put<uint64_t>(0x123456789);
+      for (auto& fn : functions) {
+        for (auto& r : fn.records) {
+          put<uint64_t>(0xabcdef);
+          put<uint32_t>(r.callOffset);
+          put<uint16_t>(0);
+          put<uint16_t>(uint16_t(r.locations.size()));
+          for (auto& loc : r.locations) {
+            put<uint8_t>(loc.type);
+            put<uint8_t>(0);
+            put<uint16_t>(8);
+            put<uint16_t>(loc.reg);
+            put<uint16_t>(0);
+            put<int32_t>(loc.offset);
+          }
+          align();
+          put<uint16_t>(0);
+          put<uint16_t>(r.numLiveOuts);
+          for (uint16_t i = 0; i < r.numLiveOuts; i += 1) {
+            put<uint16_t>(i);
+            put<uint8_t>(0);
+            put<uint8_t>(8);
+          }
+          align();
+        }
+      }
+    }
+
+  private:
+    std::vector<uint8_t>& _out;
+    size_t _start;
+
+    template<class T> void put(T value) {
+      uint8_t bytes[sizeof(T)];
+      std::memcpy(bytes, &value, sizeof(T));
+      _out.insert(_out.end(), bytes, bytes + sizeof(T));
+    }
+
+    void align() {
+      while ((_out.size() - _start) % 8 != 0) {
+        _out.push_back(0);
+      }
+    }
+  };
+
+  inline std::vector<uint8_t> stackMap(const std::vector<Function>& functions) {
+    std::vector<uint8_t> data;
+    StackMapWriter(data).write(functions);
+    return data;
+  }
+}
+
+#endif